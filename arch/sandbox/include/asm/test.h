@@ -79,4 +79,52 @@ long sandbox_i2c_rtc_get_set_base_time(struct udevice *dev, long base_time);
 
 int sandbox_usb_keyb_add_string(struct udevice *dev, const char *str);
 
+/**
+ * sandbox_dma_get_last() - get the last transfer of a sandbox DMA engine
+ *
+ * @dev:		DMA device
+ * @dstp:		Returns the destination of the last transfer
+ * @lenp:		Returns the length of the last transfer
+ * @return number of transfers done so far
+ */
+ulong sandbox_dma_get_last(struct udevice *dev, void **dstp, size_t *lenp);
+
+/**
+ * sandbox_mmc_set_tuning_fails() - make tuning of a sandbox MMC fail
+ *
+ * This lets the fallback from the modes which need tuning be tested.
+ *
+ * @dev:		MMC device
+ * @fails:		true to fail all tuning from now on
+ */
+void sandbox_mmc_set_tuning_fails(struct udevice *dev, bool fails);
+
+/**
+ * sandbox_mmc_set_switch_fails() - make the 1.8V switch of a sandbox MMC fail
+ *
+ * The SD card keeps DAT[3:0] low after CMD11, so that the host has to power
+ * cycle it to carry on at 3.3V.
+ *
+ * @dev:		MMC device
+ * @fails:		true to fail all switches from now on
+ */
+void sandbox_mmc_set_switch_fails(struct udevice *dev, bool fails);
+
+/**
+ * sandbox_mmc_set_no_card() - empty the slot of a sandbox MMC
+ *
+ * @dev:		MMC device
+ * @no_card:		true to take the card out, false to put it back
+ */
+void sandbox_mmc_set_no_card(struct udevice *dev, bool no_card);
+
+/**
+ * sandbox_mmc_get_cmd_count() - how many times a sandbox MMC got a command
+ *
+ * @dev:		MMC device
+ * @cmdidx:		Command index (MMC_CMD_...)
+ * @return number of those commands received since the device was probed
+ */
+uint sandbox_mmc_get_cmd_count(struct udevice *dev, uint cmdidx);
+
 #endif
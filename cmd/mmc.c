@@ -8,6 +8,8 @@
 #include <common.h>
 #include <command.h>
 #include <console.h>
+#include <div64.h>
+#include <malloc.h>
 #include <mmc.h>
 
 static int curr_device = -1;
@@ -39,6 +41,7 @@ static void print_mmcinfo(struct mmc *mmc)
 
 	printf("Bus Width: %d-bit%s\n", mmc->bus_width,
 			mmc->ddr_mode ? " DDR" : "");
+	printf("Mode: %s\n", mmc_mode_name(mmc->selected_mode));
 
 	puts("Erase Group Size: ");
 	print_size(((u64)mmc->erase_grp_size) << 9, "\n");
@@ -353,6 +356,90 @@ static int do_mmc_erase(cmd_tbl_t *cmdtp, int flag,
 
 	return (n == cnt) ? CMD_RET_SUCCESS : CMD_RET_FAILURE;
 }
+#ifdef CONFIG_CMD_MMC_BENCH
+static void show_mmc_speed(const char *name, ulong bytes, ulong time_ms)
+{
+	u64 speed = (u64)bytes * 1000;	/* KiB/s */
+
+	do_div(speed, max(time_ms, 1UL) * 1024);
+	printf("%s: %lu bytes in %lu ms, %lu KiB/s\n", name, bytes, time_ms,
+	       (ulong)speed);
+}
+
+static int do_mmc_bench(cmd_tbl_t *cmdtp, int flag,
+			int argc, char * const argv[])
+{
+	struct blk_desc *desc;
+	struct mmc *mmc;
+	u32 blk, cnt, n;
+	void *buf, *vbuf = NULL;
+	ulong start, len;
+	bool write = false;
+	int ret = CMD_RET_FAILURE;
+
+	if (argc == 4 && !strcmp(argv[3], "write"))
+		write = true;
+	else if (argc != 3)
+		return CMD_RET_USAGE;
+
+	blk = simple_strtoul(argv[1], NULL, 16);
+	cnt = simple_strtoul(argv[2], NULL, 16);
+
+	mmc = init_mmc_device(curr_device, false);
+	if (!mmc)
+		return CMD_RET_FAILURE;
+	desc = mmc_get_blk_desc(mmc);
+	if (write && mmc_getwp(mmc) == 1) {
+		printf("Error: card is write protected!\n");
+		return CMD_RET_FAILURE;
+	}
+
+	len = cnt * desc->blksz;
+	buf = memalign(ARCH_DMA_MINALIGN, len);
+	if (write)
+		vbuf = memalign(ARCH_DMA_MINALIGN, len);
+	if (!buf || (write && !vbuf)) {
+		printf("Cannot allocate memory (%lu bytes)\n", len);
+		goto out;
+	}
+
+	printf("MMC bench: dev # %d, block # %d, count %d\n", curr_device,
+	       blk, cnt);
+
+	/* Time the card, not the block cache */
+	blkcache_invalidate(desc->if_type, desc->devnum);
+	start = get_timer(0);
+	n = blk_dread(desc, blk, cnt, buf);
+	if (n != cnt) {
+		printf("Read failed\n");
+		goto out;
+	}
+	show_mmc_speed("read", len, get_timer(start));
+
+	if (write) {
+		/* Write back what was read, so the card is left as it was */
+		start = get_timer(0);
+		n = blk_dwrite(desc, blk, cnt, buf);
+		if (n != cnt) {
+			printf("Write failed\n");
+			goto out;
+		}
+		show_mmc_speed("write", len, get_timer(start));
+
+		n = blk_dread(desc, blk, cnt, vbuf);
+		if (n != cnt || memcmp(buf, vbuf, len)) {
+			printf("Verify failed\n");
+			goto out;
+		}
+	}
+	ret = CMD_RET_SUCCESS;
+out:
+	free(vbuf);
+	free(buf);
+
+	return ret;
+}
+#endif
 static int do_mmc_rescan(cmd_tbl_t *cmdtp, int flag,
 			 int argc, char * const argv[])
 {
@@ -759,6 +846,9 @@ static cmd_tbl_t cmd_mmc[] = {
 	U_BOOT_CMD_MKENT(read, 4, 1, do_mmc_read, "", ""),
 	U_BOOT_CMD_MKENT(write, 4, 0, do_mmc_write, "", ""),
 	U_BOOT_CMD_MKENT(erase, 3, 0, do_mmc_erase, "", ""),
+#ifdef CONFIG_CMD_MMC_BENCH
+	U_BOOT_CMD_MKENT(bench, 4, 0, do_mmc_bench, "", ""),
+#endif
 	U_BOOT_CMD_MKENT(rescan, 1, 1, do_mmc_rescan, "", ""),
 	U_BOOT_CMD_MKENT(part, 1, 1, do_mmc_part, "", ""),
 	U_BOOT_CMD_MKENT(dev, 3, 0, do_mmc_dev, "", ""),
@@ -812,6 +902,10 @@ U_BOOT_CMD(
 	"mmc read addr blk# cnt\n"
 	"mmc write addr blk# cnt\n"
 	"mmc erase blk# cnt\n"
+#ifdef CONFIG_CMD_MMC_BENCH
+	"mmc bench blk# cnt [write] - time reading cnt blocks, and writing\n"
+	"    them back\n"
+#endif
 	"mmc rescan\n"
 	"mmc part - lists available partition on current mmc device\n"
 	"mmc dev [dev] [part] - show or set current mmc device [partition]\n"
@@ -9,6 +9,7 @@
 #include <common.h>
 #include <div64.h>
 #include <dm.h>
+#include <errno.h>
 #include <malloc.h>
 #include <mapmem.h>
 #include <spi.h>
@@ -84,6 +85,7 @@ static int do_spi_flash_probe(int argc, char * const argv[])
 	unsigned int cs = CONFIG_SF_DEFAULT_CS;
 	unsigned int speed = CONFIG_SF_DEFAULT_SPEED;
 	unsigned int mode = CONFIG_SF_DEFAULT_MODE;
+	bool force = false;
 	char *endp;
 #ifdef CONFIG_DM_SPI_FLASH
 	struct udevice *new, *bus_dev;
@@ -94,6 +96,12 @@ static int do_spi_flash_probe(int argc, char * const argv[])
 	struct spi_flash *new;
 #endif
 
+	if (argc >= 2 && !strcmp(argv[1], "-f")) {
+		force = true;
+		argc--;
+		argv++;
+	}
+
 	if (argc >= 2) {
 		cs = simple_strtoul(argv[1], &endp, 0);
 		if (*argv[1] == 0 || (*endp != 0 && *endp != ':'))
@@ -121,11 +129,12 @@ static int do_spi_flash_probe(int argc, char * const argv[])
 	}
 
 #ifdef CONFIG_DM_SPI_FLASH
-	/* Remove the old device, otherwise probe will just be a nop */
-	ret = spi_find_bus_and_cs(bus, cs, &bus_dev, &new);
-	if (!ret) {
+	/*
+	 * A flash probed before is kept unless the speed or mode changes.
+	 * Remove it to scan it again
+	 */
+	if (force && !spi_find_bus_and_cs(bus, cs, &bus_dev, &new))
 		device_remove(new);
-	}
 	flash = NULL;
 	ret = spi_flash_probe_bus_cs(bus, cs, speed, mode, &new);
 	if (ret) {
@@ -153,55 +162,31 @@ static int do_spi_flash_probe(int argc, char * const argv[])
 	return 0;
 }
 
-/**
- * Write a block of data to SPI flash, first checking if it is different from
- * what is already there.
- *
- * If the data being written is the same, then *skipped is incremented by len.
- *
- * @param flash		flash context pointer
- * @param offset	flash offset to write
- * @param len		number of bytes to write
- * @param buf		buffer to write from
- * @param cmp_buf	read buffer to use to compare data
- * @param skipped	Count of skipped data (incremented by this function)
- * @return NULL if OK, else a string containing the stage which failed
- */
-static const char *spi_flash_update_block(struct spi_flash *flash, u32 offset,
-		size_t len, const char *buf, char *cmp_buf, size_t *skipped)
+/* Progress of an update, shown as spi_flash_update() goes along */
+struct sf_update_progress {
+	struct spi_flash_update_stats stats;
+	size_t len;
+	size_t scale;
+	ulong start_time;
+	ulong last_update;
+};
+
+static void sf_update_show_progress(struct spi_flash_update_stats *stats)
 {
-	char *ptr = (char *)buf;
-
-	debug("offset=%#x, sector_size=%#x, len=%#zx\n",
-	      offset, flash->sector_size, len);
-	/* Read the entire sector so to allow for rewriting */
-	if (spi_flash_read(flash, offset, flash->sector_size, cmp_buf))
-		return "read";
-	/* Compare only what is meaningful (len) */
-	if (memcmp(cmp_buf, buf, len) == 0) {
-		debug("Skip region %x size %zx: no change\n",
-		      offset, len);
-		*skipped += len;
-		return NULL;
-	}
-	/* Erase the entire sector */
-	if (spi_flash_erase(flash, offset, flash->sector_size))
-		return "erase";
-	/* If it's a partial sector, copy the data into the temp-buffer */
-	if (len != flash->sector_size) {
-		memcpy(cmp_buf, buf, len);
-		ptr = cmp_buf;
-	}
-	/* Write one complete sector */
-	if (spi_flash_write(flash, offset, flash->sector_size, ptr))
-		return "write";
-
-	return NULL;
+	struct sf_update_progress *prog;
+
+	prog = container_of(stats, struct sf_update_progress, stats);
+	if (get_timer(prog->last_update) <= 100)
+		return;
+	printf("   \rUpdating, %zu%% %lu B/s",
+	       100 - (prog->len - stats->done) / prog->scale,
+	       bytes_per_second(stats->done, prog->start_time));
+	prog->last_update = get_timer(0);
 }
 
 /**
- * Update an area of SPI flash by erasing and writing any blocks which need
- * to change. Existing blocks with the correct data are left unchanged.
+ * Update an area of SPI flash by erasing and writing only what needs to
+ * change. Existing data which is already correct is left unchanged.
  *
  * @param flash		flash context pointer
  * @param offset	flash offset to write
@@ -209,63 +194,92 @@ static const char *spi_flash_update_block(struct spi_flash *flash, u32 offset,
  * @param buf		buffer to write from
  * @return 0 if ok, 1 on error
  */
-static int spi_flash_update(struct spi_flash *flash, u32 offset,
+static int do_spi_flash_update(struct spi_flash *flash, u32 offset,
 		size_t len, const char *buf)
 {
-	const char *err_oper = NULL;
-	char *cmp_buf;
-	const char *end = buf + len;
-	size_t todo;		/* number of bytes to do in this pass */
-	size_t skipped = 0;	/* statistics */
+	struct sf_update_progress prog;
+	struct spi_flash_update_stats *stats = &prog.stats;
 	const ulong start_time = get_timer(0);
-	size_t scale = 1;
-	const char *start_buf = buf;
 	ulong delta;
+	int ret;
 
-	if (end - buf >= 200)
-		scale = (end - buf) / 100;
-	cmp_buf = memalign(ARCH_DMA_MINALIGN, flash->sector_size);
-	if (cmp_buf) {
-		ulong last_update = get_timer(0);
-
-		for (; buf < end && !err_oper; buf += todo, offset += todo) {
-			todo = min_t(size_t, end - buf, flash->sector_size);
-			if (get_timer(last_update) > 100) {
-				printf("   \rUpdating, %zu%% %lu B/s",
-				       100 - (end - buf) / scale,
-					bytes_per_second(buf - start_buf,
-							 start_time));
-				last_update = get_timer(0);
-			}
-			err_oper = spi_flash_update_block(flash, offset, todo,
-					buf, cmp_buf, &skipped);
-		}
-	} else {
-		err_oper = "malloc";
-	}
-	free(cmp_buf);
+	memset(&prog, '\0', sizeof(prog));
+	stats->progress = sf_update_show_progress;
+	prog.len = len;
+	prog.scale = len >= 200 ? len / 100 : 1;
+	prog.start_time = start_time;
+	prog.last_update = start_time;
+
+	/* The whole range in one go, so erases run ahead across it */
+	ret = spi_flash_update(flash, offset, len, buf, stats);
 	putc('\r');
-	if (err_oper) {
-		printf("SPI flash failed in %s step\n", err_oper);
+	if (ret) {
+		printf("SPI flash update failed (err=%d)\n", ret);
 		return 1;
 	}
 
 	delta = get_timer(start_time);
-	printf("%zu bytes written, %zu bytes skipped", len - skipped,
-	       skipped);
+	printf("%zu bytes written, %zu bytes skipped", len - stats->skipped,
+	       stats->skipped);
+	printf(" (%zu erased, %zu programmed)", stats->erased,
+	       stats->programmed);
 	printf(" in %ld.%lds, speed %ld B/s\n",
 	       delta / 1000, delta % 1000, bytes_per_second(len, start_time));
 
 	return 0;
 }
 
+#ifdef CONFIG_SPI_FLASH_VERIFY
+/* Names of the checksums of a verified write, as the command suffix */
+static const char *const spi_flash_verify_names[] = {
+	[SPI_FLASH_VERIFY_NONE]		= "verify",
+	[SPI_FLASH_VERIFY_CRC32]	= "crc32",
+	[SPI_FLASH_VERIFY_SHA256]	= "sha256",
+};
+
+static void spi_flash_print_verify(struct spi_flash_verify *verify)
+{
+	uint i;
+
+	printf("SF: verified");
+	if (verify->digest_len) {
+		printf(", %s ", spi_flash_verify_names[verify->algo]);
+		for (i = 0; i < verify->digest_len; i++)
+			printf("%02x", verify->digest[i]);
+	}
+	putc('\n');
+}
+#endif
+
+/* Work out the verify a write.<suffix> or update.<suffix> asks for */
+static int spi_flash_verify_algo(const char *cmd)
+{
+	const char *suffix = strchr(cmd, '.');
+	__maybe_unused int i;
+
+	if (!suffix)
+		return -ENOENT;
+#ifdef CONFIG_SPI_FLASH_VERIFY
+	for (i = 0; i < ARRAY_SIZE(spi_flash_verify_names); i++) {
+		if (!strcmp(suffix + 1, spi_flash_verify_names[i]))
+			return i;
+	}
+#endif
+
+	return -EINVAL;
+}
+
 static int do_spi_flash_read_write(int argc, char * const argv[])
 {
+#ifdef CONFIG_SPI_FLASH_VERIFY
+	struct spi_flash_verify verify;
+#endif
 	unsigned long addr;
 	void *buf;
 	char *endp;
 	int ret = 1;
 	int dev = 0;
+	int algo;
 	loff_t offset, len, maxsize;
 
 	if (argc < 3)
@@ -275,6 +289,10 @@ static int do_spi_flash_read_write(int argc, char * const argv[])
 	if (*argv[1] == 0 || *endp != 0)
 		return -1;
 
+	algo = spi_flash_verify_algo(argv[0]);
+	if (algo == -EINVAL)
+		return -1;
+
 	if (mtd_arg_off_size(argc - 2, &argv[2], &dev, &offset, &len,
 			     &maxsize, MTD_DEV_TYPE_NOR, flash->size))
 		return -1;
@@ -292,8 +310,19 @@ static int do_spi_flash_read_write(int argc, char * const argv[])
 		return 1;
 	}
 
-	if (strcmp(argv[0], "update") == 0) {
-		ret = spi_flash_update(flash, offset, len, buf);
+#ifdef CONFIG_SPI_FLASH_VERIFY
+	if (algo >= 0) {
+		ret = spi_flash_verify_begin(flash, &verify, algo, offset, len);
+		if (ret) {
+			printf("SF: cannot verify %s (err=%d)\n", argv[0], ret);
+			unmap_physmem(buf, len);
+			return 1;
+		}
+	}
+#endif
+
+	if (strncmp(argv[0], "update", 6) == 0) {
+		ret = do_spi_flash_update(flash, offset, len, buf);
 	} else if (strncmp(argv[0], "read", 4) == 0 ||
 			strncmp(argv[0], "write", 5) == 0) {
 		int read;
@@ -308,15 +337,56 @@ static int do_spi_flash_read_write(int argc, char * const argv[])
 		       read ? "Read" : "Written");
 		if (ret)
 			printf("ERROR %d\n", ret);
+		else if (!read && flash->write_stats.pages)
+			printf("OK (%u pages, %u polls, %lu us)\n",
+			       flash->write_stats.pages,
+			       flash->write_stats.polls,
+			       flash->write_stats.time_us);
 		else
 			printf("OK\n");
 	}
 
+#ifdef CONFIG_SPI_FLASH_VERIFY
+	if (algo >= 0) {
+		int verify_ret = spi_flash_verify_end(flash, &verify);
+
+		if (!ret) {
+			ret = verify_ret;
+			if (ret)
+				printf("SF: verify incomplete\n");
+			else
+				spi_flash_print_verify(&verify);
+		}
+	}
+#endif
+
 	unmap_physmem(buf, len);
 
 	return ret == 0 ? 0 : 1;
 }
 
+/* Show how many commands of each erase size the last erase took */
+static void spi_flash_print_erase_stats(struct spi_flash *flash)
+{
+	const char *sep = " (";
+	int i;
+
+	if (flash->erase_chip_count) {
+		puts(" (chip erase)");
+		return;
+	}
+
+	for (i = 0; i < SPI_FLASH_MAX_ERASE_TYPES; i++) {
+		if (!flash->erase_types[i].count)
+			continue;
+		printf("%s%u x ", sep, flash->erase_types[i].count);
+		print_size(flash->erase_types[i].size, "");
+		sep = ", ";
+	}
+	if (*sep == ',')
+		puts(")");
+}
+
 static int do_spi_flash_erase(int argc, char * const argv[])
 {
 	int ret;
@@ -343,8 +413,11 @@ static int do_spi_flash_erase(int argc, char * const argv[])
 	}
 
 	ret = spi_flash_erase(flash, offset, size);
-	printf("SF: %zu bytes @ %#x Erased: %s\n", (size_t)size, (u32)offset,
+	printf("SF: %zu bytes @ %#x Erased: %s", (size_t)size, (u32)offset,
 	       ret ? "ERROR" : "OK");
+	if (!ret)
+		spi_flash_print_erase_stats(flash);
+	puts("\n");
 
 	return ret == 0 ? 0 : 1;
 }
@@ -380,6 +453,30 @@ static int do_spi_protect(int argc, char * const argv[])
 	return ret == 0 ? 0 : 1;
 }
 
+#ifdef CONFIG_SPI_FLASH_CACHE
+static int do_spi_flash_cache(int argc, char * const argv[])
+{
+	struct spi_flash_cache_stats stats;
+	bool reset = false;
+
+	if (argc > 2)
+		return -1;
+	if (argc == 2) {
+		if (strcmp(argv[1], "reset"))
+			return -1;
+		reset = true;
+	}
+
+	spi_flash_cache_stats(&stats, reset);
+	printf("SF: cache %u/%u lines of ", stats.lines, stats.max_lines);
+	print_size(CONFIG_SPI_FLASH_CACHE_LINE, "");
+	printf(", %u hits, %u misses, %u read ahead\n", stats.hits,
+	       stats.misses, stats.readahead);
+
+	return 0;
+}
+#endif
+
 #ifdef CONFIG_CMD_SF_TEST
 enum {
 	STAGE_ERASE,
@@ -561,6 +658,13 @@ static int do_spi_flash(cmd_tbl_t *cmdtp, int flag, int argc,
 		goto done;
 	}
 
+#ifdef CONFIG_SPI_FLASH_CACHE
+	if (strcmp(cmd, "cache") == 0) {
+		ret = do_spi_flash_cache(argc, argv);
+		goto done;
+	}
+#endif
+
 	/* The remaining commands require a selected device */
 	if (!flash) {
 		puts("No SPI flash selected. Please run `sf probe'\n");
@@ -568,7 +672,8 @@ static int do_spi_flash(cmd_tbl_t *cmdtp, int flag, int argc,
 	}
 
 	if (strcmp(cmd, "read") == 0 || strcmp(cmd, "write") == 0 ||
-	    strcmp(cmd, "update") == 0)
+	    strcmp(cmd, "update") == 0 || strncmp(cmd, "write.", 6) == 0 ||
+	    strncmp(cmd, "update.", 7) == 0)
 		ret = do_spi_flash_read_write(argc, argv);
 	else if (strcmp(cmd, "erase") == 0)
 		ret = do_spi_flash_erase(argc, argv);
@@ -589,6 +694,24 @@ usage:
 	return CMD_RET_USAGE;
 }
 
+#ifdef CONFIG_SPI_FLASH_VERIFY
+#define SF_VERIFY_HELP \
+		"\nsf write.<v>|update.<v> addr offset|partition len\n" \
+		"					- write or update, reading back\n" \
+		"					  each page as it is programmed.\n" \
+		"					  <v> is verify, crc32 or sha256,\n" \
+		"					  the checksum of the data to show"
+#else
+#define SF_VERIFY_HELP
+#endif
+
+#ifdef CONFIG_SPI_FLASH_CACHE
+#define SF_CACHE_HELP "\nsf cache [reset]		" \
+		"- show read cache statistics, and reset them"
+#else
+#define SF_CACHE_HELP
+#endif
+
 #ifdef CONFIG_CMD_SF_TEST
 #define SF_TEST_HELP "\nsf test offset len		" \
 		"- run a very basic destructive test"
@@ -597,10 +720,11 @@ usage:
 #endif
 
 U_BOOT_CMD(
-	sf,	5,	1,	do_spi_flash,
+	sf,	6,	1,	do_spi_flash,
 	"SPI flash sub-system",
-	"probe [[bus:]cs] [hz] [mode]	- init flash device on given SPI bus\n"
-	"				  and chip select\n"
+	"probe [-f] [[bus:]cs] [hz] [mode]	- init flash device on given SPI bus\n"
+	"				  and chip select. -f scans a flash\n"
+	"				  probed before again\n"
 	"sf read addr offset|partition len	- read `len' bytes starting at\n"
 	"				          `offset' or from start of mtd\n"
 	"					  `partition'to memory at `addr'\n"
@@ -614,6 +738,8 @@ U_BOOT_CMD(
 	"					  at `addr' to flash at `offset'\n"
 	"					  or to start of mtd `partition'\n"
 	"sf protect lock/unlock sector len	- protect/unprotect 'len' bytes starting\n"
-	"					  at address 'sector'\n"
+	"					  at address 'sector'"
+	SF_VERIFY_HELP
+	SF_CACHE_HELP
 	SF_TEST_HELP
 );
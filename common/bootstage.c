@@ -150,6 +150,24 @@ uint32_t bootstage_accum(enum bootstage_id id)
 	return duration;
 }
 
+uint32_t bootstage_add_duration(const char *name, uint32_t duration_us)
+{
+	struct bootstage_record *rec;
+	enum bootstage_id id = next_id++;
+
+	if (id < BOOTSTAGE_ID_COUNT) {
+		rec = &record[id];
+		/* A start time is what marks this as an accumulator */
+		rec->start_us = max((uint32_t)timer_get_boot_us() - duration_us,
+				    1U);
+		rec->time_us = duration_us;
+		rec->name = name;
+		rec->id = id;
+	}
+
+	return duration_us;
+}
+
 /**
  * Get a record name as a printable string
  *
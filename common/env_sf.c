@@ -229,7 +229,10 @@ void env_relocate_spec(void)
 	}
 
 err_read:
+#ifndef CONFIG_DM_SPI_FLASH
+	/* Under driver model the flash stays probed for the next user */
 	spi_flash_free(env_flash);
+#endif
 	env_flash = NULL;
 out:
 	free(tmp_env1);
@@ -346,7 +349,9 @@ void env_relocate_spec(void)
 	if (ret)
 		gd->env_valid = 1;
 out:
+#ifndef CONFIG_DM_SPI_FLASH
 	spi_flash_free(env_flash);
+#endif
 	if (buf)
 		free(buf);
 	env_flash = NULL;
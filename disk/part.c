@@ -40,6 +40,79 @@ static struct part_driver *part_driver_lookup_type(int part_type)
 	return NULL;
 }
 
+#if CONFIG_IS_ENABLED(PARTITION_CACHE)
+/**
+ * struct part_cache - the parsed partition table of a block device
+ *
+ * @part_type:	Partition table type the entries were read with
+ * @hwpart:	Hardware partition the entries were read from
+ * @count:	Number of entries, up to the last one in use
+ * @info:	Partition n is in info[n - 1]; unused entries have a size of 0
+ */
+struct part_cache {
+	unsigned char part_type;
+	unsigned char hwpart;
+	int count;
+	disk_partition_t info[];
+};
+
+void part_cache_invalidate(struct blk_desc *dev_desc)
+{
+	free(dev_desc->part_cache);
+	dev_desc->part_cache = NULL;
+}
+
+/* Read and parse the whole partition table, unless it is cached already */
+static struct part_cache *part_cache_get(struct blk_desc *dev_desc)
+{
+	struct part_cache *cache = dev_desc->part_cache;
+	struct part_cache *shrunk;
+	struct part_driver *drv;
+	int count, i;
+
+	if (cache && cache->part_type == dev_desc->part_type &&
+	    cache->hwpart == dev_desc->hwpart)
+		return cache;
+	part_cache_invalidate(dev_desc);
+
+	drv = part_driver_lookup_type(dev_desc->part_type);
+	if (!drv || !drv->get_info)
+		return NULL;
+
+	count = drv->max_entries;
+	cache = calloc(1, sizeof(*cache) + count * sizeof(disk_partition_t));
+	if (!cache)
+		return NULL;
+	if (drv->get_all_info) {
+		if (drv->get_all_info(dev_desc, cache->info)) {
+			free(cache);
+			return NULL;
+		}
+	} else {
+		for (i = 0; i < count; i++) {
+			if (drv->get_info(dev_desc, i + 1, &cache->info[i]))
+				memset(&cache->info[i], '\0',
+				       sizeof(disk_partition_t));
+		}
+	}
+
+	/* Only keep the entries up to the last one in use */
+	while (count && !cache->info[count - 1].size)
+		count--;
+	shrunk = realloc(cache, sizeof(*cache) +
+			 count * sizeof(disk_partition_t));
+	if (shrunk)
+		cache = shrunk;
+	cache->part_type = dev_desc->part_type;
+	cache->hwpart = dev_desc->hwpart;
+	cache->count = count;
+	dev_desc->part_cache = cache;
+	debug("%s: %s table of %d entries\n", __func__, drv->name, count);
+
+	return cache;
+}
+#endif
+
 static struct blk_desc *get_dev_hwpart(const char *ifname, int dev, int hwpart)
 {
 	struct blk_desc *dev_desc;
@@ -218,6 +291,7 @@ void part_init(struct blk_desc *dev_desc)
 	struct part_driver *entry;
 
 	blkcache_invalidate(dev_desc->if_type, dev_desc->devnum);
+	part_cache_invalidate(dev_desc);
 
 	dev_desc->part_type = PART_TYPE_UNKNOWN;
 	for (entry = drv; entry != drv + n_ents; entry++) {
@@ -318,6 +392,22 @@ int part_get_info(struct blk_desc *dev_desc, int part,
 		       drv->name);
 		return -ENOSYS;
 	}
+#if CONFIG_IS_ENABLED(PARTITION_CACHE)
+	/*
+	 * The cache only covers the first max_entries partitions. Others,
+	 * such as DOS logical partitions, are looked up on the disk.
+	 */
+	if (part >= 1 && part <= drv->max_entries) {
+		struct part_cache *cache = part_cache_get(dev_desc);
+
+		if (cache) {
+			if (part > cache->count || !cache->info[part - 1].size)
+				return -1;
+			*info = cache->info[part - 1];
+			return 0;
+		}
+	}
+#endif
 	if (drv->get_info(dev_desc, part, info) == 0) {
 		PRINTF("## Valid %s partition found ##\n", drv->name);
 		return 0;
@@ -623,6 +713,22 @@ int part_get_info_by_name(struct blk_desc *dev_desc, const char *name,
 		ll_entry_start(struct part_driver, part_driver);
 	const int n_drvs = ll_entry_count(struct part_driver, part_driver);
 	struct part_driver *part_drv;
+#if defined(HAVE_BLOCK_DEVICE) && CONFIG_IS_ENABLED(PARTITION_CACHE)
+	struct part_cache *cache = part_cache_get(dev_desc);
+
+	if (cache) {
+		int i;
+
+		for (i = 0; i < cache->count; i++) {
+			if (cache->info[i].size &&
+			    !strcmp(name, (const char *)cache->info[i].name)) {
+				*info = cache->info[i];
+				return 0;
+			}
+		}
+		return -1;
+	}
+#endif
 
 	for (part_drv = first_drv; part_drv != first_drv + n_drvs; part_drv++) {
 		int ret;
@@ -642,6 +748,43 @@ int part_get_info_by_name(struct blk_desc *dev_desc, const char *name,
 	return -1;
 }
 
+#ifdef CONFIG_PARTITION_UUIDS
+int part_get_info_by_uuid(struct blk_desc *dev_desc, const char *uuid,
+			  disk_partition_t *info)
+{
+#ifdef HAVE_BLOCK_DEVICE
+	struct part_driver *drv;
+	int i;
+#if CONFIG_IS_ENABLED(PARTITION_CACHE)
+	struct part_cache *cache = part_cache_get(dev_desc);
+
+	if (cache) {
+		for (i = 0; i < cache->count; i++) {
+			if (cache->info[i].size &&
+			    !strcasecmp(uuid, cache->info[i].uuid)) {
+				*info = cache->info[i];
+				return i + 1;
+			}
+		}
+		return -1;
+	}
+#endif
+
+	drv = part_driver_lookup_type(dev_desc->part_type);
+	if (!drv)
+		return -1;
+	for (i = 1; i <= drv->max_entries; i++) {
+		if (part_get_info(dev_desc, i, info))
+			continue;
+		if (!strcasecmp(uuid, info->uuid))
+			return i;
+	}
+#endif /* HAVE_BLOCK_DEVICE */
+
+	return -1;
+}
+#endif
+
 void part_set_generic_name(const struct blk_desc *dev_desc,
 	int part_num, char *name)
 {
@@ -233,24 +233,16 @@ void part_print_efi(struct blk_desc *dev_desc)
 	return;
 }
 
-int part_get_info_efi(struct blk_desc *dev_desc, int part,
-		      disk_partition_t *info)
+/* Read the primary GPT, or the backup one if the primary is not valid */
+static int gpt_read_table(struct blk_desc *dev_desc, gpt_header *gpt_head,
+			  gpt_entry **gpt_pte)
 {
-	ALLOC_CACHE_ALIGN_BUFFER_PAD(gpt_header, gpt_head, 1, dev_desc->blksz);
-	gpt_entry *gpt_pte = NULL;
-
-	/* "part" argument must be at least 1 */
-	if (part < 1) {
-		printf("%s: Invalid Argument(s)\n", __func__);
-		return -1;
-	}
-
 	/* This function validates AND fills in the GPT header and PTE */
 	if (is_gpt_valid(dev_desc, GPT_PRIMARY_PARTITION_TABLE_LBA,
-			gpt_head, &gpt_pte) != 1) {
+			gpt_head, gpt_pte) != 1) {
 		printf("%s: *** ERROR: Invalid GPT ***\n", __func__);
 		if (is_gpt_valid(dev_desc, (dev_desc->lba - 1),
-				 gpt_head, &gpt_pte) != 1) {
+				 gpt_head, gpt_pte) != 1) {
 			printf("%s: *** ERROR: Invalid Backup GPT ***\n",
 			       __func__);
 			return -1;
@@ -260,36 +252,83 @@ int part_get_info_efi(struct blk_desc *dev_desc, int part,
 		}
 	}
 
-	if (part > le32_to_cpu(gpt_head->num_partition_entries) ||
-	    !is_pte_valid(&gpt_pte[part - 1])) {
-		debug("%s: *** ERROR: Invalid partition number %d ***\n",
-			__func__, part);
-		free(gpt_pte);
-		return -1;
-	}
+	return 0;
+}
 
+static void gpt_pte_to_info(struct blk_desc *dev_desc, gpt_entry *pte,
+			    disk_partition_t *info)
+{
 	/* The 'lbaint_t' casting may limit the maximum disk size to 2 TB */
-	info->start = (lbaint_t)le64_to_cpu(gpt_pte[part - 1].starting_lba);
+	info->start = (lbaint_t)le64_to_cpu(pte->starting_lba);
 	/* The ending LBA is inclusive, to calculate size, add 1 to it */
-	info->size = (lbaint_t)le64_to_cpu(gpt_pte[part - 1].ending_lba) + 1
+	info->size = (lbaint_t)le64_to_cpu(pte->ending_lba) + 1
 		     - info->start;
 	info->blksz = dev_desc->blksz;
 
-	sprintf((char *)info->name, "%s",
-			print_efiname(&gpt_pte[part - 1]));
+	sprintf((char *)info->name, "%s", print_efiname(pte));
 	strcpy((char *)info->type, "U-Boot");
-	info->bootable = is_bootable(&gpt_pte[part - 1]);
+	info->bootable = is_bootable(pte);
 #ifdef CONFIG_PARTITION_UUIDS
-	uuid_bin_to_str(gpt_pte[part - 1].unique_partition_guid.b, info->uuid,
+	uuid_bin_to_str(pte->unique_partition_guid.b, info->uuid,
 			UUID_STR_FORMAT_GUID);
 #endif
 #ifdef CONFIG_PARTITION_TYPE_GUID
-	uuid_bin_to_str(gpt_pte[part - 1].partition_type_guid.b,
-			info->type_guid, UUID_STR_FORMAT_GUID);
+	uuid_bin_to_str(pte->partition_type_guid.b, info->type_guid,
+			UUID_STR_FORMAT_GUID);
 #endif
 
 	debug("%s: start 0x" LBAF ", size 0x" LBAF ", name %s\n", __func__,
 	      info->start, info->size, info->name);
+}
+
+int part_get_info_efi(struct blk_desc *dev_desc, int part,
+		      disk_partition_t *info)
+{
+	ALLOC_CACHE_ALIGN_BUFFER_PAD(gpt_header, gpt_head, 1, dev_desc->blksz);
+	gpt_entry *gpt_pte = NULL;
+
+	/* "part" argument must be at least 1 */
+	if (part < 1) {
+		printf("%s: Invalid Argument(s)\n", __func__);
+		return -1;
+	}
+
+	if (gpt_read_table(dev_desc, gpt_head, &gpt_pte))
+		return -1;
+
+	if (part > le32_to_cpu(gpt_head->num_partition_entries) ||
+	    !is_pte_valid(&gpt_pte[part - 1])) {
+		debug("%s: *** ERROR: Invalid partition number %d ***\n",
+			__func__, part);
+		free(gpt_pte);
+		return -1;
+	}
+
+	gpt_pte_to_info(dev_desc, &gpt_pte[part - 1], info);
+
+	/* Remember to free pte */
+	free(gpt_pte);
+	return 0;
+}
+
+static int __maybe_unused part_get_all_info_efi(struct blk_desc *dev_desc,
+						disk_partition_t *info)
+{
+	ALLOC_CACHE_ALIGN_BUFFER_PAD(gpt_header, gpt_head, 1, dev_desc->blksz);
+	gpt_entry *gpt_pte = NULL;
+	int count, i;
+
+	if (gpt_read_table(dev_desc, gpt_head, &gpt_pte))
+		return -1;
+
+	count = min_t(int, le32_to_cpu(gpt_head->num_partition_entries),
+		      GPT_ENTRY_NUMBERS);
+	for (i = 0; i < GPT_ENTRY_NUMBERS; i++) {
+		if (i < count && is_pte_valid(&gpt_pte[i]))
+			gpt_pte_to_info(dev_desc, &gpt_pte[i], &info[i]);
+		else
+			info[i].size = 0;
+	}
 
 	/* Remember to free pte */
 	free(gpt_pte);
@@ -941,6 +980,7 @@ U_BOOT_PART_TYPE(a_efi) = {
 	.part_type	= PART_TYPE_EFI,
 	.max_entries	= GPT_ENTRY_NUMBERS,
 	.get_info	= part_get_info_ptr(part_get_info_efi),
+	.get_all_info	= part_get_info_ptr(part_get_all_info_efi),
 	.print		= part_print_ptr(part_print_efi),
 	.test		= part_test_efi,
 };
@@ -0,0 +1,48 @@
+/*
+ * Reading blocks into a buffer which is not aligned for DMA
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <memalign.h>
+#include <linux/err.h>
+
+ulong blk_dread_bounce(struct blk_desc *block_dev, lbaint_t start,
+		       lbaint_t blkcnt, void *buffer)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(u8, tmpbuf, block_dev->blksz);
+	ulong blksz = block_dev->blksz;
+	ulong pad, tail, n, i, ret;
+
+	pad = (ulong)buffer & (ARCH_DMA_MINALIGN - 1);
+	if (!pad)
+		return blk_dread(block_dev, start, blkcnt, buffer);
+	pad = ARCH_DMA_MINALIGN - pad;
+
+	/*
+	 * Read all but the last block(s) from the first aligned address in
+	 * the buffer, then move them down into place. The blocks left out
+	 * make room for the move.
+	 */
+	tail = min_t(lbaint_t, blkcnt, DIV_ROUND_UP(pad, blksz));
+	n = blkcnt - tail;
+	if (n) {
+		ret = blk_dread(block_dev, start, n, buffer + pad);
+		if (IS_ERR_VALUE(ret))
+			return ret;
+		memmove(buffer, buffer + pad, ret * blksz);
+		if (ret != n)
+			return ret;
+	}
+
+	for (i = n; i < blkcnt; i++) {
+		ret = blk_dread(block_dev, start + i, 1, tmpbuf);
+		if (ret != 1)
+			return IS_ERR_VALUE(ret) ? ret : i;
+		memcpy(buffer + i * blksz, tmpbuf, blksz);
+	}
+
+	return blkcnt;
+}
@@ -7,7 +7,6 @@
 #include <common.h>
 #include <malloc.h>
 #include <errno.h>
-#include <div64.h>
 #include <dfu.h>
 #include <spi.h>
 #include <spi_flash.h>
@@ -23,29 +22,15 @@ static int dfu_read_medium_sf(struct dfu_entity *dfu, u64 offset, void *buf,
 	return spi_flash_read(dfu->data.sf.dev, offset, *len, buf);
 }
 
-static u64 find_sector(struct dfu_entity *dfu, u64 start, u64 offset)
-{
-	return (lldiv((start + offset), dfu->data.sf.dev->sector_size)) *
-		dfu->data.sf.dev->sector_size;
-}
-
+/*
+ * Erase only the blocks which need it, checking each block while the one
+ * after is erased
+ */
 static int dfu_write_medium_sf(struct dfu_entity *dfu,
 		u64 offset, void *buf, long *len)
 {
-	int ret;
-
-	ret = spi_flash_erase(dfu->data.sf.dev,
-			      find_sector(dfu, dfu->data.sf.start, offset),
-			      dfu->data.sf.dev->sector_size);
-	if (ret)
-		return ret;
-
-	ret = spi_flash_write(dfu->data.sf.dev, dfu->data.sf.start + offset,
-			      *len, buf);
-	if (ret)
-		return ret;
-
-	return 0;
+	return spi_flash_update(dfu->data.sf.dev, dfu->data.sf.start + offset,
+				*len, buf, NULL);
 }
 
 static int dfu_flush_medium_sf(struct dfu_entity *dfu)
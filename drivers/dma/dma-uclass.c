@@ -43,7 +43,11 @@ int dma_get_device(u32 transfer_type, struct udevice **devp)
 	return ret;
 }
 
-int dma_memcpy(void *dst, void *src, size_t len)
+/*
+ * Copy by DMA. Only a source in cacheable memory needs writing back first;
+ * a device window is not cached.
+ */
+static int dma_copy(void *dst, void *src, size_t len, bool src_cached)
 {
 	struct udevice *dev;
 	const struct dma_ops *ops;
@@ -57,11 +61,48 @@ int dma_memcpy(void *dst, void *src, size_t len)
 	if (!ops->transfer)
 		return -ENOSYS;
 
-	/* Invalidate the area, so no writeback into the RAM races with DMA */
+	/* Write back the source, so the engine reads what the CPU wrote */
+	if (src_cached)
+		flush_dcache_range(rounddown((ulong)src, ARCH_DMA_MINALIGN),
+				   roundup((ulong)src + len,
+					   ARCH_DMA_MINALIGN));
+
+	/* Write back the destination, so no dirty line lands on the data */
+	flush_dcache_range((unsigned long)dst, (unsigned long)dst +
+			   roundup(len, ARCH_DMA_MINALIGN));
+
+	ret = ops->transfer(dev, DMA_MEM_TO_MEM, dst, src, len);
+
+	/* Drop the old lines, and any fetched speculatively meanwhile */
 	invalidate_dcache_range((unsigned long)dst, (unsigned long)dst +
 				roundup(len, ARCH_DMA_MINALIGN));
 
-	return ops->transfer(dev, DMA_MEM_TO_MEM, dst, src, len);
+	return ret;
+}
+
+int dma_memcpy(void *dst, void *src, size_t len)
+{
+	return dma_copy(dst, src, len, true);
+}
+
+void dma_mmap_copy(void *dst, void *src, size_t len)
+{
+	size_t head, body;
+
+	head = ALIGN((ulong)dst, ARCH_DMA_MINALIGN) - (ulong)dst;
+	if (len < CONFIG_DMA_MMAP_COPY_MIN || len < head + ARCH_DMA_MINALIGN)
+		goto cpu_copy;
+
+	body = rounddown(len - head, ARCH_DMA_MINALIGN);
+	if (dma_copy(dst + head, src + head, body, false) < 0)
+		goto cpu_copy;
+
+	memcpy(dst, src, head);
+	memcpy(dst + head + body, src + head + body, len - head - body);
+	return;
+
+cpu_copy:
+	memcpy(dst, src, len);
 }
 
 UCLASS_DRIVER(dma) = {
@@ -0,0 +1,72 @@
+/*
+ * Sandbox DMA engine
+ *
+ * Copies memory with memcpy() and remembers the last transfer, so that
+ * tests can check what they asked the engine to do.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <dm.h>
+#include <dma.h>
+#include <asm/test.h>
+
+struct sandbox_dma_priv {
+	ulong count;
+	void *last_dst;
+	size_t last_len;
+};
+
+static int sandbox_dma_transfer(struct udevice *dev, int direction,
+				void *dst, void *src, size_t len)
+{
+	struct sandbox_dma_priv *priv = dev_get_priv(dev);
+
+	if (direction != DMA_MEM_TO_MEM)
+		return -EINVAL;
+
+	memcpy(dst, src, len);
+	priv->count++;
+	priv->last_dst = dst;
+	priv->last_len = len;
+
+	return 0;
+}
+
+ulong sandbox_dma_get_last(struct udevice *dev, void **dstp, size_t *lenp)
+{
+	struct sandbox_dma_priv *priv = dev_get_priv(dev);
+
+	*dstp = priv->last_dst;
+	*lenp = priv->last_len;
+
+	return priv->count;
+}
+
+static int sandbox_dma_probe(struct udevice *dev)
+{
+	struct dma_dev_priv *uc_priv = dev_get_uclass_priv(dev);
+
+	uc_priv->supported = DMA_SUPPORTS_MEM_TO_MEM;
+
+	return 0;
+}
+
+static const struct dma_ops sandbox_dma_ops = {
+	.transfer	= sandbox_dma_transfer,
+};
+
+static const struct udevice_id sandbox_dma_ids[] = {
+	{ .compatible = "sandbox,dma" },
+	{ }
+};
+
+U_BOOT_DRIVER(dma_sandbox) = {
+	.name		= "dma_sandbox",
+	.id		= UCLASS_DMA,
+	.of_match	= sandbox_dma_ids,
+	.probe		= sandbox_dma_probe,
+	.ops		= &sandbox_dma_ops,
+	.priv_auto_alloc_size = sizeof(struct sandbox_dma_priv),
+};
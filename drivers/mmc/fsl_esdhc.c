@@ -800,6 +800,10 @@ static int fsl_esdhc_init(struct fsl_esdhc_priv *priv)
 #ifdef CONFIG_SYS_FSL_ESDHC_HAS_DDR_MODE
 	priv->cfg.host_caps |= MMC_MODE_DDR_52MHz;
 #endif
+#ifdef CONFIG_SYS_FSL_ERRATUM_ESDHC111
+	/* Multiple-block transfers are always stopped with Auto-CMD12 */
+	priv->cfg.host_caps |= MMC_MODE_AUTO_CMD12;
+#endif
 
 	if (priv->bus_width > 0) {
 		if (priv->bus_width < 8)
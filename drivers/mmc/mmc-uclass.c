@@ -77,6 +77,34 @@ int mmc_getcd(struct mmc *mmc)
 {
 	return dm_mmc_get_cd(mmc->dev);
 }
+
+int dm_mmc_execute_tuning(struct udevice *dev, uint opcode)
+{
+	struct dm_mmc_ops *ops = mmc_get_ops(dev);
+
+	if (!ops->execute_tuning)
+		return -ENOSYS;
+	return ops->execute_tuning(dev, opcode);
+}
+
+int mmc_execute_tuning(struct mmc *mmc, uint opcode)
+{
+	return dm_mmc_execute_tuning(mmc->dev, opcode);
+}
+
+int dm_mmc_card_busy(struct udevice *dev)
+{
+	struct dm_mmc_ops *ops = mmc_get_ops(dev);
+
+	if (!ops->card_busy)
+		return -ENOSYS;
+	return ops->card_busy(dev);
+}
+
+int mmc_card_busy(struct mmc *mmc)
+{
+	return dm_mmc_card_busy(mmc->dev);
+}
 #endif
 
 struct mmc *mmc_get_mmc_dev(struct udevice *dev)
@@ -149,7 +177,7 @@ void mmc_do_preinit(void)
 #ifdef CONFIG_FSL_ESDHC_ADAPTER_IDENT
 		mmc_set_preinit(m, 1);
 #endif
-		if (m->preinit)
+		if (m->preinit && !m->init_in_progress)
 			mmc_start_init(m);
 	}
 }
@@ -215,6 +243,7 @@ int mmc_bind(struct udevice *dev, struct mmc *mmc, const struct mmc_config *cfg)
 	/* setup initial part type */
 	bdesc->part_type = cfg->part_type;
 	mmc->dev = dev;
+	mmc->preinit = IS_ENABLED(CONFIG_MMC_ASYNC_INIT);
 
 	return 0;
 }
@@ -247,6 +276,28 @@ static int mmc_select_hwpart(struct udevice *bdev, int hwpart)
 	return mmc_switch_part(mmc, hwpart);
 }
 
+/*
+ * Finish an init of the card which was started by preinit. Other cards are
+ * left to whoever uses them first, e.g. the mmc command. An empty slot
+ * must not stop the other block devices from being probed, so a failure
+ * leaves the device with no blocks until the next mmc_init(), e.g. from
+ * 'mmc rescan'.
+ */
+static int mmc_blk_probe(struct udevice *bdev)
+{
+	struct mmc *mmc = mmc_get_mmc_dev(dev_get_parent(bdev));
+	int ret;
+
+	if (!mmc->init_in_progress)
+		return 0;
+
+	ret = mmc_init(mmc);
+	if (ret)
+		debug("%s: mmc_init() failed (err=%d)\n", __func__, ret);
+
+	return 0;
+}
+
 static const struct blk_ops mmc_blk_ops = {
 	.read	= mmc_bread,
 #ifndef CONFIG_SPL_BUILD
@@ -260,6 +311,7 @@ U_BOOT_DRIVER(mmc_blk) = {
 	.name		= "mmc_blk",
 	.id		= UCLASS_BLK,
 	.ops		= &mmc_blk_ops,
+	.probe		= mmc_blk_probe,
 };
 #endif /* CONFIG_BLK */
 
@@ -220,16 +220,59 @@ int mmc_set_blocklen(struct mmc *mmc, int len)
 	return mmc_send_cmd(mmc, &cmd, NULL);
 }
 
+int mmc_set_blockcount(struct mmc *mmc, unsigned int blockcount,
+		       bool is_rel_write)
+{
+	struct mmc_cmd cmd = {0};
+
+	cmd.cmdidx = MMC_CMD_SET_BLOCK_COUNT;
+	cmd.cmdarg = blockcount & 0x0000FFFF;
+	if (is_rel_write)
+		cmd.cmdarg |= 1 << 31;
+	cmd.resp_type = MMC_RSP_R1;
+
+	return mmc_send_cmd(mmc, &cmd, NULL);
+}
+
+/**
+ * mmc_multi_block_begin() - Get ready for a multiple-block read or write
+ *
+ * If the card and host can do it, the number of blocks is given to the card
+ * with CMD23 so that it stops by itself. Otherwise the transfer is
+ * open-ended, and stopped by the host (Auto-CMD12) or by the caller.
+ *
+ * @mmc:	MMC device
+ * @blkcnt:	Number of blocks to be transferred
+ * @return 1 if the caller must send CMD12 after the transfer, 0 if not,
+ * -ve on error
+ */
+int mmc_multi_block_begin(struct mmc *mmc, lbaint_t blkcnt)
+{
+	int err;
+
+	if ((mmc->card_caps & MMC_MODE_CMD23) && blkcnt <= 0xffff) {
+		err = mmc_set_blockcount(mmc, blkcnt, false);
+		return err ? err : 0;
+	}
+
+	return !(mmc->cfg->host_caps & MMC_MODE_AUTO_CMD12);
+}
+
 static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 			   lbaint_t blkcnt)
 {
 	struct mmc_cmd cmd;
 	struct mmc_data data;
+	int stop = 0;
 
-	if (blkcnt > 1)
+	if (blkcnt > 1) {
+		stop = mmc_multi_block_begin(mmc, blkcnt);
+		if (stop < 0)
+			return 0;
 		cmd.cmdidx = MMC_CMD_READ_MULTIPLE_BLOCK;
-	else
+	} else {
 		cmd.cmdidx = MMC_CMD_READ_SINGLE_BLOCK;
+	}
 
 	if (mmc->high_capacity)
 		cmd.cmdarg = start;
@@ -246,7 +289,7 @@ static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 	if (mmc_send_cmd(mmc, &cmd, &data))
 		return 0;
 
-	if (blkcnt > 1) {
+	if (stop) {
 		cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
 		cmd.cmdarg = 0;
 		cmd.resp_type = MMC_RSP_R1b;
@@ -339,54 +382,85 @@ static int mmc_go_idle(struct mmc *mmc)
 	return 0;
 }
 
-static int sd_send_op_cond(struct mmc *mmc)
+static int sd_send_op_cond_iter(struct mmc *mmc, bool uhs)
 {
-	int timeout = 1000;
-	int err;
 	struct mmc_cmd cmd;
+	int err;
 
-	while (1) {
-		cmd.cmdidx = MMC_CMD_APP_CMD;
-		cmd.resp_type = MMC_RSP_R1;
-		cmd.cmdarg = 0;
+	cmd.cmdidx = MMC_CMD_APP_CMD;
+	cmd.resp_type = MMC_RSP_R1;
+	cmd.cmdarg = 0;
 
-		err = mmc_send_cmd(mmc, &cmd, NULL);
+	err = mmc_send_cmd(mmc, &cmd, NULL);
 
-		if (err)
-			return err;
+	if (err)
+		return err;
 
-		cmd.cmdidx = SD_CMD_APP_SEND_OP_COND;
-		cmd.resp_type = MMC_RSP_R3;
+	cmd.cmdidx = SD_CMD_APP_SEND_OP_COND;
+	cmd.resp_type = MMC_RSP_R3;
 
-		/*
-		 * Most cards do not answer if some reserved bits
-		 * in the ocr are set. However, Some controller
-		 * can set bit 7 (reserved for low voltages), but
-		 * how to manage low voltages SD card is not yet
-		 * specified.
-		 */
-		cmd.cmdarg = mmc_host_is_spi(mmc) ? 0 :
-			(mmc->cfg->voltages & 0xff8000);
+	/*
+	 * Most cards do not answer if some reserved bits
+	 * in the ocr are set. However, Some controller
+	 * can set bit 7 (reserved for low voltages), but
+	 * how to manage low voltages SD card is not yet
+	 * specified.
+	 */
+	cmd.cmdarg = mmc_host_is_spi(mmc) ? 0 :
+		(mmc->cfg->voltages & 0xff8000);
 
-		if (mmc->version == SD_VERSION_2)
-			cmd.cmdarg |= OCR_HCS;
+	if (mmc->version == SD_VERSION_2) {
+		cmd.cmdarg |= OCR_HCS;
+		if (uhs)
+			cmd.cmdarg |= OCR_S18R;
+	}
 
-		err = mmc_send_cmd(mmc, &cmd, NULL);
+	err = mmc_send_cmd(mmc, &cmd, NULL);
 
-		if (err)
-			return err;
+	if (err)
+		return err;
 
-		if (cmd.response[0] & OCR_BUSY)
-			break;
+	mmc->ocr = cmd.response[0];
+
+	return 0;
+}
 
+/*
+ * Start the card powering up. Waiting until it is done is left to
+ * sd_complete_op_cond(), so that other devices can get going meanwhile.
+ */
+static int sd_send_op_cond(struct mmc *mmc, bool uhs)
+{
+	int err;
+
+	err = sd_send_op_cond_iter(mmc, uhs);
+	if (err)
+		return err;
+
+	if (mmc->version != SD_VERSION_2)
+		mmc->version = SD_VERSION_1_0;
+	mmc->op_cond_pending = 1;
+
+	return 0;
+}
+
+static int sd_complete_op_cond(struct mmc *mmc, bool uhs)
+{
+	int timeout = 1000;
+	int err;
+	struct mmc_cmd cmd;
+
+	mmc->op_cond_pending = 0;
+	while (!(mmc->ocr & OCR_BUSY)) {
 		if (timeout-- <= 0)
 			return -EOPNOTSUPP;
 
 		udelay(1000);
-	}
 
-	if (mmc->version != SD_VERSION_2)
-		mmc->version = SD_VERSION_1_0;
+		err = sd_send_op_cond_iter(mmc, uhs);
+		if (err)
+			return err;
+	}
 
 	if (mmc_host_is_spi(mmc)) { /* read OCR for spi */
 		cmd.cmdidx = MMC_CMD_SPI_READ_OCR;
@@ -397,9 +471,9 @@ static int sd_send_op_cond(struct mmc *mmc)
 
 		if (err)
 			return err;
-	}
 
-	mmc->ocr = cmd.response[0];
+		mmc->ocr = cmd.response[0];
+	}
 
 	mmc->high_capacity = ((mmc->ocr & OCR_HCS) == OCR_HCS);
 	mmc->rca = 0;
@@ -445,6 +519,7 @@ static int mmc_send_op_cond(struct mmc *mmc)
 		if (mmc->ocr & OCR_BUSY)
 			break;
 	}
+	mmc->version = MMC_VERSION_UNKNOWN;
 	mmc->op_cond_pending = 1;
 	return 0;
 }
@@ -557,6 +632,10 @@ static int mmc_change_freq(struct mmc *mmc)
 	if (mmc_host_is_spi(mmc))
 		return 0;
 
+	/* CMD23 came in with version 3.1, which reports as version 3 */
+	if (mmc->version >= MMC_VERSION_3)
+		mmc->card_caps |= MMC_MODE_CMD23;
+
 	/* Only version 4 supports high-speed */
 	if (mmc->version < MMC_VERSION_4)
 		return 0;
@@ -568,7 +647,7 @@ static int mmc_change_freq(struct mmc *mmc)
 	if (err)
 		return err;
 
-	cardtype = ext_csd[EXT_CSD_CARD_TYPE] & 0xf;
+	cardtype = ext_csd[EXT_CSD_CARD_TYPE];
 
 	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING, 1);
 
@@ -594,6 +673,14 @@ static int mmc_change_freq(struct mmc *mmc)
 		mmc->card_caps |= MMC_MODE_HS;
 	}
 
+#ifdef CONFIG_MMC_HS200_SUPPORT
+	/* Only 1.8V I/O is tried for these */
+	if (cardtype & EXT_CSD_CARD_TYPE_HS200_1_8V)
+		mmc->card_caps |= MMC_MODE_HS200;
+	if (cardtype & EXT_CSD_CARD_TYPE_HS400_1_8V)
+		mmc->card_caps |= MMC_MODE_HS400;
+#endif
+
 	return 0;
 }
 
@@ -945,6 +1032,8 @@ retry_scr:
 
 	if (mmc->scr[0] & SD_DATA_4BIT)
 		mmc->card_caps |= MMC_MODE_4BIT;
+	if (mmc->scr[0] & SD_SCR_CMD23)
+		mmc->card_caps |= MMC_MODE_CMD23;
 
 	/* Version 1.0 doesn't support switching */
 	if (mmc->version == SD_VERSION_1_0)
@@ -977,6 +1066,26 @@ retry_scr:
 		(mmc->cfg->host_caps & MMC_MODE_HS)))
 		return 0;
 
+#ifdef CONFIG_MMC_UHS_SUPPORT
+	/*
+	 * At 1.8V the card is switched to a UHS-I mode once its bus is 4 bits
+	 * wide, by sd_select_uhs(). Just note what it supports.
+	 */
+	if (mmc->signal_voltage == MMC_SIGNAL_VOLTAGE_180 &&
+	    (mmc->card_caps & mmc->cfg->host_caps & MMC_MODE_4BIT)) {
+		uint funcs = __be32_to_cpu(switch_status[3]);
+
+		mmc->card_caps |= MMC_MODE_HS;
+		if (funcs & SD_SWITCH_SUPPORTED(SD_SWITCH_SDR50))
+			mmc->card_caps |= MMC_MODE_UHS_SDR50;
+		if (funcs & SD_SWITCH_SUPPORTED(SD_SWITCH_SDR104))
+			mmc->card_caps |= MMC_MODE_UHS_SDR104;
+		if (funcs & SD_SWITCH_SUPPORTED(SD_SWITCH_DDR50))
+			mmc->card_caps |= MMC_MODE_UHS_DDR50;
+		return 0;
+	}
+#endif
+
 	err = sd_switch(mmc, SD_SWITCH_SWITCH, 0, 1, (u8 *)switch_status);
 
 	if (err)
@@ -1103,6 +1212,292 @@ static void mmc_set_bus_width(struct mmc *mmc, uint width)
 	mmc_set_ios(mmc);
 }
 
+static const char *const mmc_mode_names[] = {
+	[MMC_LEGACY]	= "MMC legacy",
+	[SD_LEGACY]	= "SD legacy",
+	[MMC_HS]	= "MMC High Speed (26MHz)",
+	[SD_HS]		= "SD High Speed (50MHz)",
+	[MMC_HS_52]	= "MMC High Speed (52MHz)",
+	[MMC_DDR_52]	= "MMC DDR52 (52MHz)",
+	[UHS_SDR12]	= "UHS SDR12 (25MHz)",
+	[UHS_SDR25]	= "UHS SDR25 (50MHz)",
+	[UHS_SDR50]	= "UHS SDR50 (100MHz)",
+	[UHS_DDR50]	= "UHS DDR50 (50MHz)",
+	[UHS_SDR104]	= "UHS SDR104 (208MHz)",
+	[MMC_HS_200]	= "HS200 (200MHz)",
+	[MMC_HS_400]	= "HS400 (200MHz)",
+};
+
+const char *mmc_mode_name(enum bus_mode mode)
+{
+	if (mode >= MMC_MODES_END)
+		return "Unknown mode";
+
+	return mmc_mode_names[mode];
+}
+
+#if defined(CONFIG_MMC_UHS_SUPPORT) || defined(CONFIG_MMC_HS200_SUPPORT)
+#ifndef CONFIG_DM_MMC_OPS
+static int mmc_execute_tuning(struct mmc *mmc, uint opcode)
+{
+	if (!mmc->cfg->ops->execute_tuning)
+		return -ENOSYS;
+
+	return mmc->cfg->ops->execute_tuning(mmc, opcode);
+}
+
+#ifdef CONFIG_MMC_UHS_SUPPORT
+static int mmc_card_busy(struct mmc *mmc)
+{
+	if (!mmc->cfg->ops->card_busy)
+		return -ENOSYS;
+
+	return mmc->cfg->ops->card_busy(mmc);
+}
+#endif
+#endif
+
+/* Set the bus timing, and the clock which goes with it */
+static void mmc_select_mode(struct mmc *mmc, enum bus_mode mode, uint clock)
+{
+	mmc->selected_mode = mode;
+	mmc->tran_speed = clock;
+	mmc_set_clock(mmc, clock);
+}
+
+/*
+ * Switch the I/O voltage, with the 'vqmmc-supply' regulator if there is one,
+ * then let the host know through set_ios().
+ */
+static int mmc_set_signal_voltage(struct mmc *mmc, enum mmc_voltage voltage)
+{
+#if defined(CONFIG_DM_MMC) && defined(CONFIG_DM_REGULATOR) && \
+	!defined(CONFIG_SPL_BUILD)
+	int uv = voltage == MMC_SIGNAL_VOLTAGE_180 ? 1800000 : 3300000;
+	struct udevice *vqmmc_supply;
+	int ret;
+#endif
+
+	if (mmc->signal_voltage == voltage)
+		return 0;
+
+#if defined(CONFIG_DM_MMC) && defined(CONFIG_DM_REGULATOR) && \
+	!defined(CONFIG_SPL_BUILD)
+	ret = device_get_supply_regulator(mmc->dev, "vqmmc-supply",
+					  &vqmmc_supply);
+	if (!ret && regulator_get_value(vqmmc_supply) != uv) {
+		ret = regulator_set_value(vqmmc_supply, uv);
+		if (ret) {
+			debug("%s: Cannot set vqmmc to %d uV (err=%d)\n",
+			      mmc->dev->name, uv, ret);
+			return ret;
+		}
+	}
+#endif
+	mmc->signal_voltage = voltage;
+	mmc_set_ios(mmc);
+
+	return 0;
+}
+#endif
+
+#ifdef CONFIG_MMC_UHS_SUPPORT
+/* Stop SDCLK, which set_ios() does for a clock of 0 */
+static void mmc_stop_clock(struct mmc *mmc)
+{
+	mmc->clock = 0;
+	mmc_set_ios(mmc);
+}
+
+/*
+ * Switch the card's I/O to 1.8V with CMD11. The card holds DAT[3:0] low
+ * from its response until it runs at 1.8V, which it starts to do once
+ * SDCLK has stopped. Where the host can read the data lines, both ends
+ * of this are checked. A card which fails this has to be power cycled.
+ */
+static int sd_switch_voltage(struct mmc *mmc)
+{
+	uint clock = mmc->clock;
+	struct mmc_cmd cmd;
+	int err;
+
+	cmd.cmdidx = SD_CMD_SWITCH_UHS18V;
+	cmd.resp_type = MMC_RSP_R1;
+	cmd.cmdarg = 0;
+
+	err = mmc_send_cmd(mmc, &cmd, NULL);
+	if (err)
+		return err;
+
+	if (mmc_card_busy(mmc) == 0) {
+		debug("%s: DAT[3:0] not low after CMD11\n", __func__);
+		return -EIO;
+	}
+
+	mmc_stop_clock(mmc);
+	err = mmc_set_signal_voltage(mmc, MMC_SIGNAL_VOLTAGE_180);
+	if (err)
+		return err;
+
+	/* The clock stays off for 5ms while the voltage settles */
+	udelay(5000);
+	mmc_set_clock(mmc, clock);
+	udelay(1000);
+
+	if (mmc_card_busy(mmc)) {
+		debug("%s: DAT[3:0] not high at 1.8V\n", __func__);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/* UHS-I modes, fastest first, with the access mode function of each */
+static const struct sd_uhs_mode {
+	enum bus_mode mode;
+	uint caps;
+	u8 func;
+	uint clock;
+} sd_uhs_modes[] = {
+	{ UHS_SDR104, MMC_MODE_UHS_SDR104, SD_SWITCH_SDR104, 208000000 },
+	{ UHS_SDR50, MMC_MODE_UHS_SDR50, SD_SWITCH_SDR50, 100000000 },
+	{ UHS_DDR50, MMC_MODE_UHS_DDR50, SD_SWITCH_DDR50, 50000000 },
+	{ UHS_SDR25, MMC_MODE_HS, SD_SWITCH_SDR25, 50000000 },
+};
+
+/*
+ * Switch a card at 1.8V to the fastest UHS-I mode which both sides support,
+ * tuning for SDR104. A mode which fails leaves the next one to try, and the
+ * card stays at SDR12 if none works.
+ */
+static int sd_select_uhs(struct mmc *mmc)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(uint, switch_status, 16);
+	const struct sd_uhs_mode *m;
+	int err;
+
+	for (m = sd_uhs_modes; m < sd_uhs_modes + ARRAY_SIZE(sd_uhs_modes);
+	     m++) {
+		if (!(mmc->card_caps & m->caps))
+			continue;
+
+		err = sd_switch(mmc, SD_SWITCH_SWITCH, 0, m->func,
+				(u8 *)switch_status);
+		if (err ||
+		    ((__be32_to_cpu(switch_status[4]) >> 24) & 0xf) != m->func)
+			continue;
+
+		mmc->ddr_mode = m->mode == UHS_DDR50;
+		mmc_select_mode(mmc, m->mode, m->clock);
+		if (m->mode != UHS_SDR104)
+			return 0;
+
+		err = mmc_execute_tuning(mmc, MMC_CMD_SEND_TUNING_BLOCK);
+		if (!err)
+			return 0;
+		debug("%s: Tuning for %s failed (err=%d)\n", __func__,
+		      mmc_mode_name(m->mode), err);
+		mmc_select_mode(mmc, UHS_SDR12, 25000000);
+	}
+
+	mmc->ddr_mode = 0;
+	mmc_select_mode(mmc, UHS_SDR12, 25000000);
+
+	return 0;
+}
+#endif
+
+#ifdef CONFIG_MMC_HS200_SUPPORT
+static int mmc_select_hs400(struct mmc *mmc)
+{
+	int err;
+
+	/* HS400 is entered from High Speed, with the bus in DDR mode */
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING,
+			 EXT_CSD_TIMING_HS);
+	if (err)
+		return err;
+	mmc_select_mode(mmc, MMC_HS_52, 52000000);
+
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_BUS_WIDTH,
+			 EXT_CSD_DDR_BUS_WIDTH_8);
+	if (err)
+		return err;
+	mmc->ddr_mode = 1;
+
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING,
+			 EXT_CSD_TIMING_HS400);
+	if (err)
+		return err;
+	mmc_select_mode(mmc, MMC_HS_400, 200000000);
+
+	return 0;
+}
+
+/*
+ * Switch to HS200 and tune, then go on to HS400 if both sides can. If any
+ * of this fails, the card is put back at High Speed on a 1-bit bus, for the
+ * other bus widths to be tried from there.
+ */
+static int mmc_select_hs200(struct mmc *mmc, u8 *test_csd)
+{
+	enum mmc_voltage voltage = mmc->signal_voltage;
+	bool wide = mmc->card_caps & MMC_MODE_8BIT;
+	u8 timing = EXT_CSD_TIMING_HS200;
+	uint clock = mmc->clock;
+	int err;
+
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_BUS_WIDTH,
+			 wide ? EXT_CSD_BUS_WIDTH_8 : EXT_CSD_BUS_WIDTH_4);
+	if (err)
+		return err;
+	mmc_set_bus_width(mmc, wide ? 8 : 4);
+
+	err = mmc_set_signal_voltage(mmc, MMC_SIGNAL_VOLTAGE_180);
+	if (err)
+		goto fail;
+
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING,
+			 EXT_CSD_TIMING_HS200);
+	if (err)
+		goto fail;
+	mmc_select_mode(mmc, MMC_HS_200, 200000000);
+
+	err = mmc_execute_tuning(mmc, MMC_CMD_SEND_TUNING_BLOCK_HS200);
+	if (err)
+		goto fail;
+
+	if (wide && (mmc->card_caps & MMC_MODE_HS400)) {
+		err = mmc_select_hs400(mmc);
+		if (err)
+			goto fail;
+		timing = EXT_CSD_TIMING_HS400;
+	}
+
+	/* Check that the card can still be read, in the mode it should be */
+	err = mmc_send_ext_csd(mmc, test_csd);
+	if (!err && test_csd[EXT_CSD_HS_TIMING] != timing)
+		err = -EBADMSG;
+	if (!err)
+		return 0;
+
+fail:
+	debug("%s: %s failed (err=%d)\n", __func__,
+	      mmc_mode_name(mmc->selected_mode), err);
+	mmc->ddr_mode = 0;
+	mmc->selected_mode = MMC_LEGACY;
+	mmc_set_clock(mmc, clock);
+	mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING,
+		   EXT_CSD_TIMING_HS);
+	mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_BUS_WIDTH,
+		   EXT_CSD_BUS_WIDTH_1);
+	mmc_set_bus_width(mmc, 1);
+	mmc_set_signal_voltage(mmc, voltage);
+
+	return err;
+}
+#endif
+
 static int mmc_startup(struct mmc *mmc)
 {
 	int err, i;
@@ -1453,10 +1848,21 @@ static int mmc_startup(struct mmc *mmc)
 		if (err)
 			return err;
 
-		if (mmc->card_caps & MMC_MODE_HS)
+		if (mmc->card_caps & MMC_MODE_HS) {
+			mmc->selected_mode = SD_HS;
 			mmc->tran_speed = 50000000;
-		else
+		} else {
+			mmc->selected_mode = SD_LEGACY;
 			mmc->tran_speed = 25000000;
+		}
+#ifdef CONFIG_MMC_UHS_SUPPORT
+		if (mmc->signal_voltage == MMC_SIGNAL_VOLTAGE_180 &&
+		    (mmc->card_caps & MMC_MODE_4BIT)) {
+			err = sd_select_uhs(mmc);
+			if (err)
+				return err;
+		}
+#endif
 	} else if (mmc->version >= MMC_VERSION_4) {
 		/* Only version 4 of MMC supports wider bus widths */
 		int idx;
@@ -1485,7 +1891,14 @@ static int mmc_startup(struct mmc *mmc)
 			8, 4, 8, 4, 1,
 		};
 
-		for (idx=0; idx < ARRAY_SIZE(ext_csd_bits); idx++) {
+		err = -EOPNOTSUPP;
+#ifdef CONFIG_MMC_HS200_SUPPORT
+		if (mmc->card_caps & MMC_MODE_HS200)
+			err = mmc_select_hs200(mmc, test_csd);
+#endif
+
+		/* Unless HS200 has set it up, find the widest bus that works */
+		for (idx = 0; err && idx < ARRAY_SIZE(ext_csd_bits); idx++) {
 			unsigned int extw = ext_csd_bits[idx];
 			unsigned int caps = ext_to_hostcaps[extw];
 
@@ -1541,11 +1954,16 @@ static int mmc_startup(struct mmc *mmc)
 		if (err)
 			return err;
 
-		if (mmc->card_caps & MMC_MODE_HS) {
-			if (mmc->card_caps & MMC_MODE_HS_52MHz)
+		if (mmc->selected_mode == MMC_LEGACY &&
+		    (mmc->card_caps & MMC_MODE_HS)) {
+			if (mmc->card_caps & MMC_MODE_HS_52MHz) {
+				mmc->selected_mode = mmc->ddr_mode ?
+					MMC_DDR_52 : MMC_HS_52;
 				mmc->tran_speed = 52000000;
-			else
+			} else {
+				mmc->selected_mode = MMC_HS;
 				mmc->tran_speed = 26000000;
+			}
 		}
 	}
 
@@ -1642,7 +2060,53 @@ static int mmc_power_init(struct mmc *mmc)
 	return 0;
 }
 
-int mmc_start_init(struct mmc *mmc)
+#ifdef CONFIG_MMC_UHS_SUPPORT
+/*
+ * Turn the card off and on again with its 'vmmc-supply' regulator. This is
+ * the only way back to 3.3V signalling for an SD card which has taken CMD11.
+ */
+static int mmc_power_cycle(struct mmc *mmc)
+{
+#if defined(CONFIG_DM_MMC) && defined(CONFIG_DM_REGULATOR) && \
+	!defined(CONFIG_SPL_BUILD)
+	struct udevice *vmmc_supply;
+	int ret;
+
+	ret = device_get_supply_regulator(mmc->dev, "vmmc-supply",
+					  &vmmc_supply);
+	if (ret) {
+		debug("%s: No vmmc supply to power cycle\n", mmc->dev->name);
+		return ret;
+	}
+
+	ret = regulator_set_enable(vmmc_supply, false);
+	if (ret)
+		return ret;
+	mmc_stop_clock(mmc);
+	mmc_set_signal_voltage(mmc, MMC_SIGNAL_VOLTAGE_330);
+	udelay(1000);
+
+	ret = regulator_set_enable(vmmc_supply, true);
+	if (ret)
+		return ret;
+	udelay(1000);
+	mmc_set_clock(mmc, 1);
+
+	return 0;
+#else
+	return -ENOSYS;
+#endif
+}
+#endif
+
+static bool mmc_host_uhs(struct mmc *mmc)
+{
+	return IS_ENABLED(CONFIG_MMC_UHS_SUPPORT) &&
+		(mmc->cfg->host_caps & MMC_MODE_UHS);
+}
+
+/* Power the card up and ask for its operating conditions, without waiting */
+static int mmc_power_up(struct mmc *mmc)
 {
 	bool no_card;
 	int err;
@@ -1677,8 +2141,20 @@ int mmc_start_init(struct mmc *mmc)
 	err = mmc->cfg->ops->init(mmc);
 	if (err)
 		return err;
+#endif
+#ifdef CONFIG_MMC_UHS_SUPPORT
+	/* An SD card left at 1.8V from an earlier init only answers at 1.8V */
+	if (IS_SD(mmc) && mmc->signal_voltage == MMC_SIGNAL_VOLTAGE_180) {
+		err = mmc_power_cycle(mmc);
+		if (err)
+			return err;
+	}
 #endif
 	mmc->ddr_mode = 0;
+	mmc->selected_mode = MMC_LEGACY;
+#if defined(CONFIG_MMC_UHS_SUPPORT) || defined(CONFIG_MMC_HS200_SUPPORT)
+	mmc_set_signal_voltage(mmc, MMC_SIGNAL_VOLTAGE_330);
+#endif
 	mmc_set_bus_width(mmc, 1);
 	mmc_set_clock(mmc, 1);
 
@@ -1695,7 +2171,7 @@ int mmc_start_init(struct mmc *mmc)
 	err = mmc_send_if_cond(mmc);
 
 	/* Now try to get the SD card's operating condition */
-	err = sd_send_op_cond(mmc);
+	err = sd_send_op_cond(mmc, mmc_host_uhs(mmc));
 
 	/* If the command timed out, we check for an MMC card */
 	if (err == -ETIMEDOUT) {
@@ -1715,13 +2191,61 @@ int mmc_start_init(struct mmc *mmc)
 	return err;
 }
 
+int mmc_start_init(struct mmc *mmc)
+{
+	int err;
+
+	/* A start which fails leaves nothing for mmc_init() to finish */
+	mmc->init_in_progress = 0;
+	mmc->init_start_us = timer_get_us();
+	bootstage_start(BOOTSTAGE_ID_ACCUM_MMC, "mmc_init");
+	err = mmc_power_up(mmc);
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_MMC);
+
+	return err;
+}
+
+/* Wait for an SD card to be ready, then switch to 1.8V if it can */
+static int sd_complete_init(struct mmc *mmc)
+{
+	bool uhs = mmc_host_uhs(mmc);
+	int err;
+
+	err = sd_complete_op_cond(mmc, uhs);
+
+#ifdef CONFIG_MMC_UHS_SUPPORT
+	/* The card offers 1.8V signalling, for the UHS-I modes */
+	if (!err && uhs && (mmc->ocr & OCR_S18R)) {
+		err = sd_switch_voltage(mmc);
+		if (err) {
+			debug("%s: No 1.8V signalling (err=%d), without UHS\n",
+			      __func__, err);
+			/* Only a power cycle takes the card back to 3.3V */
+			if (mmc_power_cycle(mmc))
+				return err;
+			err = mmc_go_idle(mmc);
+			if (err)
+				return err;
+			mmc_send_if_cond(mmc);
+			err = sd_send_op_cond(mmc, false);
+			if (!err)
+				err = sd_complete_op_cond(mmc, false);
+		}
+	}
+#endif
+
+	return err;
+}
+
 static int mmc_complete_init(struct mmc *mmc)
 {
 	int err = 0;
 
+	bootstage_start(BOOTSTAGE_ID_ACCUM_MMC, "mmc_init");
 	mmc->init_in_progress = 0;
 	if (mmc->op_cond_pending)
-		err = mmc_complete_op_cond(mmc);
+		err = IS_SD(mmc) ? sd_complete_init(mmc) :
+			mmc_complete_op_cond(mmc);
 
 	if (!err)
 		err = mmc_startup(mmc);
@@ -1729,6 +2253,15 @@ static int mmc_complete_init(struct mmc *mmc)
 		mmc->has_init = 0;
 	else
 		mmc->has_init = 1;
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_MMC);
+
+	/* Record how long each device took to get ready, the first time */
+	if (!err && !mmc->init_time_us) {
+		mmc->init_time_us = max(timer_get_us() - mmc->init_start_us,
+					1UL);
+		bootstage_add_duration(mmc->cfg->name, mmc->init_time_us);
+	}
+
 	return err;
 }
 
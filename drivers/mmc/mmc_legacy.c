@@ -161,6 +161,7 @@ struct mmc *mmc_create(const struct mmc_config *cfg, void *priv)
 
 	mmc->cfg = cfg;
 	mmc->priv = priv;
+	mmc->preinit = IS_ENABLED(CONFIG_MMC_ASYNC_INIT);
 
 	/* the following chunk was mmc_register() */
 
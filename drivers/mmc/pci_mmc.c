@@ -24,7 +24,7 @@ int pci_mmc_init(const char *name, struct pci_device_id *mmc_supported)
 		ret = pci_find_device_id(mmc_supported, i, &dev);
 		if (ret)
 			return ret;
-		mmc_host = malloc(sizeof(struct sdhci_host));
+		mmc_host = calloc(1, sizeof(struct sdhci_host));
 		if (!mmc_host)
 			return -ENOMEM;
 
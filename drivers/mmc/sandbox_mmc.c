@@ -11,29 +11,208 @@
 #include <fdtdec.h>
 #include <mmc.h>
 #include <asm/test.h>
+#include <power/regulator.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
+/**
+ * struct sandbox_mmc_plat - Platform data of the host and the emulated card
+ *
+ * @emmc:	Emulate an eMMC, which can do HS200 and HS400, instead of an SD
+ *		card ("sandbox,emmc")
+ * @uhs:	The SD card supports the UHS-I modes ("sandbox,uhs")
+ */
 struct sandbox_mmc_plat {
 	struct mmc_config cfg;
 	struct mmc mmc;
+	bool emmc;
+	bool uhs;
 };
 
 /**
- * sandbox_mmc_send_cmd() - Emulate SD commands
+ * struct sandbox_mmc_priv - State of the emulated card
+ *
+ * @tuning_fails:	Tuning never finds a sampling point
+ * @tuned:		Tuning has been done since the mode needing it was set
+ * @s18a:		The SD card has switched to 1.8V signalling (CMD11). Only
+ *			a power cycle through 'vmmc-supply' undoes this
+ * @dat_low:		The SD card holds DAT[3:0] low, during the 1.8V switch
+ * @clock_stopped:	SDCLK has stopped since CMD11
+ * @switch_fails:	The SD card never releases DAT[3:0] after CMD11
+ * @access_mode:	SD access mode function (SD_SWITCH_...), 0 for default
+ * @ext_csd:		EXT_CSD of the eMMC
+ * @block_count:	Length of the next multiple-block transfer (CMD23), or 0
+ * @open_ended:		A multiple-block transfer is waiting for CMD12
+ * @cmd_count:		Number of each command received
+ * @powerup_polls:	Number of operating condition requests (CMD1, ACMD41)
+ *			for which the card is still powering up
+ * @no_card:		The slot is empty
+ */
+struct sandbox_mmc_priv {
+	bool tuning_fails;
+	bool tuned;
+	bool s18a;
+	bool dat_low;
+	bool clock_stopped;
+	bool switch_fails;
+	int access_mode;
+	u8 ext_csd[MMC_MAX_BLOCK_LEN];
+	uint block_count;
+	bool open_ended;
+	uint cmd_count[64];
+	uint powerup_polls;
+	bool no_card;
+};
+
+/* Start a multiple-block transfer, of the length given by CMD23 if any */
+static int sandbox_mmc_multi_block(struct udevice *dev, struct mmc_data *data)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	uint count = priv->block_count;
+
+	priv->block_count = 0;
+	if (count && count != data->blocks)
+		return -EIO;
+	priv->open_ended = !count;
+
+	return 0;
+}
+
+static void sandbox_mmc_reset(struct udevice *dev)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	u8 *ext_csd = priv->ext_csd;
+
+	priv->tuned = false;
+	priv->access_mode = 0;
+	memset(ext_csd, '\0', MMC_MAX_BLOCK_LEN);
+	ext_csd[EXT_CSD_REV] = 8;			/* eMMC 5.1 */
+	ext_csd[EXT_CSD_CARD_TYPE] = EXT_CSD_CARD_TYPE_26 |
+		EXT_CSD_CARD_TYPE_52 | EXT_CSD_CARD_TYPE_DDR_1_8V |
+		EXT_CSD_CARD_TYPE_HS200_1_8V | EXT_CSD_CARD_TYPE_HS400_1_8V;
+	ext_csd[EXT_CSD_SEC_CNT + 2] = 0x80;		/* 4 GiB */
+}
+
+/* Emulate CMD6 of an eMMC, refusing the switches JEDEC does not allow */
+static void sandbox_mmc_switch(struct udevice *dev, uint arg)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	u8 *ext_csd = priv->ext_csd;
+	u8 index = arg >> 16, value = arg >> 8;
+
+	if (index == EXT_CSD_HS_TIMING) {
+		u8 width = ext_csd[EXT_CSD_BUS_WIDTH];
+
+		if (value == EXT_CSD_TIMING_HS200 &&
+		    width != EXT_CSD_BUS_WIDTH_4 &&
+		    width != EXT_CSD_BUS_WIDTH_8)
+			return;
+		if (value == EXT_CSD_TIMING_HS400 &&
+		    (width != EXT_CSD_DDR_BUS_WIDTH_8 ||
+		     ext_csd[EXT_CSD_HS_TIMING] != EXT_CSD_TIMING_HS))
+			return;
+		if (value == EXT_CSD_TIMING_HS200)
+			priv->tuned = false;
+	}
+	ext_csd[index] = value;
+}
+
+/* Emulate CMD6 of an SD card, for the access mode group */
+static void sandbox_mmc_switch_func(struct udevice *dev, uint arg, u32 *resp)
+{
+	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	uint funcs = SD_SWITCH_SUPPORTED(0) | SD_SWITCH_SUPPORTED(1);
+	int func = arg & 0xf;
+
+	memset(resp, '\0', 64);
+	if (!plat->uhs) {
+		/* The high-speed function is always busy */
+		resp[7] = cpu_to_be32(SD_HIGHSPEED_BUSY);
+		return;
+	}
+
+	if (priv->s18a)
+		funcs |= SD_SWITCH_SUPPORTED(SD_SWITCH_SDR50) |
+			 SD_SWITCH_SUPPORTED(SD_SWITCH_SDR104) |
+			 SD_SWITCH_SUPPORTED(SD_SWITCH_DDR50);
+	if (func == 0xf)
+		func = priv->access_mode;
+	else if (!(funcs & SD_SWITCH_SUPPORTED(func)))
+		func = 0xf;
+	else if (arg & (1U << 31))
+		priv->access_mode = func;
+	if (func == SD_SWITCH_SDR104)
+		priv->tuned = false;
+	resp[3] = cpu_to_be32(funcs);
+	resp[4] = cpu_to_be32(func << 24);
+}
+
+/**
+ * sandbox_mmc_send_cmd() - Emulate SD or eMMC commands
  *
- * This emulate an SD card version 2. Single-block reads result in zero data.
- * Multiple-block reads return a test string.
+ * This emulate an SD card version 2, or an eMMC. Single-block reads result in
+ * zero data. Multiple-block reads return a test string.
  */
 static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 				struct mmc_data *data)
 {
+	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	struct mmc *mmc = &plat->mmc;
+	int ret;
+
+	priv->cmd_count[cmd->cmdidx % ARRAY_SIZE(priv->cmd_count)]++;
+
+	/* Once at 1.8V, the card does not understand a host at 3.3V */
+	if (priv->s18a && mmc->signal_voltage != MMC_SIGNAL_VOLTAGE_180)
+		return -ETIMEDOUT;
+
+	/* Untuned, data is sampled at the wrong time */
+	if (data && !priv->tuned &&
+	    (mmc->selected_mode == MMC_HS_200 ||
+	     mmc->selected_mode == MMC_HS_400 ||
+	     mmc->selected_mode == UHS_SDR104))
+		return -EIO;
+
+	if (plat->emmc) {
+		switch (cmd->cmdidx) {
+		case MMC_CMD_APP_CMD:
+			return -ETIMEDOUT;
+		case MMC_CMD_SEND_EXT_CSD:
+			/* The same index as SD_CMD_SEND_IF_COND, with data */
+			if (!data)
+				return -ETIMEDOUT;
+			memcpy(data->dest, priv->ext_csd, MMC_MAX_BLOCK_LEN);
+			return 0;
+		case MMC_CMD_SEND_OP_COND:
+			cmd->response[0] = OCR_HCS | MMC_VDD_165_195 |
+				MMC_VDD_32_33 | MMC_VDD_33_34;
+			if (!priv->powerup_polls)
+				cmd->response[0] |= OCR_BUSY;
+			else
+				priv->powerup_polls--;
+			return 0;
+		case MMC_CMD_SEND_CSD:
+			cmd->response[0] = 4 << 26 | 0x32; /* v4, 25 MHz */
+			cmd->response[1] = 9 << 16;	/* 1 << block_len */
+			cmd->response[2] = 0;
+			cmd->response[3] = 9 << 22;	/* 1 << write_bl_len */
+			return 0;
+		case MMC_CMD_SWITCH:
+			sandbox_mmc_switch(dev, cmd->cmdarg);
+			return 0;
+		}
+	}
+
 	switch (cmd->cmdidx) {
 	case MMC_CMD_ALL_SEND_CID:
 		break;
 	case SD_CMD_SEND_RELATIVE_ADDR:
 		cmd->response[0] = 0 << 16; /* mmc->rca */
+		break;
 	case MMC_CMD_GO_IDLE_STATE:
+		sandbox_mmc_reset(dev);
 		break;
 	case SD_CMD_SEND_IF_COND:
 		cmd->response[0] = 0xaa;
@@ -47,22 +226,49 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 		cmd->response[0] = 0;
 		cmd->response[1] = 10 << 16;	/* 1 << block_len */
 		break;
-	case SD_CMD_SWITCH_FUNC: {
-		u32 *resp = (u32 *)data->dest;
-
-		resp[7] = cpu_to_be32(SD_HIGHSPEED_BUSY);
+	case SD_CMD_SWITCH_FUNC:
+		/* Without data, this is SD_CMD_APP_SET_BUS_WIDTH */
+		if (data)
+			sandbox_mmc_switch_func(dev, cmd->cmdarg,
+						(u32 *)data->dest);
+		break;
+	case SD_CMD_SWITCH_UHS18V:
+		if (!plat->uhs)
+			return -ETIMEDOUT;
+		priv->s18a = true;
+		priv->dat_low = true;
+		priv->clock_stopped = false;
 		break;
-	}
 	case MMC_CMD_READ_SINGLE_BLOCK:
 		memset(data->dest, '\0', data->blocksize);
 		break;
 	case MMC_CMD_READ_MULTIPLE_BLOCK:
+		ret = sandbox_mmc_multi_block(dev, data);
+		if (ret)
+			return ret;
 		strcpy(data->dest, "this is a test");
 		break;
+	case MMC_CMD_WRITE_MULTIPLE_BLOCK:
+		return sandbox_mmc_multi_block(dev, data);
+	case MMC_CMD_SET_BLOCK_COUNT:
+		if (!plat->emmc && !plat->uhs)
+			return -EIO;
+		priv->block_count = cmd->cmdarg & 0xffff;
+		break;
 	case MMC_CMD_STOP_TRANSMISSION:
+		/* A transfer with its length set has already stopped */
+		if (!priv->open_ended)
+			return -EIO;
+		priv->open_ended = false;
 		break;
 	case SD_CMD_APP_SEND_OP_COND:
-		cmd->response[0] = OCR_BUSY | OCR_HCS;
+		cmd->response[0] = OCR_HCS;
+		if (!priv->powerup_polls)
+			cmd->response[0] |= OCR_BUSY;
+		else
+			priv->powerup_polls--;
+		if (plat->uhs && (cmd->cmdarg & OCR_S18R))
+			cmd->response[0] |= OCR_S18R;
 		cmd->response[1] = 0;
 		cmd->response[2] = 0;
 		break;
@@ -75,6 +281,8 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 		u32 *scr = (u32 *)data->dest;
 
 		scr[0] = cpu_to_be32(2 << 24 | 1 << 15);  /* SD version 3 */
+		if (plat->uhs)
+			scr[0] |= cpu_to_be32(SD_DATA_4BIT | SD_SCR_CMD23);
 		break;
 	}
 	default:
@@ -85,25 +293,124 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 	return 0;
 }
 
+/*
+ * The card loses its state while its supply is off. After CMD11 it lets go
+ * of DAT[3:0] once the clock has stopped and come back, with the host at
+ * 1.8V.
+ */
 static int sandbox_mmc_set_ios(struct udevice *dev)
 {
+	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	struct mmc *mmc = &plat->mmc;
+	struct udevice *vmmc_supply;
+
+	if (!device_get_supply_regulator(dev, "vmmc-supply", &vmmc_supply) &&
+	    !regulator_get_enable(vmmc_supply)) {
+		sandbox_mmc_reset(dev);
+		priv->s18a = false;
+		priv->dat_low = false;
+	}
+
+	if (!mmc->clock)
+		priv->clock_stopped = true;
+	else if (priv->dat_low && priv->clock_stopped &&
+		 mmc->signal_voltage == MMC_SIGNAL_VOLTAGE_180 &&
+		 !priv->switch_fails)
+		priv->dat_low = false;
+
 	return 0;
 }
 
 static int sandbox_mmc_get_cd(struct udevice *dev)
 {
-	return 1;
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	return !priv->no_card;
+}
+
+static int sandbox_mmc_card_busy(struct udevice *dev)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	return priv->dat_low;
+}
+
+static int sandbox_mmc_execute_tuning(struct udevice *dev, uint opcode)
+{
+	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	struct mmc *mmc = &plat->mmc;
+	bool ok;
+
+	if (opcode == MMC_CMD_SEND_TUNING_BLOCK_HS200)
+		ok = plat->emmc && mmc->selected_mode == MMC_HS_200 &&
+		     priv->ext_csd[EXT_CSD_HS_TIMING] == EXT_CSD_TIMING_HS200;
+	else
+		ok = plat->uhs && mmc->selected_mode == UHS_SDR104 &&
+		     priv->access_mode == SD_SWITCH_SDR104;
+	if (!ok || priv->tuning_fails ||
+	    mmc->signal_voltage != MMC_SIGNAL_VOLTAGE_180)
+		return -EIO;
+	priv->tuned = true;
+
+	return 0;
+}
+
+void sandbox_mmc_set_tuning_fails(struct udevice *dev, bool fails)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	priv->tuning_fails = fails;
+}
+
+void sandbox_mmc_set_switch_fails(struct udevice *dev, bool fails)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	priv->switch_fails = fails;
+}
+
+void sandbox_mmc_set_no_card(struct udevice *dev, bool no_card)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	priv->no_card = no_card;
+}
+
+uint sandbox_mmc_get_cmd_count(struct udevice *dev, uint cmdidx)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	return priv->cmd_count[cmdidx];
 }
 
 static const struct dm_mmc_ops sandbox_mmc_ops = {
 	.send_cmd = sandbox_mmc_send_cmd,
 	.set_ios = sandbox_mmc_set_ios,
 	.get_cd = sandbox_mmc_get_cd,
+	.execute_tuning = sandbox_mmc_execute_tuning,
+	.card_busy = sandbox_mmc_card_busy,
 };
 
 int sandbox_mmc_probe(struct udevice *dev)
 {
+	struct mmc_uclass_priv *upriv = dev_get_uclass_priv(dev);
 	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	upriv->mmc = &plat->mmc;
+	/* The card is busy for a few polls after power-up */
+	priv->powerup_polls = 3;
+
+	/*
+	 * There is no board to bring MMC up, so start the init here as preinit
+	 * would, and leave the block device to finish it
+	 */
+	if (plat->mmc.preinit) {
+		mmc_start_init(&plat->mmc);
+		return 0;
+	}
 
 	return mmc_init(&plat->mmc);
 }
@@ -112,13 +419,30 @@ int sandbox_mmc_bind(struct udevice *dev)
 {
 	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
 	struct mmc_config *cfg = &plat->cfg;
+	const void *blob = gd->fdt_blob;
+	int node = dev->of_offset;
 
 	cfg->name = dev->name;
-	cfg->host_caps = MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_8BIT;
+	cfg->host_caps = MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_4BIT |
+			  MMC_MODE_8BIT | MMC_MODE_CMD23;
+	if (fdtdec_get_bool(blob, node, "mmc-ddr-1_8v"))
+		cfg->host_caps |= MMC_MODE_DDR_52MHz;
+	if (fdtdec_get_bool(blob, node, "mmc-hs200-1_8v"))
+		cfg->host_caps |= MMC_MODE_HS200;
+	if (fdtdec_get_bool(blob, node, "mmc-hs400-1_8v"))
+		cfg->host_caps |= MMC_MODE_HS200 | MMC_MODE_HS400;
+	if (fdtdec_get_bool(blob, node, "sd-uhs-sdr50"))
+		cfg->host_caps |= MMC_MODE_UHS_SDR50;
+	if (fdtdec_get_bool(blob, node, "sd-uhs-sdr104"))
+		cfg->host_caps |= MMC_MODE_UHS_SDR104;
+	if (fdtdec_get_bool(blob, node, "sd-uhs-ddr50"))
+		cfg->host_caps |= MMC_MODE_UHS_DDR50;
 	cfg->voltages = MMC_VDD_165_195 | MMC_VDD_32_33 | MMC_VDD_33_34;
 	cfg->f_min = 1000000;
-	cfg->f_max = 52000000;
+	cfg->f_max = fdtdec_get_int(blob, node, "max-frequency", 52000000);
 	cfg->b_max = U32_MAX;
+	plat->emmc = fdtdec_get_bool(blob, node, "sandbox,emmc");
+	plat->uhs = fdtdec_get_bool(blob, node, "sandbox,uhs");
 
 	return mmc_bind(dev, &plat->mmc, cfg);
 }
@@ -144,4 +468,5 @@ U_BOOT_DRIVER(mmc_sandbox) = {
 	.unbind		= sandbox_mmc_unbind,
 	.probe		= sandbox_mmc_probe,
 	.platdata_auto_alloc_size = sizeof(struct sandbox_mmc_plat),
+	.priv_auto_alloc_size = sizeof(struct sandbox_mmc_priv),
 };
@@ -68,18 +68,87 @@ static void sdhci_transfer_pio(struct sdhci_host *host, struct mmc_data *data)
 	}
 }
 
-static int sdhci_transfer_data(struct sdhci_host *host, struct mmc_data *data,
-				unsigned int start_addr)
+#if defined(CONFIG_MMC_SDHCI_SDMA) || defined(CONFIG_MMC_SDHCI_ADMA)
+static void sdhci_set_dma(struct sdhci_host *host, u8 dma)
 {
-	unsigned int stat, rdy, mask, timeout, block = 0;
-#ifdef CONFIG_MMC_SDHCI_SDMA
-	unsigned char ctrl;
+	u8 ctrl;
+
 	ctrl = sdhci_readb(host, SDHCI_HOST_CONTROL);
 	ctrl &= ~SDHCI_CTRL_DMA_MASK;
+	ctrl |= dma;
 	sdhci_writeb(host, ctrl, SDHCI_HOST_CONTROL);
+}
+#endif
+
+#ifdef CONFIG_MMC_SDHCI_ADMA
+/*
+ * Describe the buffer of data to the ADMA2 engine, in as few descriptors as
+ * it takes. Returns false if the buffer is not aligned for ADMA2 or needs
+ * more descriptors than the table holds, which then leaves the transfer to
+ * SDMA or PIO.
+ */
+static bool sdhci_prepare_adma(struct sdhci_host *host, struct mmc_data *data)
+{
+	bool adma64 = host->flags & SDHCI_USE_ADMA64;
+	uint desc_len = adma64 ? ADMA_DESC_64_LEN : ADMA_DESC_LEN;
+	uint todo = data->blocks * data->blocksize;
+	struct sdhci_adma_desc *desc;
+	void *table = host->adma_desc_table;
+	void *pos = table;
+	ulong addr, len, attr;
+
+	if (!(host->flags & SDHCI_USE_ADMA))
+		return false;
+	if (data->flags == MMC_DATA_READ)
+		addr = (ulong)data->dest;
+	else
+		addr = (ulong)data->src;
+	if (addr & (adma64 ? 0x7 : 0x3))
+		return false;
+	if (DIV_ROUND_UP(todo, ADMA_MAX_LEN) * desc_len > ADMA_TABLE_SZ)
+		return false;
+
+	flush_cache(addr, ALIGN(todo, CONFIG_SYS_CACHELINE_SIZE));
+	for (; todo; todo -= len, addr += len, pos += desc_len) {
+		len = min_t(ulong, todo, ADMA_MAX_LEN);
+		desc = pos;
+		attr = ADMA_DESC_ATTR_VALID | ADMA_DESC_ATTR_ACT_TRAN;
+		if (len == todo)
+			attr |= ADMA_DESC_ATTR_END;
+		desc->attr = cpu_to_le16(attr);
+		/* 64 KiB wraps to 0, which is what the engine expects */
+		desc->len = cpu_to_le16(len & 0xffff);
+		desc->addr_lo = cpu_to_le32(lower_32_bits(addr));
+		if (adma64)
+			desc->addr_hi = cpu_to_le32(upper_32_bits(addr));
+	}
+	len = ALIGN(pos - table, CONFIG_SYS_CACHELINE_SIZE);
+	flush_cache((ulong)table, len);
+
+	sdhci_writel(host, lower_32_bits((ulong)table), SDHCI_ADMA_ADDRESS);
+	if (adma64)
+		sdhci_writel(host, upper_32_bits((ulong)table),
+			     SDHCI_ADMA_ADDRESS_HI);
+	sdhci_set_dma(host, adma64 ? SDHCI_CTRL_ADMA64 : SDHCI_CTRL_ADMA32);
+
+	return true;
+}
 #endif
 
-	timeout = 1000000;
+/*
+ * Status is polled back to back while data moves, and with a delay growing
+ * up to SDHCI_POLL_MAX_US once the controller has gone quiet.
+ */
+#define SDHCI_POLL_MAX_US		10
+#define SDHCI_TRANSFER_TIMEOUT		10000	/* ms */
+
+static int sdhci_transfer_data(struct sdhci_host *host, struct mmc_data *data,
+				unsigned int start_addr)
+{
+	unsigned int stat, rdy, mask, block = 0;
+	unsigned int delay_us = 0;
+	ulong start = get_timer(0);
+
 	rdy = SDHCI_INT_SPACE_AVAIL | SDHCI_INT_DATA_AVAIL;
 	mask = SDHCI_DATA_AVAILABLE | SDHCI_SPACE_AVAILABLE;
 	do {
@@ -87,6 +156,16 @@ static int sdhci_transfer_data(struct sdhci_host *host, struct mmc_data *data,
 		if (stat & SDHCI_INT_ERROR) {
 			printf("%s: Error detected in status(0x%X)!\n",
 			       __func__, stat);
+#ifdef CONFIG_MMC_SDHCI_ADMA
+			if (stat & SDHCI_INT_ADMA_ERROR)
+				printf("%s: ADMA error 0x%X at 0x%X\n",
+				       __func__,
+				       sdhci_readb(host, SDHCI_ADMA_ERROR),
+				       sdhci_readl(host, SDHCI_ADMA_ADDRESS));
+#endif
+			if (stat & SDHCI_INT_ACMD12ERR)
+				printf("%s: Auto-CMD error 0x%X\n", __func__,
+				       sdhci_readw(host, SDHCI_ACMD12_ERR));
 			return -EIO;
 		}
 		if (stat & rdy) {
@@ -97,6 +176,8 @@ static int sdhci_transfer_data(struct sdhci_host *host, struct mmc_data *data,
 			data->dest += data->blocksize;
 			if (++block >= data->blocks)
 				break;
+			delay_us = 0;
+			continue;
 		}
 #ifdef CONFIG_MMC_SDHCI_SDMA
 		if (stat & SDHCI_INT_DMA_END) {
@@ -104,14 +185,17 @@ static int sdhci_transfer_data(struct sdhci_host *host, struct mmc_data *data,
 			start_addr &= ~(SDHCI_DEFAULT_BOUNDARY_SIZE - 1);
 			start_addr += SDHCI_DEFAULT_BOUNDARY_SIZE;
 			sdhci_writel(host, start_addr, SDHCI_DMA_ADDRESS);
+			delay_us = 0;
+			continue;
 		}
 #endif
-		if (timeout-- > 0)
-			udelay(10);
-		else {
+		if (get_timer(start) > SDHCI_TRANSFER_TIMEOUT) {
 			printf("%s: Transfer data timeout\n", __func__);
 			return -ETIMEDOUT;
 		}
+		if (delay_us)
+			udelay(delay_us);
+		delay_us = min_t(uint, delay_us * 2 + 1, SDHCI_POLL_MAX_US);
 	} while (!(stat & SDHCI_INT_DATA_END));
 	return 0;
 }
@@ -149,6 +233,17 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 
 	/* Timeout unit - ms */
 	static unsigned int cmd_timeout = SDHCI_CMD_DEFAULT_TIMEOUT;
+	bool sbc = host->sbc_pending;
+
+	host->sbc_pending = false;
+	if (cmd->cmdidx == MMC_CMD_SET_BLOCK_COUNT) {
+		host->sbc_pending = true;
+		/* The controller sends it, just before the transfer */
+		if (host->flags & SDHCI_AUTO_CMD23) {
+			host->sbc_arg = cmd->cmdarg;
+			return 0;
+		}
+	}
 
 	sdhci_writel(host, SDHCI_INT_ALL_MASK, SDHCI_INT_STATUS);
 	mask = SDHCI_CMD_INHIBIT | SDHCI_DATA_INHIBIT;
@@ -198,38 +293,60 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 		sdhci_writeb(host, 0xe, SDHCI_TIMEOUT_CONTROL);
 		mode = SDHCI_TRNS_BLK_CNT_EN;
 		trans_bytes = data->blocks * data->blocksize;
-		if (data->blocks > 1)
+		/* CMD23 may also come before a single block, as with RPMB */
+		if (data->blocks > 1 || sbc) {
 			mode |= SDHCI_TRNS_MULTI;
+			if (sbc) {
+				if (host->flags & SDHCI_AUTO_CMD23) {
+					sdhci_writel(host, host->sbc_arg,
+						     SDHCI_ARGUMENT2);
+					mode |= SDHCI_TRNS_AUTO_CMD23;
+				}
+			} else if (mmc->cfg->host_caps & MMC_MODE_AUTO_CMD12) {
+				mode |= SDHCI_TRNS_ACMD12;
+			}
+		}
 
 		if (data->flags == MMC_DATA_READ)
 			mode |= SDHCI_TRNS_READ;
 
+#ifdef CONFIG_MMC_SDHCI_ADMA
+		if (sdhci_prepare_adma(host, data))
+			mode |= SDHCI_TRNS_DMA;
+#endif
 #ifdef CONFIG_MMC_SDHCI_SDMA
-		if (data->flags == MMC_DATA_READ)
-			start_addr = (unsigned long)data->dest;
-		else
-			start_addr = (unsigned long)data->src;
-		if ((host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR) &&
-				(start_addr & 0x7) != 0x0) {
+		if (!(mode & SDHCI_TRNS_DMA)) {
+			if (data->flags == MMC_DATA_READ)
+				start_addr = (unsigned long)data->dest;
+			else
+				start_addr = (unsigned long)data->src;
+			if ((host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR) &&
+			    (start_addr & 0x7) != 0x0) {
+				is_aligned = 0;
+				start_addr = (unsigned long)aligned_buffer;
+				if (data->flags != MMC_DATA_READ)
+					memcpy(aligned_buffer, data->src,
+					       trans_bytes);
+			}
+
+#if defined(CONFIG_FIXED_SDHCI_ALIGNED_BUFFER)
+			/*
+			 * Always use this bounce-buffer when
+			 * CONFIG_FIXED_SDHCI_ALIGNED_BUFFER is defined
+			 */
 			is_aligned = 0;
 			start_addr = (unsigned long)aligned_buffer;
 			if (data->flags != MMC_DATA_READ)
 				memcpy(aligned_buffer, data->src, trans_bytes);
-		}
-
-#if defined(CONFIG_FIXED_SDHCI_ALIGNED_BUFFER)
-		/*
-		 * Always use this bounce-buffer when
-		 * CONFIG_FIXED_SDHCI_ALIGNED_BUFFER is defined
-		 */
-		is_aligned = 0;
-		start_addr = (unsigned long)aligned_buffer;
-		if (data->flags != MMC_DATA_READ)
-			memcpy(aligned_buffer, data->src, trans_bytes);
 #endif
 
-		sdhci_writel(host, start_addr, SDHCI_DMA_ADDRESS);
-		mode |= SDHCI_TRNS_DMA;
+			sdhci_writel(host, start_addr, SDHCI_DMA_ADDRESS);
+			sdhci_set_dma(host, SDHCI_CTRL_SDMA);
+			mode |= SDHCI_TRNS_DMA;
+			trans_bytes = ALIGN(trans_bytes,
+					    CONFIG_SYS_CACHELINE_SIZE);
+			flush_cache(start_addr, trans_bytes);
+		}
 #endif
 		sdhci_writew(host, SDHCI_MAKE_BLKSZ(SDHCI_DEFAULT_BOUNDARY_ARG,
 				data->blocksize),
@@ -241,10 +358,6 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 	}
 
 	sdhci_writel(host, cmd->cmdarg, SDHCI_ARGUMENT);
-#ifdef CONFIG_MMC_SDHCI_SDMA
-	trans_bytes = ALIGN(trans_bytes, CONFIG_SYS_CACHELINE_SIZE);
-	flush_cache(start_addr, trans_bytes);
-#endif
 	sdhci_writew(host, SDHCI_MAKE_CMD(cmd->cmdidx, flags), SDHCI_COMMAND);
 	start = get_timer(0);
 	do {
@@ -478,6 +591,18 @@ static int sdhci_init(struct mmc *mmc)
 		}
 	}
 
+#ifdef CONFIG_MMC_SDHCI_ADMA
+	if ((host->flags & SDHCI_USE_ADMA) && !host->adma_desc_table) {
+		host->adma_desc_table = memalign(CONFIG_SYS_CACHELINE_SIZE,
+						 ADMA_TABLE_SZ);
+		if (!host->adma_desc_table) {
+			printf("%s: ADMA descriptor table alloc failed!!!\n",
+			       __func__);
+			return -ENOMEM;
+		}
+	}
+#endif
+
 	sdhci_set_power(host, fls(mmc->cfg->voltages) - 1);
 
 	if (host->ops->get_cd)
@@ -517,6 +642,7 @@ int sdhci_setup_cfg(struct mmc_config *cfg, struct sdhci_host *host,
 {
 	u32 caps, caps_1;
 
+	host->flags = 0;
 	caps = sdhci_readl(host, SDHCI_CAPABILITIES);
 
 #ifdef CONFIG_MMC_SDHCI_SDMA
@@ -525,6 +651,17 @@ int sdhci_setup_cfg(struct mmc_config *cfg, struct sdhci_host *host,
 		       __func__);
 		return -EINVAL;
 	}
+#endif
+#ifdef CONFIG_MMC_SDHCI_ADMA
+	if (caps & SDHCI_CAN_DO_ADMA2) {
+		host->flags |= SDHCI_USE_ADMA;
+#ifdef CONFIG_DMA_ADDR_T_64BIT
+		if (caps & SDHCI_CAN_64BIT)
+			host->flags |= SDHCI_USE_ADMA64;
+#endif
+	} else {
+		debug("%s: no ADMA2, not using it\n", __func__);
+	}
 #endif
 	if (host->quirks & SDHCI_QUIRK_REG32_RW)
 		host->version =
@@ -572,6 +709,14 @@ int sdhci_setup_cfg(struct mmc_config *cfg, struct sdhci_host *host,
 		cfg->voltages |= host->voltages;
 
 	cfg->host_caps = MMC_MODE_HS | MMC_MODE_HS_52MHz | MMC_MODE_4BIT;
+#ifdef CONFIG_MMC_SDHCI_AUTO_CMD
+	cfg->host_caps |= MMC_MODE_CMD23 | MMC_MODE_AUTO_CMD12;
+#ifndef CONFIG_MMC_SDHCI_SDMA
+	/* Its argument goes where SDMA would have its address */
+	if (SDHCI_GET_VERSION(host) >= SDHCI_SPEC_300)
+		host->flags |= SDHCI_AUTO_CMD23;
+#endif
+#endif
 
 	/* Since Host Controller Version3.0 */
 	if (SDHCI_GET_VERSION(host) >= SDHCI_SPEC_300) {
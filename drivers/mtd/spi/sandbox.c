@@ -15,6 +15,8 @@
 #include <os.h>
 
 #include <spi_flash.h>
+#include <linux/log2.h>
+#include <linux/sizes.h>
 #include "sf_internal.h"
 
 #include <asm/getopt.h>
@@ -41,13 +43,15 @@ enum sandbox_sf_state {
 	SF_READ_STATUS, /* read the flash's status register */
 	SF_READ_STATUS1, /* read the flash's status register upper 8 bits*/
 	SF_WRITE_STATUS, /* write the flash's status register */
+	SF_READ_SFDP, /* read the flash's SFDP tables */
+	SF_BUSY, /* ignoring a command while an erase is in progress */
 };
 
 static const char *sandbox_sf_state_name(enum sandbox_sf_state state)
 {
 	static const char * const states[] = {
 		"CMD", "ID", "ADDR", "READ", "WRITE", "ERASE", "READ_STATUS",
-		"READ_STATUS1", "WRITE_STATUS",
+		"READ_STATUS1", "WRITE_STATUS", "READ_SFDP", "BUSY",
 	};
 	return states[state];
 }
@@ -55,11 +59,34 @@ static const char *sandbox_sf_state_name(enum sandbox_sf_state state)
 /* Bits for the status register */
 #define STAT_WIP	(1 << 0)
 #define STAT_WEL	(1 << 1)
+#define STAT_SUS	(1 << 15)	/* erase suspended, bit 7 of status 2 */
 
-/* Assume all SPI flashes have 3 byte addresses since they do atm */
+/* Commands take 3 address bytes, unless a 4-byte opcode is used */
 #define SF_ADDR_LEN	3
+#define SF_ADDR_LEN_4B	4
 
-#define IDCODE_LEN 3
+/* Layout of the emulated SFDP: header, BFPT and 4-byte address table */
+#define SF_SFDP_BFPT	0x30
+#define SF_SFDP_BFPT_LEN	16
+#define SF_SFDP_4BAIT	0x70
+#define SF_SFDP_LEN	0x80
+
+/*
+ * Parts which exist only to exercise SFDP. They are not in spi_flash_ids,
+ * so the flash core can only find out about them through their SFDP.
+ */
+static const struct spi_flash_info sandbox_sf_flash_ids[] = {
+	{
+		.name = "sandbox_sfdp",
+		.id = { 0xaa, 0x60, 0x19 },
+		.id_len = 3,
+		.sector_size = 64 << 10,
+		.n_sectors = 512,
+		.page_size = 256,
+		.flags = SECT_4K | RD_FULL | OPCODES_4B,
+	},
+	{},	/* Empty entry to terminate the list */
+};
 
 /* Used to quickly bulk erase backing store */
 static u8 sandbox_sf_0xff[0x1000];
@@ -85,12 +112,24 @@ struct sandbox_spi_flash {
 	uint off;
 	/* How many address bytes we've consumed */
 	uint addr_bytes, pad_addr_bytes;
+	/* How many address bytes the current command takes */
+	uint addr_len;
 	/* The current flash status (see STAT_XXX defines above) */
 	u16 status;
+	/* Time to erase each 4KiB in microseconds, 0 to erase at once */
+	uint erase_us;
+	/* Time to program each page in microseconds, 0 to program at once */
+	uint prog_us;
+	/* When the erase or program in progress ends, from timer_get_us() */
+	ulong busy_end;
+	/* Time left for a suspended erase, in microseconds */
+	ulong erase_left;
 	/* Data describing the flash we're emulating */
 	const struct spi_flash_info *data;
 	/* The file on disk to serv up data from */
 	int fd;
+	/* SFDP tables describing the flash, little-endian */
+	u32 sfdp[SF_SFDP_LEN / 4];
 };
 
 struct sandbox_spi_flash_plat_data {
@@ -100,6 +139,106 @@ struct sandbox_spi_flash_plat_data {
 	int cs;
 };
 
+static const struct spi_flash_info *
+sandbox_sf_find(const struct spi_flash_info *data, const char *name,
+		size_t name_len)
+{
+	for (; data->name; data++) {
+		if (strlen(data->name) == name_len &&
+		    !strncasecmp(name, data->name, name_len))
+			return data;
+	}
+
+	return NULL;
+}
+
+/* Describe the emulated flash in SFDP (JESD216B) tables */
+static void sandbox_sf_build_sfdp(struct sandbox_spi_flash *sbsf)
+{
+	const struct spi_flash_info *data = sbsf->data;
+	u64 size = (u64)data->sector_size * data->n_sectors;
+	bool use_4b = (data->flags & OPCODES_4B) && size > SPI_FLASH_16MB_BOUN;
+	u32 bfpt[SF_SFDP_BFPT_LEN], bait[2];
+	uint i;
+
+	memset(sbsf->sfdp, 0xff, sizeof(sbsf->sfdp));
+	memset(bfpt, '\0', sizeof(bfpt));
+
+	/* Header (rev 1.6) and parameter headers */
+	sbsf->sfdp[0] = 0x50444653;
+	sbsf->sfdp[1] = 0xff000106 | (use_4b ? 1 : 0) << 16;
+	sbsf->sfdp[2] = SF_SFDP_BFPT_LEN << 24 | 0x010600;
+	sbsf->sfdp[3] = 0xff000000 | SF_SFDP_BFPT;
+	if (use_4b) {
+		sbsf->sfdp[4] = ARRAY_SIZE(bait) << 24 | 0x010084;
+		sbsf->sfdp[5] = 0xff000000 | SF_SFDP_4BAIT;
+	}
+
+	/* Basic flash parameter table */
+	bfpt[0] = data->flags & SECT_4K ? 0x1 | CMD_ERASE_4K << 8 : 0x3;
+	if (data->flags & RD_DUAL)
+		bfpt[0] |= BIT(16);
+	if (use_4b)
+		bfpt[0] |= 1 << 17;
+	if (data->flags & RD_DUALIO)
+		bfpt[0] |= BIT(20);
+	if (data->flags & RD_QUADIO)
+		bfpt[0] |= BIT(21);
+	if (data->flags & RD_QUAD)
+		bfpt[0] |= BIT(22);
+	if (size <= SZ_256M)
+		bfpt[1] = size * 8 - 1;
+	else
+		bfpt[1] = BIT(31) | (ilog2(size) + 3);
+	/* 1-4-4: 2 mode + 4 dummy clocks, 1-1-4: 8 dummy clocks */
+	bfpt[2] = CMD_READ_QUAD_OUTPUT_FAST << 24 | 8 << 16 |
+		  CMD_READ_QUAD_IO_FAST << 8 | 2 << 5 | 4;
+	/* 1-2-2: 4 mode clocks, 1-1-2: 8 dummy clocks */
+	bfpt[3] = CMD_READ_DUAL_IO_FAST << 24 | 4 << 21 |
+		  CMD_READ_DUAL_OUTPUT_FAST << 8 | 8;
+	/* Erase types: 4KiB and 32KiB when supported, then the sector erase */
+	if (data->flags & SECT_4K) {
+		bfpt[7] = CMD_ERASE_32K << 24 | 15 << 16 |
+			  CMD_ERASE_4K << 8 | 12;
+		bfpt[8] = CMD_ERASE_64K << 8 | ilog2(data->sector_size);
+	} else {
+		bfpt[7] = CMD_ERASE_64K << 8 | ilog2(data->sector_size);
+	}
+	/* 256-byte pages taking 11 * 64us to program, no quad enable bit */
+	bfpt[10] = BIT(13) | 10 << 8 | 8 << 4;
+
+	for (i = 0; i < SF_SFDP_BFPT_LEN; i++)
+		sbsf->sfdp[SF_SFDP_BFPT / 4 + i] = bfpt[i];
+
+	/* 4-byte address instruction table */
+	if (use_4b) {
+		bait[0] = BIT(0) | BIT(1) | BIT(6);
+		if (data->flags & RD_DUAL)
+			bait[0] |= BIT(2);
+		if (data->flags & RD_DUALIO)
+			bait[0] |= BIT(3);
+		if (data->flags & RD_QUAD)
+			bait[0] |= BIT(4);
+		if (data->flags & RD_QUADIO)
+			bait[0] |= BIT(5);
+		if (data->flags & WR_QPP)
+			bait[0] |= BIT(7);
+		if (data->flags & SECT_4K) {
+			bait[0] |= BIT(9) | BIT(10) | BIT(11);
+			bait[1] = CMD_ERASE_64K_4B << 16 |
+				  CMD_ERASE_32K_4B << 8 | CMD_ERASE_4K_4B;
+		} else {
+			bait[0] |= BIT(9);
+			bait[1] = CMD_ERASE_64K_4B;
+		}
+		sbsf->sfdp[SF_SFDP_4BAIT / 4] = bait[0];
+		sbsf->sfdp[SF_SFDP_4BAIT / 4 + 1] = bait[1];
+	}
+
+	for (i = 0; i < ARRAY_SIZE(sbsf->sfdp); i++)
+		sbsf->sfdp[i] = cpu_to_le32(sbsf->sfdp[i]);
+}
+
 /**
  * This is a very strange probe function. If it has platform data (which may
  * have come from the device tree) then this function gets the filename and
@@ -111,7 +250,7 @@ static int sandbox_sf_probe(struct udevice *dev)
 	/* spec = idcode:file */
 	struct sandbox_spi_flash *sbsf = dev_get_priv(dev);
 	const char *file;
-	size_t len, idname_len;
+	size_t idname_len;
 	const struct spi_flash_info *data;
 	struct sandbox_spi_flash_plat_data *pdata = dev_get_platdata(dev);
 	struct sandbox_state *state = state_get_current();
@@ -159,6 +298,21 @@ static int sandbox_sf_probe(struct udevice *dev)
 		pdata->device_name = spec;
 		++file;
 	} else {
+		u32 reg[2];
+		int count;
+
+		/* A dual flash node has a file for each chip select */
+		count = fdtdec_get_int_array_count(gd->fdt_blob, dev->of_offset,
+						   "reg", reg, ARRAY_SIZE(reg));
+		for (i = 1; i < count; i++) {
+			if (reg[i] != cs)
+				continue;
+			file = fdt_stringlist_get(gd->fdt_blob, dev->of_offset,
+						  "sandbox,filename", i, NULL);
+			if (file)
+				pdata->filename = file;
+		}
+
 		spec = strchr(pdata->device_name, ',');
 		if (spec)
 			spec++;
@@ -168,14 +322,10 @@ static int sandbox_sf_probe(struct udevice *dev)
 	}
 	debug("%s: device='%s'\n", __func__, spec);
 
-	for (data = spi_flash_ids; data->name; data++) {
-		len = strlen(data->name);
-		if (idname_len != len)
-			continue;
-		if (!strncasecmp(spec, data->name, len))
-			break;
-	}
-	if (!data->name) {
+	data = sandbox_sf_find(spi_flash_ids, spec, idname_len);
+	if (!data)
+		data = sandbox_sf_find(sandbox_sf_flash_ids, spec, idname_len);
+	if (!data) {
 		printf("%s: unknown flash '%*s'\n", __func__, (int)idname_len,
 		       spec);
 		ret = -EINVAL;
@@ -195,6 +345,7 @@ static int sandbox_sf_probe(struct udevice *dev)
 
 	sbsf->data = data;
 	sbsf->cs = cs;
+	sandbox_sf_build_sfdp(sbsf);
 
 	return 0;
 
@@ -212,16 +363,46 @@ static int sandbox_sf_remove(struct udevice *dev)
 	return 0;
 }
 
+void sandbox_sf_set_erase_time(struct udevice *dev, uint erase_us)
+{
+	struct sandbox_spi_flash *sbsf = dev_get_priv(dev);
+
+	sbsf->erase_us = erase_us;
+}
+
+void sandbox_sf_set_prog_time(struct udevice *dev, uint prog_us)
+{
+	struct sandbox_spi_flash *sbsf = dev_get_priv(dev);
+
+	sbsf->prog_us = prog_us;
+}
+
+/* Keep the flash busy for as long as erasing size bytes takes */
+static void sandbox_sf_erase_busy(struct sandbox_spi_flash *sbsf, uint size)
+{
+	if (!sbsf->erase_us)
+		return;
+	sbsf->busy_end = timer_get_us() +
+			  (ulong)DIV_ROUND_UP(size, SZ_4K) * sbsf->erase_us;
+	sbsf->status |= STAT_WIP;
+}
+
 static void sandbox_sf_cs_activate(struct udevice *dev)
 {
 	struct sandbox_spi_flash *sbsf = dev_get_priv(dev);
 
 	debug("sandbox_sf: CS activated; state is fresh!\n");
 
+	/* See whether the erase in progress has finished */
+	if ((sbsf->status & STAT_WIP) &&
+	    (long)(timer_get_us() - sbsf->busy_end) >= 0)
+		sbsf->status &= ~STAT_WIP;
+
 	/* CS is asserted, so reset state */
 	sbsf->off = 0;
 	sbsf->addr_bytes = 0;
 	sbsf->pad_addr_bytes = 0;
+	sbsf->addr_len = SF_ADDR_LEN;
 	sbsf->state = SF_CMD;
 	sbsf->cmd = SF_CMD;
 }
@@ -244,6 +425,45 @@ static void sandbox_spi_tristate(u8 *buf, uint len)
 	memset(buf, 0xff, len);
 }
 
+int sandbox_erase_part(struct sandbox_spi_flash *sbsf, int size)
+{
+	int todo;
+	int ret;
+
+	while (size > 0) {
+		todo = min(size, (int)sizeof(sandbox_sf_0xff));
+		ret = os_write(sbsf->fd, sandbox_sf_0xff, todo);
+		if (ret != todo)
+			return ret;
+		size -= todo;
+	}
+
+	return 0;
+}
+
+static int sandbox_sf_erase_chip(struct sandbox_spi_flash *sbsf)
+{
+	int ret;
+
+	if (!(sbsf->status & STAT_WEL)) {
+		puts("sandbox_sf: write enable not set before erase\n");
+		return 0;
+	}
+
+	debug(" chip erase, size: %u\n", sbsf->erase_size);
+	if (os_lseek(sbsf->fd, 0, OS_SEEK_SET) < 0) {
+		puts("sandbox_sf: os_lseek() failed");
+		return -EIO;
+	}
+	ret = sandbox_erase_part(sbsf, sbsf->erase_size);
+	sbsf->status &= ~STAT_WEL;
+	if (ret)
+		debug("sandbox_sf: Erase failed\n");
+	sandbox_sf_erase_busy(sbsf, sbsf->erase_size);
+
+	return 0;
+}
+
 /* Figure out what command this stream is telling us to do */
 static int sandbox_sf_process_cmd(struct sandbox_spi_flash *sbsf, const u8 *rx,
 				  u8 *tx)
@@ -255,13 +475,40 @@ static int sandbox_sf_process_cmd(struct sandbox_spi_flash *sbsf, const u8 *rx,
 		sandbox_spi_tristate(tx, 1);
 
 	sbsf->cmd = rx[0];
+
+	/* While erasing, the flash only takes status reads and suspend */
+	if ((sbsf->status & STAT_WIP) && sbsf->cmd != CMD_READ_STATUS &&
+	    sbsf->cmd != CMD_READ_STATUS1 && sbsf->cmd != CMD_ERASE_SUSPEND) {
+		debug(" busy, ignoring cmd %#x\n", sbsf->cmd);
+		sbsf->state = SF_BUSY;
+		return 0;
+	}
+
 	switch (sbsf->cmd) {
 	case CMD_READ_ID:
 		sbsf->state = SF_ID;
 		sbsf->cmd = SF_ID;
 		break;
+	case CMD_READ_QUAD_IO_FAST_4B:
+		sbsf->pad_addr_bytes = 2;
+	case CMD_READ_ARRAY_FAST_4B:
+	case CMD_READ_DUAL_OUTPUT_FAST_4B:
+	case CMD_READ_DUAL_IO_FAST_4B:
+	case CMD_READ_QUAD_OUTPUT_FAST_4B:
+		sbsf->pad_addr_bytes++;
+	case CMD_READ_ARRAY_SLOW_4B:
+	case CMD_PAGE_PROGRAM_4B:
+		sbsf->addr_len = SF_ADDR_LEN_4B;
+		sbsf->state = SF_ADDR;
+		break;
+	case CMD_READ_QUAD_IO_FAST:
+		sbsf->pad_addr_bytes = 2;
 	case CMD_READ_ARRAY_FAST:
-		sbsf->pad_addr_bytes = 1;
+	case CMD_READ_DUAL_OUTPUT_FAST:
+	case CMD_READ_DUAL_IO_FAST:
+	case CMD_READ_QUAD_OUTPUT_FAST:
+	case CMD_READ_SFDP:
+		sbsf->pad_addr_bytes++;
 	case CMD_READ_ARRAY_SLOW:
 	case CMD_PAGE_PROGRAM:
 		sbsf->state = SF_ADDR;
@@ -283,17 +530,53 @@ static int sandbox_sf_process_cmd(struct sandbox_spi_flash *sbsf, const u8 *rx,
 	case CMD_WRITE_STATUS:
 		sbsf->state = SF_WRITE_STATUS;
 		break;
+	case CMD_ERASE_SUSPEND:
+		if (!(sbsf->status & STAT_WIP) ||
+		    !(sbsf->data->flags & ERASE_SUSP))
+			break;
+		debug(" erase suspended\n");
+		sbsf->erase_left = sbsf->busy_end - timer_get_us();
+		sbsf->status = (sbsf->status & ~STAT_WIP) | STAT_SUS;
+		break;
+	case CMD_ERASE_RESUME:
+		if (!(sbsf->status & STAT_SUS))
+			break;
+		debug(" erase resumed\n");
+		sbsf->busy_end = timer_get_us() + sbsf->erase_left;
+		sbsf->status = (sbsf->status & ~STAT_SUS) | STAT_WIP;
+		break;
 	default: {
 		int flags = sbsf->data->flags;
 
+		/* Another erase has to wait for the suspended one */
+		if (sbsf->status & STAT_SUS) {
+			debug(" erase suspended, ignoring cmd %#x\n",
+			      sbsf->cmd);
+			sbsf->state = SF_BUSY;
+			return 0;
+		}
+
 		/* we only support erase here */
+		if (sbsf->cmd == CMD_ERASE_4K_4B ||
+		    sbsf->cmd == CMD_ERASE_32K_4B ||
+		    sbsf->cmd == CMD_ERASE_64K_4B)
+			sbsf->addr_len = SF_ADDR_LEN_4B;
+
 		if (sbsf->cmd == CMD_ERASE_CHIP) {
+			/* No address follows, so erase straight away */
 			sbsf->erase_size = sbsf->data->sector_size *
 				sbsf->data->n_sectors;
-		} else if (sbsf->cmd == CMD_ERASE_4K && (flags & SECT_4K)) {
+			return sandbox_sf_erase_chip(sbsf);
+		} else if ((sbsf->cmd == CMD_ERASE_4K ||
+			    sbsf->cmd == CMD_ERASE_4K_4B) && (flags & SECT_4K)) {
 			sbsf->erase_size = 4 << 10;
-		} else if (sbsf->cmd == CMD_ERASE_64K && !(flags & SECT_4K)) {
-			sbsf->erase_size = 64 << 10;
+		} else if ((sbsf->cmd == CMD_ERASE_32K ||
+			    sbsf->cmd == CMD_ERASE_32K_4B) &&
+			   (flags & SECT_4K)) {
+			sbsf->erase_size = 32 << 10;
+		} else if (sbsf->cmd == CMD_ERASE_64K ||
+			   sbsf->cmd == CMD_ERASE_64K_4B) {
+			sbsf->erase_size = sbsf->data->sector_size;
 		} else {
 			debug(" cmd unknown: %#x\n", sbsf->cmd);
 			return -EIO;
@@ -310,20 +593,31 @@ static int sandbox_sf_process_cmd(struct sandbox_spi_flash *sbsf, const u8 *rx,
 	return 0;
 }
 
-int sandbox_erase_part(struct sandbox_spi_flash *sbsf, int size)
+/* Program data at the current offset; like NOR, this can only clear bits */
+static int sandbox_sf_program(struct sandbox_spi_flash *sbsf,
+			      const uint8_t *data, uint cnt)
 {
-	int todo;
+	uint8_t old[256];
+	uint todo, done, i;
 	int ret;
 
-	while (size > 0) {
-		todo = min(size, (int)sizeof(sandbox_sf_0xff));
-		ret = os_write(sbsf->fd, sandbox_sf_0xff, todo);
-		if (ret != todo)
+	for (done = 0; done < cnt; done += todo) {
+		todo = min(cnt - done, (uint)sizeof(old));
+		ret = os_read(sbsf->fd, old, todo);
+		if (ret < 0)
 			return ret;
-		size -= todo;
+		/* Past the end of the file is erased */
+		memset(old + ret, 0xff, todo - ret);
+		if (os_lseek(sbsf->fd, -ret, OS_SEEK_CUR) < 0)
+			return -EIO;
+		for (i = 0; i < todo; i++)
+			old[i] &= data[done + i];
+		ret = os_write(sbsf->fd, old, todo);
+		if (ret != todo)
+			return -EIO;
 	}
 
-	return 0;
+	return done;
 }
 
 static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
@@ -357,14 +651,10 @@ static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
 			u8 id;
 
 			debug(" id: off:%u tx:", sbsf->off);
-			if (sbsf->off < IDCODE_LEN) {
-				/* Extract correct byte from ID 0x00aabbcc */
-				id = ((JEDEC_MFR(sbsf->data) << 16) |
-					JEDEC_ID(sbsf->data)) >>
-					(8 * (IDCODE_LEN - 1 - sbsf->off));
-			} else {
+			if (sbsf->off < sbsf->data->id_len)
+				id = sbsf->data->id[sbsf->off];
+			else
 				id = 0;
-			}
 			debug("%d %02x\n", sbsf->off, id);
 			tx[pos++] = id;
 			++sbsf->off;
@@ -374,7 +664,7 @@ static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
 			debug(" addr: bytes:%u rx:%02x ", sbsf->addr_bytes,
 			      rx[pos]);
 
-			if (sbsf->addr_bytes++ < SF_ADDR_LEN)
+			if (sbsf->addr_bytes++ < sbsf->addr_len)
 				sbsf->off = (sbsf->off << 8) | rx[pos];
 			debug("addr:%06x\n", sbsf->off);
 
@@ -384,7 +674,7 @@ static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
 
 			/* See if we're done processing */
 			if (sbsf->addr_bytes <
-					SF_ADDR_LEN + sbsf->pad_addr_bytes)
+					sbsf->addr_len + sbsf->pad_addr_bytes)
 				break;
 
 			/* Next state! */
@@ -395,9 +685,23 @@ static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
 			switch (sbsf->cmd) {
 			case CMD_READ_ARRAY_FAST:
 			case CMD_READ_ARRAY_SLOW:
+			case CMD_READ_DUAL_OUTPUT_FAST:
+			case CMD_READ_DUAL_IO_FAST:
+			case CMD_READ_QUAD_OUTPUT_FAST:
+			case CMD_READ_QUAD_IO_FAST:
+			case CMD_READ_ARRAY_FAST_4B:
+			case CMD_READ_ARRAY_SLOW_4B:
+			case CMD_READ_DUAL_OUTPUT_FAST_4B:
+			case CMD_READ_DUAL_IO_FAST_4B:
+			case CMD_READ_QUAD_OUTPUT_FAST_4B:
+			case CMD_READ_QUAD_IO_FAST_4B:
 				sbsf->state = SF_READ;
 				break;
+			case CMD_READ_SFDP:
+				sbsf->state = SF_READ_SFDP;
+				break;
 			case CMD_PAGE_PROGRAM:
+			case CMD_PAGE_PROGRAM_4B:
 				sbsf->state = SF_WRITE;
 				break;
 			default:
@@ -424,6 +728,15 @@ static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
 			}
 			pos += ret;
 			break;
+		case SF_READ_SFDP: {
+			const u8 *sfdp = (const u8 *)sbsf->sfdp;
+
+			debug(" sfdp: off:%#x\n", sbsf->off);
+			for (; pos < bytes; pos++, sbsf->off++)
+				tx[pos] = sbsf->off < SF_SFDP_LEN ?
+					  sfdp[sbsf->off] : 0xff;
+			break;
+		}
 		case SF_READ_STATUS:
 			debug(" read status: %#x\n", sbsf->status);
 			cnt = bytes - pos;
@@ -440,6 +753,12 @@ static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
 			debug(" write status: %#x (ignored)\n", rx[pos]);
 			pos = bytes;
 			break;
+		case SF_BUSY:
+			cnt = bytes - pos;
+			if (tx)
+				sandbox_spi_tristate(&tx[pos], cnt);
+			pos += cnt;
+			break;
 		case SF_WRITE:
 			/*
 			 * XXX: need to handle exotic behavior:
@@ -456,13 +775,18 @@ static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
 			debug(" rx: write(%u)\n", cnt);
 			if (tx)
 				sandbox_spi_tristate(&tx[pos], cnt);
-			ret = os_write(sbsf->fd, rx + pos, cnt);
+			ret = sandbox_sf_program(sbsf, rx + pos, cnt);
 			if (ret < 0) {
 				puts("sandbox_spi: os_write() failed\n");
 				return -EIO;
 			}
 			pos += ret;
 			sbsf->status &= ~STAT_WEL;
+			if (sbsf->prog_us) {
+				sbsf->busy_end = timer_get_us() +
+						 sbsf->prog_us;
+				sbsf->status |= STAT_WIP;
+			}
 			break;
 		case SF_ERASE:
  case_sf_erase: {
@@ -489,8 +813,8 @@ static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
 			pos += cnt;
 
 			/*
-			 * TODO(vapier@gentoo.org): latch WIP in status, and
-			 * delay before clearing it ?
+			 * The data is erased at once, but the flash then stays
+			 * busy for as long as the erase would take
 			 */
 			ret = sandbox_erase_part(sbsf, sbsf->erase_size);
 			sbsf->status &= ~STAT_WEL;
@@ -498,6 +822,7 @@ static int sandbox_sf_xfer(struct udevice *dev, unsigned int bitlen,
 				debug("sandbox_sf: Erase failed\n");
 				goto done;
 			}
+			sandbox_sf_erase_busy(sbsf, sbsf->erase_size);
 			goto done;
 		}
 		default:
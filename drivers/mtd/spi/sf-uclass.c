@@ -6,6 +6,7 @@
 
 #include <common.h>
 #include <dm.h>
+#include <errno.h>
 #include <spi.h>
 #include <spi_flash.h>
 #include <dm/device-internal.h>
@@ -15,20 +16,68 @@ DECLARE_GLOBAL_DATA_PTR;
 
 int spi_flash_read_dm(struct udevice *dev, u32 offset, size_t len, void *buf)
 {
+	if (spi_flash_cache_read(dev, offset, len, buf))
+		return 0;
+
 	return sf_get_ops(dev)->read(dev, offset, len, buf);
 }
 
 int spi_flash_write_dm(struct udevice *dev, u32 offset, size_t len,
 		       const void *buf)
 {
+	spi_flash_cache_invalidate(dev, offset, len);
+
 	return sf_get_ops(dev)->write(dev, offset, len, buf);
 }
 
 int spi_flash_erase_dm(struct udevice *dev, u32 offset, size_t len)
 {
+	spi_flash_cache_invalidate(dev, offset, len);
+
 	return sf_get_ops(dev)->erase(dev, offset, len);
 }
 
+int spi_flash_erase_start_dm(struct udevice *dev, u32 offset, size_t len)
+{
+	struct dm_spi_flash_ops *ops = sf_get_ops(dev);
+
+	if (!ops->erase_start)
+		return -ENOSYS;
+	spi_flash_cache_invalidate(dev, offset, len);
+
+	return ops->erase_start(dev, offset, len);
+}
+
+int spi_flash_erase_poll_dm(struct udevice *dev)
+{
+	struct dm_spi_flash_ops *ops = sf_get_ops(dev);
+
+	if (!ops->erase_poll)
+		return -ENOSYS;
+
+	return ops->erase_poll(dev);
+}
+
+int spi_flash_erase_suspend_dm(struct udevice *dev)
+{
+	struct dm_spi_flash_ops *ops = sf_get_ops(dev);
+
+	if (!ops->erase_suspend)
+		return -ENOSYS;
+
+	return ops->erase_suspend(dev);
+}
+
+int spi_flash_erase_resume_dm(struct udevice *dev)
+{
+	struct dm_spi_flash_ops *ops = sf_get_ops(dev);
+
+	if (!ops->erase_resume)
+		return -ENOSYS;
+
+	return ops->erase_resume(dev);
+}
+
 /*
  * TODO(sjg@chromium.org): This is an old-style function. We should remove
  * it when all SPI flash drivers use dm
@@ -54,10 +103,24 @@ int spi_flash_probe_bus_cs(unsigned int busnum, unsigned int cs,
 			   struct udevice **devp)
 {
 	struct spi_slave *slave;
-	struct udevice *bus;
+	struct spi_flash *flash;
+	struct udevice *bus, *dev;
 	char *str;
 	int ret;
 
+	/* Keep a flash which is already probed unless the setup changes */
+	if (max_hz && !spi_find_bus_and_cs(busnum, cs, &bus, &dev) &&
+	    device_active(dev) &&
+	    device_get_uclass_id(dev) == UCLASS_SPI_FLASH) {
+		flash = dev_get_uclass_priv(dev);
+		if (flash->probe_hz != max_hz ||
+		    flash->probe_mode != spi_mode) {
+			debug("SF: probing %s again for %u Hz, mode %x\n",
+			      dev->name, max_hz, spi_mode);
+			device_remove(dev);
+		}
+	}
+
 #if defined(CONFIG_SPL_BUILD) && defined(CONFIG_USE_TINY_PRINTF)
 	str = "spi_flash";
 #else
@@ -71,10 +134,24 @@ int spi_flash_probe_bus_cs(unsigned int busnum, unsigned int cs,
 	if (ret)
 		return ret;
 
+	flash = dev_get_uclass_priv(slave->dev);
+	if (max_hz) {
+		flash->probe_hz = max_hz;
+		flash->probe_mode = spi_mode;
+	}
 	*devp = slave->dev;
 	return 0;
 }
 
+static int spi_flash_pre_remove(struct udevice *dev)
+{
+	struct spi_flash *flash = dev_get_uclass_priv(dev);
+
+	spi_flash_cache_invalidate(dev, 0, flash->size);
+
+	return 0;
+}
+
 static int spi_flash_post_bind(struct udevice *dev)
 {
 #if defined(CONFIG_NEEDS_MANUAL_RELOC)
@@ -88,6 +165,14 @@ static int spi_flash_post_bind(struct udevice *dev)
 			ops->write += gd->reloc_off;
 		if (ops->erase)
 			ops->erase += gd->reloc_off;
+		if (ops->erase_start)
+			ops->erase_start += gd->reloc_off;
+		if (ops->erase_poll)
+			ops->erase_poll += gd->reloc_off;
+		if (ops->erase_suspend)
+			ops->erase_suspend += gd->reloc_off;
+		if (ops->erase_resume)
+			ops->erase_resume += gd->reloc_off;
 
 		reloc_done++;
 	}
@@ -99,5 +184,6 @@ UCLASS_DRIVER(spi_flash) = {
 	.id		= UCLASS_SPI_FLASH,
 	.name		= "spi_flash",
 	.post_bind	= spi_flash_post_bind,
+	.pre_remove	= spi_flash_pre_remove,
 	.per_device_auto_alloc_size = sizeof(struct spi_flash),
 };
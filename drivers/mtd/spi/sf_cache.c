@@ -0,0 +1,195 @@
+/*
+ * SPI flash read cache, with read-ahead of sequential reads
+ *
+ * Small reads are served from whole lines of the flash, kept in least
+ * recently used order. A miss on the line following the last miss reads
+ * the next line too, in the same transaction. Writes and erases drop the
+ * lines they touch.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <dm.h>
+#include <errno.h>
+#include <malloc.h>
+#include <spi_flash.h>
+#include <linux/list.h>
+
+#define LINE_SIZE	CONFIG_SPI_FLASH_CACHE_LINE
+#define MAX_LINES	(CONFIG_SPI_FLASH_CACHE_SIZE / LINE_SIZE)
+
+#if CONFIG_SPI_FLASH_CACHE_SIZE < CONFIG_SPI_FLASH_CACHE_LINE
+#error "CONFIG_SPI_FLASH_CACHE_SIZE must hold at least one cache line"
+#endif
+
+struct spi_flash_cache_line {
+	struct list_head lh;
+	struct udevice *dev;
+	u32 offset;
+	u8 *data;
+};
+
+static LIST_HEAD(spi_flash_cache);
+
+static struct spi_flash_cache_stats _stats = {
+	.max_lines = MAX_LINES,
+};
+
+/* Where the last miss was, to spot sequential reads */
+static struct udevice *last_miss_dev;
+static u32 last_miss;
+
+/* Buffer the lines of a miss are read into, one line and one ahead */
+static u8 *fill_buf;
+
+static struct spi_flash_cache_line *cache_find(struct udevice *dev,
+					       u32 offset)
+{
+	struct spi_flash_cache_line *line;
+
+	list_for_each_entry(line, &spi_flash_cache, lh) {
+		if (line->dev == dev && line->offset == offset) {
+			if (spi_flash_cache.next != &line->lh) {
+				/* maintain MRU ordering */
+				list_del(&line->lh);
+				list_add(&line->lh, &spi_flash_cache);
+			}
+			return line;
+		}
+	}
+
+	return NULL;
+}
+
+/* Take a free line, or the least recently used one */
+static struct spi_flash_cache_line *cache_alloc(void)
+{
+	struct spi_flash_cache_line *line;
+
+	if (_stats.lines >= _stats.max_lines) {
+		line = list_entry(spi_flash_cache.prev,
+				  struct spi_flash_cache_line, lh);
+		list_del(&line->lh);
+		debug("SF: cache drops %s at %#x\n", line->dev->name,
+		      line->offset);
+		return line;
+	}
+
+	line = malloc(sizeof(*line));
+	if (!line)
+		return NULL;
+	line->data = malloc(LINE_SIZE);
+	if (!line->data) {
+		free(line);
+		return NULL;
+	}
+	_stats.lines++;
+
+	return line;
+}
+
+/* Read the line at offset, and the one after it for a sequential read */
+static struct spi_flash_cache_line *cache_fill(struct udevice *dev,
+					       u32 offset)
+{
+	struct spi_flash *flash = dev_get_uclass_priv(dev);
+	struct spi_flash_cache_line *line = NULL;
+	u32 count = 1, i;
+	int ret;
+
+	if (!fill_buf) {
+		fill_buf = memalign(ARCH_DMA_MINALIGN, LINE_SIZE * 2);
+		if (!fill_buf)
+			return NULL;
+	}
+
+	if (last_miss_dev == dev && last_miss + LINE_SIZE == offset &&
+	    offset + LINE_SIZE * 2 <= flash->size &&
+	    !cache_find(dev, offset + LINE_SIZE))
+		count = 2;
+	last_miss_dev = dev;
+	last_miss = offset + (count - 1) * LINE_SIZE;
+
+	ret = sf_get_ops(dev)->read(dev, offset, LINE_SIZE * count, fill_buf);
+	if (ret) {
+		debug("SF: cache fill at %#x failed (err=%d)\n", offset, ret);
+		return NULL;
+	}
+
+	/* The line asked for goes in last, to be the most recently used */
+	for (i = count; i-- > 0;) {
+		line = cache_alloc();
+		if (!line)
+			return NULL;
+		line->dev = dev;
+		line->offset = offset + i * LINE_SIZE;
+		memcpy(line->data, fill_buf + i * LINE_SIZE, LINE_SIZE);
+		list_add(&line->lh, &spi_flash_cache);
+		if (i)
+			_stats.readahead++;
+	}
+
+	return line;
+}
+
+int spi_flash_cache_read(struct udevice *dev, u32 offset, size_t len,
+			 void *buf)
+{
+	struct spi_flash *flash = dev_get_uclass_priv(dev);
+	struct spi_flash_cache_line *line;
+	u32 base, todo;
+
+	/* Big reads are better done in one go */
+	if (!len || len > LINE_SIZE || offset + len > flash->size)
+		return 0;
+
+	for (; len; len -= todo, offset += todo, buf += todo) {
+		base = offset - offset % LINE_SIZE;
+		todo = min_t(size_t, len, base + LINE_SIZE - offset);
+		line = cache_find(dev, base);
+		if (line) {
+			_stats.hits++;
+		} else {
+			/* Whatever is read now may be erased under us */
+			if (flash->async_erase.len)
+				return 0;
+			_stats.misses++;
+			line = cache_fill(dev, base);
+			if (!line)
+				return 0;
+		}
+		memcpy(buf, line->data + offset - base, todo);
+	}
+
+	return 1;
+}
+
+void spi_flash_cache_invalidate(struct udevice *dev, u32 offset, size_t len)
+{
+	struct spi_flash_cache_line *line, *n;
+
+	list_for_each_entry_safe(line, n, &spi_flash_cache, lh) {
+		if (line->dev != dev)
+			continue;
+		if (line->offset >= offset ? line->offset - offset < len :
+		    offset - line->offset < LINE_SIZE) {
+			list_del(&line->lh);
+			free(line->data);
+			free(line);
+			_stats.lines--;
+		}
+	}
+	if (last_miss_dev == dev)
+		last_miss_dev = NULL;
+}
+
+void spi_flash_cache_stats(struct spi_flash_cache_stats *stats, bool reset)
+{
+	memcpy(stats, &_stats, sizeof(*stats));
+	if (reset) {
+		_stats.hits = 0;
+		_stats.misses = 0;
+		_stats.readahead = 0;
+	}
+}
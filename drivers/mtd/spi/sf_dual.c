@@ -0,0 +1,392 @@
+/*
+ * Dual SPI flash, with the two chips combined in software
+ *
+ * A flash node with two chip selects in its "reg" property and either
+ * "stacked-memories" or "u-boot,interleaved-memories" is presented as one
+ * flash:
+ *
+ * - stacked: the second chip follows the first
+ * - interleaved: pages alternate between the chips
+ *
+ * Both chips share one bus, so every page still costs a command of its
+ * own and reads are no faster. Programs and erases are started on both
+ * chips before waiting for either, so the chips program and erase at the
+ * same time.
+ *
+ * This is not the "parallel-memories" of Linux, where the two chips sit on
+ * the two halves of a dual bus and each byte is split between them. That
+ * needs a controller which drives both halves at once.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <dm.h>
+#include <errno.h>
+#include <fdtdec.h>
+#include <malloc.h>
+#include <spi.h>
+#include <spi-mem.h>
+#include <spi_flash.h>
+#include <dm/device-internal.h>
+#include <dm/lists.h>
+
+#include "sf_internal.h"
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/*
+ * Find the chip holding a logical offset, the offset within that chip and
+ * how many bytes from there stay on the same chip
+ */
+static struct spi_flash *spi_flash_dual_map(struct spi_flash *flash,
+					    u32 offset, u32 *chip_offp,
+					    size_t *maxp)
+{
+	struct spi_flash *chips = flash->dual_chips;
+	u32 page_size = chips[0].page_size;
+	int chip;
+
+	if (flash->dual_flash == SF_DUAL_STACKED_FLASH) {
+		chip = offset >= chips[0].size;
+		*chip_offp = offset - chip * chips[0].size;
+		*maxp = chips[chip].size - *chip_offp;
+	} else {
+		chip = (offset / page_size) & 1;
+		*chip_offp = offset / (page_size * 2) * page_size +
+			     offset % page_size;
+		*maxp = page_size - offset % page_size;
+	}
+
+	return &chips[chip];
+}
+
+/* Work out which part of a chip a logical range touches */
+static void spi_flash_dual_span(struct spi_flash *flash, int chip,
+				u32 offset, size_t len, u32 *chip_offp,
+				size_t *chip_lenp)
+{
+	struct spi_flash *chips = flash->dual_chips;
+	u32 page_size = chips[0].page_size;
+	u32 first, last, end = offset + len;
+	size_t room;
+
+	*chip_lenp = 0;
+	if (flash->dual_flash == SF_DUAL_STACKED_FLASH) {
+		first = max(offset, chip * chips[0].size);
+		last = min(end, chip * chips[0].size + chips[chip].size);
+		if (first >= last)
+			return;
+		*chip_offp = first - chip * chips[0].size;
+		*chip_lenp = last - first;
+		return;
+	}
+
+	/* First and last logical bytes of the range on this chip */
+	first = offset;
+	if (((first / page_size) & 1) != chip)
+		first = roundup(first + 1, page_size);
+	last = end - 1;
+	if (((last / page_size) & 1) != chip)
+		last = rounddown(last, page_size) - 1;
+	if (!len || first >= end || last < offset || first > last)
+		return;
+
+	spi_flash_dual_map(flash, first, chip_offp, &room);
+	spi_flash_dual_map(flash, last, &end, &room);
+	*chip_lenp = end + 1 - *chip_offp;
+}
+
+static int spi_flash_dual_check_locked(struct spi_flash *flash, u32 offset,
+				       size_t len)
+{
+	struct spi_flash *chip;
+	size_t chip_len;
+	u32 chip_off;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		chip = &flash->dual_chips[i];
+		spi_flash_dual_span(flash, i, offset, len, &chip_off,
+				    &chip_len);
+		if (chip_len && chip->flash_is_locked &&
+		    chip->flash_is_locked(chip, chip_off, chip_len) > 0) {
+			printf("offset 0x%x is protected\n", offset);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+int spi_flash_dual_read(struct spi_flash *flash, u32 offset, size_t len,
+			void *buf)
+{
+	struct spi_flash *chip;
+	size_t chunk;
+	u32 chip_off;
+	int ret;
+
+	while (len) {
+		chip = spi_flash_dual_map(flash, offset, &chip_off, &chunk);
+		chunk = min(chunk, len);
+		ret = spi_flash_cmd_read_ops(chip, chip_off, chunk, buf);
+		if (ret)
+			return ret;
+		offset += chunk;
+		buf += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+int spi_flash_dual_write(struct spi_flash *flash, u32 offset, size_t len,
+			 const void *buf)
+{
+	struct spi_flash_write_stats *stats = &flash->write_stats;
+	ulong start = timer_get_us();
+	bool busy[2] = { false, false };
+	struct spi_flash *chip;
+	size_t chunk;
+	u32 chip_off;
+	int i, ret;
+
+	memset(stats, '\0', sizeof(*stats));
+	ret = spi_flash_dual_check_locked(flash, offset, len);
+	if (ret)
+		return ret;
+	for (i = 0; i < 2; i++)
+		spi_mem_dirmap_invalidate(flash->dual_chips[i].dirmap);
+
+	/* Program one chip while the other is still busy */
+	while (len) {
+		chip = spi_flash_dual_map(flash, offset, &chip_off, &chunk);
+		i = chip - flash->dual_chips;
+		if (busy[i]) {
+			ret = spi_flash_wait_ready(chip,
+						   SPI_FLASH_PROG_TIMEOUT);
+			if (ret)
+				goto out;
+		}
+		ret = spi_flash_program_start(chip, chip_off, min(chunk, len),
+					      buf);
+		if (ret < 0)
+			goto out;
+		busy[i] = true;
+		stats->pages++;
+		offset += ret;
+		buf += ret;
+		len -= ret;
+	}
+	ret = 0;
+
+out:
+	for (i = 0; i < 2; i++) {
+		if (busy[i]) {
+			int err = spi_flash_wait_ready(&flash->dual_chips[i],
+						       SPI_FLASH_PROG_TIMEOUT);
+
+			if (!ret)
+				ret = err;
+		}
+	}
+	stats->time_us = timer_get_us() - start;
+
+	return ret;
+}
+
+int spi_flash_dual_erase(struct spi_flash *flash, u32 offset, size_t len)
+{
+	struct spi_flash *chips = flash->dual_chips;
+	unsigned long timeout[2];
+	size_t chip_len[2];
+	u32 chip_off[2];
+	bool busy[2] = { false, false };
+	int i, j, ret = 0, err;
+
+	if (!len || offset % flash->erase_types[0].size ||
+	    len % flash->erase_types[0].size) {
+		debug("SF: Erase offset/length not multiple of erase size\n");
+		return -EINVAL;
+	}
+	ret = spi_flash_dual_check_locked(flash, offset, len);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < 2; i++) {
+		spi_flash_dual_span(flash, i, offset, len, &chip_off[i],
+				    &chip_len[i]);
+		for (j = 0; j < SPI_FLASH_MAX_ERASE_TYPES; j++)
+			chips[i].erase_types[j].count = 0;
+		chips[i].erase_chip_count = 0;
+		spi_mem_dirmap_invalidate(chips[i].dirmap);
+	}
+
+	/* Keep an erase running on each chip until its part is done */
+	while (!ret && (chip_len[0] || chip_len[1])) {
+		for (i = 0; i < 2; i++) {
+			if (!chip_len[i])
+				continue;
+			ret = spi_flash_erase_start(&chips[i], chip_off[i],
+						    chip_len[i], &timeout[i]);
+			if (ret < 0)
+				break;
+			busy[i] = true;
+			chip_off[i] += ret;
+			chip_len[i] -= ret;
+			ret = 0;
+		}
+		for (i = 0; i < 2; i++) {
+			if (!busy[i])
+				continue;
+			busy[i] = false;
+			err = spi_flash_wait_ready(&chips[i], timeout[i]);
+			if (!ret)
+				ret = err;
+		}
+	}
+
+	/* Report the erases as the commands the combined flash would use */
+	for (j = 0; j < SPI_FLASH_MAX_ERASE_TYPES; j++) {
+		flash->erase_types[j].count = chips[0].erase_types[j].count;
+		if (flash->dual_flash == SF_DUAL_STACKED_FLASH)
+			flash->erase_types[j].count +=
+				chips[1].erase_types[j].count;
+	}
+	flash->erase_chip_count = chips[0].erase_chip_count +
+				  chips[1].erase_chip_count;
+
+	return ret;
+}
+
+/* Set up the second chip select as a generic device on the same node */
+static int spi_flash_dual_get_slave(struct udevice *dev, int cs,
+				    struct udevice **devp)
+{
+	struct dm_spi_slave_platdata *plat;
+	struct udevice *bus = dev->parent;
+	char name[30];
+	int ret;
+
+	ret = spi_find_chip_select(bus, cs, devp);
+	if (ret == -ENODEV) {
+		ret = device_bind_driver_to_node(bus, "spi_generic_drv",
+						 dev->name, dev->of_offset,
+						 devp);
+		if (ret)
+			return ret;
+		snprintf(name, sizeof(name), "%s.%d", dev->name, cs);
+		ret = device_set_name(*devp, name);
+		if (ret)
+			return ret;
+		plat = dev_get_parent_platdata(*devp);
+		plat->cs = cs;
+		/*
+		 * Put it ahead of the flash among the bus's children, so that
+		 * it is never the next child when removing the bus removes
+		 * the flash, which unbinds it
+		 */
+		list_move_tail(&(*devp)->sibling_node, &dev->sibling_node);
+	} else if (ret) {
+		return ret;
+	}
+
+	return device_probe(*devp);
+}
+
+int spi_flash_dual_probe(struct spi_flash *flash)
+{
+	struct udevice *dev = flash->dev, *upper;
+	const void *blob = gd->fdt_blob;
+	int node = dev->of_offset;
+	struct spi_flash *chips;
+	u32 cs[2];
+	int i, ret;
+	u8 mode;
+
+	if (fdtdec_get_bool(blob, node, "u-boot,interleaved-memories"))
+		mode = SF_DUAL_INTERLEAVED_FLASH;
+	else if (fdtdec_get_bool(blob, node, "stacked-memories"))
+		mode = SF_DUAL_STACKED_FLASH;
+	else
+		return 0;
+
+	if (fdtdec_get_int_array(blob, node, "reg", cs, ARRAY_SIZE(cs))) {
+		printf("SF: Dual flash needs two chip selects\n");
+		return -EINVAL;
+	}
+	ret = spi_flash_dual_get_slave(dev, cs[1], &upper);
+	if (ret) {
+		debug("SF: Cannot get chip select %u: %d\n", cs[1], ret);
+		return ret;
+	}
+
+	chips = calloc(2, sizeof(*chips));
+	if (!chips)
+		return -ENOMEM;
+	chips[0] = *flash;
+	chips[1].dev = upper;
+	chips[1].spi = dev_get_parent_priv(upper);
+	ret = spi_claim_bus(chips[1].spi);
+	if (!ret) {
+		ret = spi_flash_scan(&chips[1]);
+		spi_release_bus(chips[1].spi);
+	}
+	if (!ret && (chips[1].size != chips[0].size ||
+		     chips[1].page_size != chips[0].page_size ||
+		     chips[1].erase_types[0].size !=
+		     chips[0].erase_types[0].size)) {
+		printf("SF: Dual flash chips differ\n");
+		ret = -EINVAL;
+	}
+	if (ret) {
+		spi_mem_dirmap_destroy(chips[1].dirmap);
+		free(chips);
+		return ret;
+	}
+
+	/* The chips are now reached through dual_chips only */
+	flash->dirmap = NULL;
+	flash->flash_lock = NULL;
+	flash->flash_unlock = NULL;
+	flash->flash_is_locked = NULL;
+	flash->dual_flash = mode;
+	flash->dual_chips = chips;
+	flash->size <<= 1;
+	if (mode == SF_DUAL_INTERLEAVED_FLASH) {
+		flash->page_size <<= 1;
+		flash->sector_size <<= 1;
+		flash->erase_size <<= 1;
+		for (i = 0; i < SPI_FLASH_MAX_ERASE_TYPES; i++)
+			flash->erase_types[i].size <<= 1;
+	}
+
+	printf("SF: Dual %s flash on chip selects %u and %u, total ",
+	       mode == SF_DUAL_INTERLEAVED_FLASH ? "interleaved" : "stacked",
+	       cs[0], cs[1]);
+	print_size(flash->size, "\n");
+
+	return 0;
+}
+
+void spi_flash_dual_remove(struct spi_flash *flash)
+{
+	struct udevice *upper;
+	int i;
+
+	if (!flash->dual_chips)
+		return;
+
+	upper = flash->dual_chips[1].dev;
+	for (i = 0; i < 2; i++)
+		spi_mem_dirmap_destroy(flash->dual_chips[i].dirmap);
+	free(flash->dual_chips);
+	flash->dual_chips = NULL;
+
+	/* Unbind the second chip select if it was bound for this flash */
+	if (upper->of_offset == flash->dev->of_offset) {
+		device_remove(upper);
+		device_unbind(upper);
+	}
+}
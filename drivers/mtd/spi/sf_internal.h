@@ -18,15 +18,19 @@ enum spi_dual_flash {
 	SF_SINGLE_FLASH	= 0,
 	SF_DUAL_STACKED_FLASH	= BIT(0),
 	SF_DUAL_PARALLEL_FLASH	= BIT(1),
+	/* Pages alternate between two chip selects, see sf_dual.c */
+	SF_DUAL_INTERLEAVED_FLASH	= BIT(2),
 };
 
 enum spi_nor_option_flags {
 	SNOR_F_SST_WR		= BIT(0),
 	SNOR_F_USE_FSR		= BIT(1),
 	SNOR_F_USE_UPAGE	= BIT(3),
+	SNOR_F_ERASE_SUSP	= BIT(4),
 };
 
 #define SPI_FLASH_3B_ADDR_LEN		3
+#define SPI_FLASH_4B_ADDR_LEN		4
 #define SPI_FLASH_CMD_LEN		(1 + SPI_FLASH_3B_ADDR_LEN)
 #define SPI_FLASH_16MB_BOUN		0x1000000
 
@@ -40,8 +44,14 @@ enum spi_nor_option_flags {
 
 /* Erase commands */
 #define CMD_ERASE_4K			0x20
+#define CMD_ERASE_32K			0x52
 #define CMD_ERASE_CHIP			0xc7
 #define CMD_ERASE_64K			0xd8
+#define CMD_ERASE_4K_4B			0x21
+#define CMD_ERASE_32K_4B		0x5c
+#define CMD_ERASE_64K_4B		0xdc
+#define CMD_ERASE_SUSPEND		0x75
+#define CMD_ERASE_RESUME		0x7a
 
 /* Write commands */
 #define CMD_WRITE_STATUS		0x01
@@ -49,6 +59,8 @@ enum spi_nor_option_flags {
 #define CMD_WRITE_DISABLE		0x04
 #define CMD_WRITE_ENABLE		0x06
 #define CMD_QUAD_PAGE_PROGRAM		0x32
+#define CMD_PAGE_PROGRAM_4B		0x12
+#define CMD_QUAD_PAGE_PROGRAM_4B	0x34
 
 /* Read commands */
 #define CMD_READ_ARRAY_SLOW		0x03
@@ -57,7 +69,14 @@ enum spi_nor_option_flags {
 #define CMD_READ_DUAL_IO_FAST		0xbb
 #define CMD_READ_QUAD_OUTPUT_FAST	0x6b
 #define CMD_READ_QUAD_IO_FAST		0xeb
+#define CMD_READ_ARRAY_SLOW_4B		0x13
+#define CMD_READ_ARRAY_FAST_4B		0x0c
+#define CMD_READ_DUAL_OUTPUT_FAST_4B	0x3c
+#define CMD_READ_DUAL_IO_FAST_4B	0xbc
+#define CMD_READ_QUAD_OUTPUT_FAST_4B	0x6c
+#define CMD_READ_QUAD_IO_FAST_4B	0xec
 #define CMD_READ_ID			0x9f
+#define CMD_READ_SFDP			0x5a
 #define CMD_READ_STATUS			0x05
 #define CMD_READ_STATUS1		0x35
 #define CMD_READ_CONFIG			0x35
@@ -84,6 +103,14 @@ enum spi_nor_option_flags {
 #define SPI_FLASH_PROG_TIMEOUT		(2 * CONFIG_SYS_HZ)
 #define SPI_FLASH_PAGE_ERASE_TIMEOUT	(5 * CONFIG_SYS_HZ)
 #define SPI_FLASH_SECTOR_ERASE_TIMEOUT	(10 * CONFIG_SYS_HZ)
+/* Chip erase: 40 seconds for each 2MiB */
+#define SPI_FLASH_CHIP_ERASE_TIMEOUT(size) \
+	(40 * CONFIG_SYS_HZ * max_t(u32, (size) >> 21, 1))
+/* Erase suspend latency, and how long to let an erase run once resumed */
+#define SPI_FLASH_SUSPEND_TIMEOUT	(CONFIG_SYS_HZ / 100)
+#define SPI_FLASH_RESUME_RUN_US		100
+/* Typical program time of a 256-byte page, when SFDP does not give it */
+#define SPI_FLASH_PAGE_PROG_US		700
 
 /* SST specific */
 #ifdef CONFIG_SPI_FLASH_SST
@@ -131,10 +158,16 @@ struct spi_flash_info {
 #define RD_DUAL			BIT(5)	/* use Dual Read */
 #define RD_QUADIO		BIT(6)	/* use Quad IO Read */
 #define RD_DUALIO		BIT(7)	/* use Dual IO Read */
+#define OPCODES_4B		BIT(8)	/* use dedicated 4-byte addr opcodes */
+#define ERASE_SUSP		BIT(9)	/* erase suspend with 0x75/0x7a */
 #define RD_FULL			(RD_QUAD | RD_DUAL | RD_QUADIO | RD_DUALIO)
 };
 
 extern const struct spi_flash_info spi_flash_ids[];
+extern const unsigned int spi_flash_ids_count;
+
+/* Look up the spi_flash_ids[] entry for the ID read from a flash */
+const struct spi_flash_info *spi_flash_find_id(const u8 *id);
 
 /* Send a single-byte command to the device and read the response */
 int spi_flash_cmd(struct spi_slave *spi, u8 cmd, void *response, size_t len);
@@ -157,6 +190,49 @@ int spi_flash_cmd_write(struct spi_slave *spi, const u8 *cmd, size_t cmd_len,
 /* Flash erase(sectors) operation, support all possible erase commands */
 int spi_flash_cmd_erase_ops(struct spi_flash *flash, u32 offset, size_t len);
 
+/*
+ * Start erasing the largest block that fits at offset, or the whole chip
+ * if offset and len cover it, without waiting for the erase to finish.
+ * Returns the number of bytes being erased and sets *timeoutp to how long
+ * to wait for them, or -ve on error.
+ */
+int spi_flash_erase_start(struct spi_flash *flash, u32 offset, size_t len,
+			  unsigned long *timeoutp);
+
+/*
+ * Start programming at offset, up to the end of its page, without waiting
+ * for the program to finish. Returns the number of bytes sent, or -ve on
+ * error.
+ */
+int spi_flash_program_start(struct spi_flash *flash, u32 offset, size_t len,
+			    const void *buf);
+
+/* Wait for an erase or program started above to finish */
+int spi_flash_wait_ready(struct spi_flash *flash, unsigned long timeout);
+
+/*
+ * Background erase, one block at a time. Start it, then poll it until it
+ * returns 0; it returns -EBUSY while blocks remain. See the
+ * spi_flash_erase_..._dm() functions for the details.
+ */
+int spi_flash_async_erase_start(struct spi_flash *flash, u32 offset,
+				size_t len);
+int spi_flash_async_erase_poll(struct spi_flash *flash);
+int spi_flash_async_erase_suspend(struct spi_flash *flash);
+int spi_flash_async_erase_resume(struct spi_flash *flash);
+
+/*
+ * Get a background erase out of the way of an access to offset/len. The
+ * block being erased is suspended if the flash can do that and the access
+ * does not touch the block; otherwise the block is left to finish. Resume
+ * the erase with spi_flash_async_erase_resume() after the access.
+ */
+int spi_flash_async_erase_hold(struct spi_flash *flash, u32 offset,
+			       size_t len);
+
+/* Stop a background erase once the block in flight has finished */
+int spi_flash_async_erase_abort(struct spi_flash *flash);
+
 /* Lock stmicro spi flash region */
 int stm_lock(struct spi_flash *flash, u32 ofs, size_t len);
 
@@ -208,6 +284,131 @@ int spi_flash_read_common(struct spi_flash *flash, const u8 *cmd,
 int spi_flash_cmd_read_ops(struct spi_flash *flash, u32 offset,
 		size_t len, void *data);
 
+#if CONFIG_IS_ENABLED(SPI_FLASH_VERIFY)
+/*
+ * Check len bytes read back from offset against what was written there,
+ * and add them to the checksum of the verify in progress
+ */
+int spi_flash_verify_data(struct spi_flash *flash, u32 offset,
+			  const void *readback, const void *buf, size_t len);
+
+/*
+ * Read back len bytes at offset and check them as above. For write paths
+ * which cannot read back page by page
+ */
+int spi_flash_verify_range(struct spi_flash *flash, u32 offset, size_t len,
+			   const void *buf);
+
+/* Whether writes are read back and checked as they are done */
+static inline bool spi_flash_verifying(struct spi_flash *flash)
+{
+	return flash->verify;
+}
+#else
+static inline bool spi_flash_verifying(struct spi_flash *flash)
+{
+	return false;
+}
+#endif
+
+#ifdef CONFIG_SPI_FLASH_SFDP
+/* SFDP fast read modes (x-y-z: lines for opcode-address-data) */
+enum spi_flash_sfdp_read_mode {
+	SFDP_READ_1_1_2,
+	SFDP_READ_1_2_2,
+	SFDP_READ_1_1_4,
+	SFDP_READ_1_4_4,
+
+	SFDP_READ_COUNT,
+};
+
+#define SFDP_MAX_ERASE_TYPES		4
+
+/**
+ * struct spi_flash_sfdp_read - SFDP fast read mode settings
+ *
+ * @opcode:	Read opcode, 0 if the mode is not supported
+ * @wait:	Mode and dummy clock cycles between address and data
+ * @addr_lines:	Number of lines used for the address and wait cycles
+ */
+struct spi_flash_sfdp_read {
+	u8 opcode;
+	u8 wait;
+	u8 addr_lines;
+};
+
+/**
+ * struct spi_flash_sfdp_erase - SFDP erase type
+ *
+ * @size:	Erase size in bytes, 0 if the erase type is not supported
+ * @opcode:	Erase opcode
+ */
+struct spi_flash_sfdp_erase {
+	u32 size;
+	u8 opcode;
+};
+
+/**
+ * struct spi_flash_sfdp - Flash parameters discovered through SFDP
+ *
+ * @size:	Flash size in bytes
+ * @page_size:	Page program size in bytes, 0 if not given (JESD216 rev 0)
+ * @prog_time_us: Typical page program time, 0 if not given (JESD216 rev 0)
+ * @sector_size: Largest erase size usable across the whole flash
+ * @flags:	Flash info flags (see struct spi_flash_info) implied by SFDP
+ * @flags_known: Flash info flags which SFDP is authoritative for; any
+ *		other flags are taken from the ID table
+ * @quad_enable: Quad enable requirement (BFPT QER field), -1 if unknown
+ * @read:	Fast read mode settings, indexed by spi_flash_sfdp_read_mode
+ * @erase:	Erase types, indexed by SFDP erase type - 1
+ * @erase_mask:	Bitmask of the erase types usable across the whole flash
+ */
+struct spi_flash_sfdp {
+	u32 size;
+	u32 page_size;
+	u32 prog_time_us;
+	u32 sector_size;
+	u16 flags;
+	u16 flags_known;
+	s8 quad_enable;
+	struct spi_flash_sfdp_read read[SFDP_READ_COUNT];
+	struct spi_flash_sfdp_erase erase[SFDP_MAX_ERASE_TYPES];
+	u8 erase_mask;
+};
+
+/* The flash has no quad enable bit (BFPT QER field) */
+#define SFDP_QER_NONE			0
+
+/**
+ * spi_flash_parse_sfdp() - Read and parse the SFDP tables of a flash
+ *
+ * This reads the Basic Flash Parameter Table, the Sector Map Parameter
+ * Table and the 4-byte Address Instruction Table, if present.
+ *
+ * @flash:	Flash to read from
+ * @sfdp:	Returns the flash parameters
+ * @return 0 if OK, -ENOENT if the flash has no valid SFDP, other -ve on error
+ */
+int spi_flash_parse_sfdp(struct spi_flash *flash, struct spi_flash_sfdp *sfdp);
+#endif
+
+#ifdef CONFIG_SPI_FLASH_DUAL
+/*
+ * Combine a flash with the second chip select given in its device tree
+ * node, if the node asks for stacked or interleaved dual flash. Returns 0
+ * if it does not.
+ */
+int spi_flash_dual_probe(struct spi_flash *flash);
+void spi_flash_dual_remove(struct spi_flash *flash);
+
+/* Flash operations on the combined chips */
+int spi_flash_dual_read(struct spi_flash *flash, u32 offset, size_t len,
+			void *buf);
+int spi_flash_dual_write(struct spi_flash *flash, u32 offset, size_t len,
+			 const void *buf);
+int spi_flash_dual_erase(struct spi_flash *flash, u32 offset, size_t len);
+#endif
+
 #ifdef CONFIG_SPI_FLASH_MTD
 int spi_flash_mtd_register(struct spi_flash *flash);
 void spi_flash_mtd_unregister(void);
@@ -13,6 +13,7 @@
 #include <errno.h>
 #include <malloc.h>
 #include <spi.h>
+#include <spi-mem.h>
 #include <spi_flash.h>
 
 #include "sf_internal.h"
@@ -41,7 +42,9 @@ static int spi_flash_probe_slave(struct spi_flash *flash)
 		return ret;
 	}
 
+	bootstage_start(BOOTSTAGE_ID_ACCUM_SPI, "spi_flash_probe");
 	ret = spi_flash_scan(flash);
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_SPI);
 	if (ret)
 		goto err_read_id;
 
@@ -105,6 +108,7 @@ void spi_flash_free(struct spi_flash *flash)
 #ifdef CONFIG_SPI_FLASH_MTD
 	spi_flash_mtd_unregister();
 #endif
+	spi_mem_dirmap_destroy(flash->dirmap);
 	spi_free_slave(flash->spi);
 	free(flash);
 }
@@ -115,51 +119,161 @@ static int spi_flash_std_read(struct udevice *dev, u32 offset, size_t len,
 			      void *buf)
 {
 	struct spi_flash *flash = dev_get_uclass_priv(dev);
+	bool resume;
+	int ret, err;
 
-	return spi_flash_cmd_read_ops(flash, offset, len, buf);
+#ifdef CONFIG_SPI_FLASH_DUAL
+	if (flash->dual_chips)
+		return spi_flash_dual_read(flash, offset, len, buf);
+#endif
+
+	/* Suspend a background erase for the read, unless already done */
+	resume = flash->async_erase.len && !flash->async_erase.suspended;
+	if (resume) {
+		ret = spi_flash_async_erase_hold(flash, offset, len);
+		if (ret)
+			return ret;
+	}
+
+	ret = spi_flash_cmd_read_ops(flash, offset, len, buf);
+
+	if (resume) {
+		err = spi_flash_async_erase_resume(flash);
+		if (!ret)
+			ret = err;
+	}
+
+	return ret;
 }
 
 static int spi_flash_std_write(struct udevice *dev, u32 offset, size_t len,
 			const void *buf)
 {
 	struct spi_flash *flash = dev_get_uclass_priv(dev);
+#if defined(CONFIG_SPI_FLASH_DUAL) || defined(CONFIG_SPI_FLASH_SST)
+	int ret;
+#endif
 
+	if (flash->async_erase.len)
+		return -EBUSY;
+#ifdef CONFIG_SPI_FLASH_DUAL
+	if (flash->dual_chips) {
+		ret = spi_flash_dual_write(flash, offset, len, buf);
+		goto verify;
+	}
+#endif
 #if defined(CONFIG_SPI_FLASH_SST)
 	if (flash->flags & SNOR_F_SST_WR) {
 		if (flash->spi->mode & SPI_TX_BYTE)
-			return sst_write_bp(flash, offset, len, buf);
+			ret = sst_write_bp(flash, offset, len, buf);
 		else
-			return sst_write_wp(flash, offset, len, buf);
+			ret = sst_write_wp(flash, offset, len, buf);
+		goto verify;
 	}
 #endif
 
+	/* This verifies page by page */
 	return spi_flash_cmd_write_ops(flash, offset, len, buf);
+
+#if defined(CONFIG_SPI_FLASH_DUAL) || defined(CONFIG_SPI_FLASH_SST)
+verify:
+#if CONFIG_IS_ENABLED(SPI_FLASH_VERIFY)
+	if (!ret && flash->verify)
+		ret = spi_flash_verify_range(flash, offset, len, buf);
+#endif
+	return ret;
+#endif
 }
 
 static int spi_flash_std_erase(struct udevice *dev, u32 offset, size_t len)
 {
 	struct spi_flash *flash = dev_get_uclass_priv(dev);
 
+	if (flash->async_erase.len)
+		return -EBUSY;
+#ifdef CONFIG_SPI_FLASH_DUAL
+	if (flash->dual_chips)
+		return spi_flash_dual_erase(flash, offset, len);
+#endif
+
 	return spi_flash_cmd_erase_ops(flash, offset, len);
 }
 
+static int spi_flash_std_erase_start(struct udevice *dev, u32 offset,
+				     size_t len)
+{
+	struct spi_flash *flash = dev_get_uclass_priv(dev);
+
+#ifdef CONFIG_SPI_FLASH_DUAL
+	if (flash->dual_chips)
+		return -ENOSYS;
+#endif
+
+	return spi_flash_async_erase_start(flash, offset, len);
+}
+
+static int spi_flash_std_erase_poll(struct udevice *dev)
+{
+	return spi_flash_async_erase_poll(dev_get_uclass_priv(dev));
+}
+
+static int spi_flash_std_erase_suspend(struct udevice *dev)
+{
+	return spi_flash_async_erase_suspend(dev_get_uclass_priv(dev));
+}
+
+static int spi_flash_std_erase_resume(struct udevice *dev)
+{
+	return spi_flash_async_erase_resume(dev_get_uclass_priv(dev));
+}
+
 static int spi_flash_std_probe(struct udevice *dev)
 {
 	struct spi_slave *slave = dev_get_parent_priv(dev);
 	struct dm_spi_slave_platdata *plat = dev_get_parent_platdata(dev);
 	struct spi_flash *flash;
+	int ret;
 
 	flash = dev_get_uclass_priv(dev);
 	flash->dev = dev;
 	flash->spi = slave;
 	debug("%s: slave=%p, cs=%d\n", __func__, slave, plat->cs);
-	return spi_flash_probe_slave(flash);
+	ret = spi_flash_probe_slave(flash);
+	if (ret)
+		return ret;
+
+#ifdef CONFIG_SPI_FLASH_DUAL
+	ret = spi_flash_dual_probe(flash);
+	if (ret) {
+		spi_mem_dirmap_destroy(flash->dirmap);
+		return ret;
+	}
+#endif
+
+	return 0;
+}
+
+static int spi_flash_std_remove(struct udevice *dev)
+{
+	struct spi_flash *flash = dev_get_uclass_priv(dev);
+
+	spi_flash_async_erase_abort(flash);
+#ifdef CONFIG_SPI_FLASH_DUAL
+	spi_flash_dual_remove(flash);
+#endif
+	spi_mem_dirmap_destroy(flash->dirmap);
+
+	return 0;
 }
 
 static const struct dm_spi_flash_ops spi_flash_std_ops = {
 	.read = spi_flash_std_read,
 	.write = spi_flash_std_write,
 	.erase = spi_flash_std_erase,
+	.erase_start = spi_flash_std_erase_start,
+	.erase_poll = spi_flash_std_erase_poll,
+	.erase_suspend = spi_flash_std_erase_suspend,
+	.erase_resume = spi_flash_std_erase_resume,
 };
 
 static const struct udevice_id spi_flash_std_ids[] = {
@@ -172,6 +286,7 @@ U_BOOT_DRIVER(spi_flash_std) = {
 	.id		= UCLASS_SPI_FLASH,
 	.of_match	= spi_flash_std_ids,
 	.probe		= spi_flash_std_probe,
+	.remove		= spi_flash_std_remove,
 	.priv_auto_alloc_size = sizeof(struct spi_flash),
 	.ops		= &spi_flash_std_ops,
 };
@@ -0,0 +1,496 @@
+/*
+ * SPI flash Serial Flash Discoverable Parameters (JESD216) support
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <malloc.h>
+#include <spi.h>
+#include <spi_flash.h>
+
+#include "sf_internal.h"
+
+#define SFDP_SIGNATURE			0x50444653	/* "SFDP" */
+#define SFDP_JESD216_MAJOR		1
+
+/* Parameter table IDs */
+#define SFDP_BFPT_ID			0xff00
+#define SFDP_SMPT_ID			0xff81
+#define SFDP_4BAIT_ID			0xff84
+
+/* Basic Flash Parameter Table, as 0-based dword indexes */
+#define BFPT_DWORD(i)			((i) - 1)
+#define BFPT_DWORD_MAX			16
+#define BFPT_DWORD_MAX_JESD216		9
+
+#define BFPT_DW1_READ_1_1_2		BIT(16)
+#define BFPT_DW1_ADDR_BYTES_MASK	GENMASK(18, 17)
+#define BFPT_DW1_ADDR_BYTES_3_ONLY	(0x0 << 17)
+#define BFPT_DW1_ADDR_BYTES_3_OR_4	(0x1 << 17)
+#define BFPT_DW1_ADDR_BYTES_4_ONLY	(0x2 << 17)
+#define BFPT_DW1_READ_1_2_2		BIT(20)
+#define BFPT_DW1_READ_1_4_4		BIT(21)
+#define BFPT_DW1_READ_1_1_4		BIT(22)
+
+#define BFPT_DW2_DENSITY_EXP		BIT(31)
+
+#define BFPT_DW11_PAGE_SIZE_SHIFT	4
+#define BFPT_DW11_PAGE_SIZE_MASK	GENMASK(7, 4)
+#define BFPT_DW11_PP_TYP_SHIFT		8
+#define BFPT_DW11_PP_TYP_MASK		GENMASK(12, 8)
+#define BFPT_DW11_PP_TYP_64US		BIT(13)
+
+#define BFPT_DW15_QER_SHIFT		20
+#define BFPT_DW15_QER_MASK		GENMASK(22, 20)
+
+/* Sector Map Parameter Table */
+#define SMPT_DESC_END			BIT(0)
+#define SMPT_DESC_TYPE_MAP		BIT(1)
+
+#define SMPT_CMD_OPCODE(cmd)		(((cmd) >> 8) & 0xff)
+#define SMPT_CMD_READ_DUMMY(cmd)	(((cmd) >> 16) & 0xf)
+#define SMPT_CMD_READ_DUMMY_VARIABLE	0xf
+#define SMPT_CMD_ADDR_LEN(cmd)		(((cmd) >> 22) & 0x3)
+#define SMPT_CMD_ADDR_LEN_0		0
+#define SMPT_CMD_ADDR_LEN_3		1
+#define SMPT_CMD_ADDR_LEN_4		2
+#define SMPT_CMD_READ_DATA(cmd)		(((cmd) >> 24) & 0xff)
+
+#define SMPT_MAP_ID(hdr)		(((hdr) >> 8) & 0xff)
+#define SMPT_MAP_REGION_COUNT(hdr)	((((hdr) >> 16) & 0xff) + 1)
+
+#define SMPT_REGION_ERASE_TYPES(r)	((r) & 0xf)
+#define SMPT_REGION_SIZE(r)		((((r) >> 8) + 1) * 256)
+
+/* 4-byte Address Instruction Table */
+#define BAIT_DWORD_MAX			2
+#define BAIT_READ			BIT(0)
+#define BAIT_READ_FAST			BIT(1)
+#define BAIT_READ_1_1_2			BIT(2)
+#define BAIT_READ_1_2_2			BIT(3)
+#define BAIT_READ_1_1_4			BIT(4)
+#define BAIT_READ_1_4_4			BIT(5)
+#define BAIT_PP				BIT(6)
+#define BAIT_PP_1_1_4			BIT(7)
+#define BAIT_ERASE_TYPE(i)		BIT(9 + (i))
+
+struct sfdp_header {
+	u32 signature;
+	u8 minor;
+	u8 major;
+	u8 nph;		/* number of parameter headers - 1 */
+	u8 unused;
+};
+
+struct sfdp_param_header {
+	u8 id_lsb;
+	u8 minor;
+	u8 major;
+	u8 length;	/* in dwords */
+	u8 ptp[3];	/* parameter table pointer */
+	u8 id_msb;
+};
+
+#define SFDP_PARAM_ID(ph)	(((ph)->id_msb << 8) | (ph)->id_lsb)
+#define SFDP_PARAM_PTP(ph)	(((ph)->ptp[2] << 16) | ((ph)->ptp[1] << 8) | \
+				 (ph)->ptp[0])
+
+static const struct {
+	u32 bfpt_flag;
+	u32 bait_flag;
+	u16 info_flag;
+	u8 addr_lines;
+} sfdp_read_modes[SFDP_READ_COUNT] = {
+	[SFDP_READ_1_1_2] = { BFPT_DW1_READ_1_1_2, BAIT_READ_1_1_2,
+			      RD_DUAL, 1 },
+	[SFDP_READ_1_2_2] = { BFPT_DW1_READ_1_2_2, BAIT_READ_1_2_2,
+			      RD_DUALIO, 2 },
+	[SFDP_READ_1_1_4] = { BFPT_DW1_READ_1_1_4, BAIT_READ_1_1_4,
+			      RD_QUAD, 1 },
+	[SFDP_READ_1_4_4] = { BFPT_DW1_READ_1_4_4, BAIT_READ_1_4_4,
+			      RD_QUADIO, 4 },
+};
+
+/* SFDP is always read with 3 address bytes and 8 dummy cycles */
+static int sfdp_read(struct spi_flash *flash, u32 addr, void *buf, size_t len)
+{
+	u8 cmd[SPI_FLASH_CMD_LEN + 1];
+
+	cmd[0] = CMD_READ_SFDP;
+	cmd[1] = addr >> 16;
+	cmd[2] = addr >> 8;
+	cmd[3] = addr >> 0;
+	cmd[4] = 0;
+
+	return spi_flash_read_common(flash, cmd, sizeof(cmd), buf, len);
+}
+
+/* Read a parameter table as host-endian dwords */
+static int sfdp_read_table(struct spi_flash *flash,
+			   const struct sfdp_param_header *ph, u32 *table,
+			   uint dwords)
+{
+	uint i;
+	int ret;
+
+	ret = sfdp_read(flash, SFDP_PARAM_PTP(ph), table, dwords * 4);
+	if (ret)
+		return ret;
+	for (i = 0; i < dwords; i++)
+		table[i] = le32_to_cpu(table[i]);
+
+	return 0;
+}
+
+static int sfdp_parse_bfpt(struct spi_flash *flash,
+			   const struct sfdp_param_header *ph,
+			   struct spi_flash_sfdp *sfdp, u32 *addr_bytes)
+{
+	u32 bfpt[BFPT_DWORD_MAX] = { 0 };
+	u32 density, half;
+	uint len, i;
+	int ret;
+
+	if (ph->length < BFPT_DWORD_MAX_JESD216)
+		return -EINVAL;
+	len = min_t(uint, ph->length, BFPT_DWORD_MAX);
+	ret = sfdp_read_table(flash, ph, bfpt, len);
+	if (ret)
+		return ret;
+
+	/* Flash density is given in bits */
+	density = bfpt[BFPT_DWORD(2)];
+	if (density & BFPT_DW2_DENSITY_EXP) {
+		density &= ~BFPT_DW2_DENSITY_EXP;
+		if (density < 3 || density > 34)
+			return -EINVAL;
+		sfdp->size = 1U << (density - 3);
+	} else {
+		sfdp->size = ((u64)density + 1) >> 3;
+	}
+
+	/* Fast read modes: each is described by a half of dword 3 or 4 */
+	for (i = 0; i < SFDP_READ_COUNT; i++) {
+		struct spi_flash_sfdp_read *read = &sfdp->read[i];
+
+		if (!(bfpt[BFPT_DWORD(1)] & sfdp_read_modes[i].bfpt_flag))
+			continue;
+
+		switch (i) {
+		case SFDP_READ_1_4_4:
+			half = bfpt[BFPT_DWORD(3)];
+			break;
+		case SFDP_READ_1_1_4:
+			half = bfpt[BFPT_DWORD(3)] >> 16;
+			break;
+		case SFDP_READ_1_1_2:
+			half = bfpt[BFPT_DWORD(4)];
+			break;
+		default:
+			half = bfpt[BFPT_DWORD(4)] >> 16;
+			break;
+		}
+
+		read->opcode = (half >> 8) & 0xff;
+		read->wait = (half & 0x1f) + ((half >> 5) & 0x7);
+		read->addr_lines = sfdp_read_modes[i].addr_lines;
+		sfdp->flags |= sfdp_read_modes[i].info_flag;
+	}
+	sfdp->flags_known |= RD_FULL;
+
+	/* Erase types: each is described by a half of dword 8 or 9 */
+	for (i = 0; i < SFDP_MAX_ERASE_TYPES; i++) {
+		half = bfpt[BFPT_DWORD(8) + i / 2] >> (16 * (i % 2));
+		if (!(half & 0xff) || (half & 0xff) > 31)
+			continue;
+
+		sfdp->erase[i].size = 1U << (half & 0xff);
+		sfdp->erase[i].opcode = (half >> 8) & 0xff;
+		sfdp->erase_mask |= BIT(i);
+	}
+
+	/* Page size and quad enable requirements appeared in JESD216A */
+	sfdp->quad_enable = -1;
+	if (len >= BFPT_DWORD_MAX) {
+		sfdp->page_size = 1U << ((bfpt[BFPT_DWORD(11)] &
+					  BFPT_DW11_PAGE_SIZE_MASK) >>
+					 BFPT_DW11_PAGE_SIZE_SHIFT);
+		sfdp->prog_time_us = ((bfpt[BFPT_DWORD(11)] &
+				       BFPT_DW11_PP_TYP_MASK) >>
+				      BFPT_DW11_PP_TYP_SHIFT) + 1;
+		sfdp->prog_time_us *= bfpt[BFPT_DWORD(11)] &
+				      BFPT_DW11_PP_TYP_64US ? 64 : 8;
+		sfdp->quad_enable = (bfpt[BFPT_DWORD(15)] &
+				     BFPT_DW15_QER_MASK) >> BFPT_DW15_QER_SHIFT;
+	}
+
+	*addr_bytes = bfpt[BFPT_DWORD(1)] & BFPT_DW1_ADDR_BYTES_MASK;
+
+	return 0;
+}
+
+/* Run one sector map configuration detection command, returning its bit */
+static int sfdp_smpt_detect(struct spi_flash *flash, u32 cmd, u32 addr)
+{
+	u8 buf[1 + SPI_FLASH_4B_ADDR_LEN + 2];
+	uint addr_len, dummy, i;
+	u8 data;
+	int ret;
+
+	switch (SMPT_CMD_ADDR_LEN(cmd)) {
+	case SMPT_CMD_ADDR_LEN_0:
+		addr_len = 0;
+		break;
+	case SMPT_CMD_ADDR_LEN_4:
+		addr_len = SPI_FLASH_4B_ADDR_LEN;
+		break;
+	case SMPT_CMD_ADDR_LEN_3:
+		addr_len = SPI_FLASH_3B_ADDR_LEN;
+		break;
+	default:
+		addr_len = flash->addr_width ? flash->addr_width :
+			   SPI_FLASH_3B_ADDR_LEN;
+		break;
+	}
+
+	/* A variable latency is taken to be the usual 8 dummy cycles */
+	dummy = SMPT_CMD_READ_DUMMY(cmd);
+	if (dummy == SMPT_CMD_READ_DUMMY_VARIABLE)
+		dummy = 8;
+	dummy = DIV_ROUND_UP(dummy, 8);
+
+	memset(buf, 0, sizeof(buf));
+	buf[0] = SMPT_CMD_OPCODE(cmd);
+	for (i = addr_len; i > 0; i--) {
+		buf[i] = addr;
+		addr >>= 8;
+	}
+
+	ret = spi_flash_read_common(flash, buf, 1 + addr_len + dummy, &data,
+				    1);
+	if (ret)
+		return ret;
+
+	return !!(data & SMPT_CMD_READ_DATA(cmd));
+}
+
+/*
+ * Find the sector map in use and restrict the erase types to those which
+ * work in every region, so that erases never need to care about regions.
+ */
+static int sfdp_parse_smpt(struct spi_flash *flash,
+			   const struct sfdp_param_header *ph,
+			   struct spi_flash_sfdp *sfdp)
+{
+	uint len = ph->length, i, r, regions;
+	u32 *smpt, mask, total;
+	u8 map_id = 0;
+	int ret;
+
+	smpt = malloc(len * 4);
+	if (!smpt)
+		return -ENOMEM;
+	ret = sfdp_read_table(flash, ph, smpt, len);
+	if (ret)
+		goto out;
+
+	/* Detection commands build the ID of the map in use, MSB first */
+	for (i = 0; i + 1 < len; i += 2) {
+		if (smpt[i] & SMPT_DESC_TYPE_MAP)
+			break;
+		ret = sfdp_smpt_detect(flash, smpt[i], smpt[i + 1]);
+		if (ret < 0)
+			goto out;
+		map_id = map_id << 1 | ret;
+	}
+
+	ret = -EINVAL;
+	while (i < len && (smpt[i] & SMPT_DESC_TYPE_MAP)) {
+		regions = SMPT_MAP_REGION_COUNT(smpt[i]);
+		if (i + regions >= len)
+			break;
+
+		if (SMPT_MAP_ID(smpt[i]) == map_id) {
+			mask = sfdp->erase_mask;
+			total = 0;
+			for (r = 1; r <= regions; r++) {
+				mask &= SMPT_REGION_ERASE_TYPES(smpt[i + r]);
+				total += SMPT_REGION_SIZE(smpt[i + r]);
+			}
+			if (total != sfdp->size) {
+				debug("SF: sector map covers %#x, not %#x\n",
+				      total, sfdp->size);
+				break;
+			}
+			sfdp->erase_mask = mask;
+			ret = 0;
+			break;
+		}
+
+		if (smpt[i] & SMPT_DESC_END)
+			break;
+		i += regions + 1;
+	}
+
+out:
+	free(smpt);
+	return ret;
+}
+
+/*
+ * Check that the flash has 4-byte address opcodes for reading, programming
+ * and erasing. Modes and erase types without one are not usable then.
+ */
+static int sfdp_parse_4bait(struct spi_flash *flash,
+			    const struct sfdp_param_header *ph,
+			    struct spi_flash_sfdp *sfdp)
+{
+	const u32 needed = BAIT_READ | BAIT_READ_FAST | BAIT_PP;
+	u32 bait[BAIT_DWORD_MAX];
+	uint i;
+	int ret;
+
+	if (ph->length < BAIT_DWORD_MAX)
+		return -EINVAL;
+	ret = sfdp_read_table(flash, ph, bait, BAIT_DWORD_MAX);
+	if (ret)
+		return ret;
+
+	sfdp->flags_known |= OPCODES_4B;
+	if ((bait[0] & needed) != needed)
+		return 0;
+
+	for (i = 0; i < SFDP_READ_COUNT; i++) {
+		if (!(bait[0] & sfdp_read_modes[i].bait_flag)) {
+			sfdp->read[i].opcode = 0;
+			sfdp->flags &= ~sfdp_read_modes[i].info_flag;
+		}
+	}
+	for (i = 0; i < SFDP_MAX_ERASE_TYPES; i++) {
+		if (!(bait[0] & BAIT_ERASE_TYPE(i)))
+			sfdp->erase_mask &= ~BIT(i);
+	}
+	if (!(bait[0] & BAIT_PP_1_1_4))
+		sfdp->flags_known |= WR_QPP;
+	sfdp->flags |= OPCODES_4B;
+
+	return 0;
+}
+
+/* Pick the sector (largest) and 4K erase types from those left usable */
+static void sfdp_setup_erase(struct spi_flash_sfdp *sfdp)
+{
+	const struct spi_flash_sfdp_erase *erase;
+	uint i;
+
+	sfdp->sector_size = 0;
+	for (i = 0; i < SFDP_MAX_ERASE_TYPES; i++) {
+		if (!(sfdp->erase_mask & BIT(i)))
+			continue;
+
+		erase = &sfdp->erase[i];
+		if (erase->opcode == CMD_ERASE_4K && erase->size == 4096)
+			sfdp->flags |= SECT_4K;
+		else if (erase->opcode == CMD_ERASE_64K &&
+			 erase->size > sfdp->sector_size)
+			sfdp->sector_size = erase->size;
+	}
+	sfdp->flags_known |= SECT_4K;
+}
+
+int spi_flash_parse_sfdp(struct spi_flash *flash, struct spi_flash_sfdp *sfdp)
+{
+	const struct sfdp_param_header *bfpt = NULL, *smpt = NULL, *bait = NULL;
+	struct sfdp_param_header *ph, *phdrs;
+	struct sfdp_header hdr;
+	u32 addr_bytes;
+	uint nph, i;
+	int ret;
+
+	memset(sfdp, 0, sizeof(*sfdp));
+
+	ret = sfdp_read(flash, 0, &hdr, sizeof(hdr));
+	if (ret)
+		return ret;
+	if (le32_to_cpu(hdr.signature) != SFDP_SIGNATURE ||
+	    hdr.major != SFDP_JESD216_MAJOR)
+		return -ENOENT;
+
+	nph = hdr.nph + 1;
+	phdrs = calloc(nph, sizeof(*phdrs));
+	if (!phdrs)
+		return -ENOMEM;
+	ret = sfdp_read(flash, sizeof(hdr), phdrs, nph * sizeof(*phdrs));
+	if (ret)
+		goto out;
+
+	/* Use the newest revision of each table we know about */
+	for (i = 0, ph = phdrs; i < nph; i++, ph++) {
+		const struct sfdp_param_header **found;
+
+		if (ph->major != SFDP_JESD216_MAJOR)
+			continue;
+
+		switch (SFDP_PARAM_ID(ph)) {
+		case SFDP_BFPT_ID:
+			found = &bfpt;
+			break;
+		case SFDP_SMPT_ID:
+			found = &smpt;
+			break;
+		case SFDP_4BAIT_ID:
+			found = &bait;
+			break;
+		default:
+			continue;
+		}
+		if (!*found || ph->minor > (*found)->minor)
+			*found = ph;
+	}
+
+	ret = -ENOENT;
+	if (!bfpt)
+		goto out;
+	ret = sfdp_parse_bfpt(flash, bfpt, sfdp, &addr_bytes);
+	if (ret)
+		goto out;
+
+	if (smpt) {
+		ret = sfdp_parse_smpt(flash, smpt, sfdp);
+		if (ret) {
+			debug("SF: unusable SFDP sector map (err=%d)\n", ret);
+			goto out;
+		}
+	}
+
+	/*
+	 * Large flashes only take the 4-byte opcodes listed in the 4BAIT.
+	 * Without that table the ID table decides; entries whose JEDEC ID is
+	 * shared with older parts lacking those opcodes leave OPCODES_4B to
+	 * the 4BAIT and stay on the bank address register otherwise.
+	 */
+	if (addr_bytes == BFPT_DW1_ADDR_BYTES_3_ONLY) {
+		sfdp->flags_known |= OPCODES_4B;
+	} else if (bait && sfdp->size > SPI_FLASH_16MB_BOUN) {
+		ret = sfdp_parse_4bait(flash, bait, sfdp);
+		if (ret)
+			goto out;
+	}
+
+	sfdp_setup_erase(sfdp);
+	if (!sfdp->sector_size) {
+		debug("SF: no uniform sector erase in SFDP\n");
+		ret = -EINVAL;
+		goto out;
+	}
+
+	debug("SF: SFDP size %#x, page %#x, sector %#x, flags %#x/%#x\n",
+	      sfdp->size, sfdp->page_size, sfdp->sector_size, sfdp->flags,
+	      sfdp->flags_known);
+
+out:
+	free(phdrs);
+	return ret;
+}
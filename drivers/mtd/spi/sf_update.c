@@ -0,0 +1,319 @@
+/*
+ * SPI flash update: erase and program only what changed
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <malloc.h>
+#include <spi_flash.h>
+
+#include "sf_internal.h"
+
+/* The smallest erase the flash can do, which is the update granularity */
+static u32 spi_flash_update_block_size(struct spi_flash *flash)
+{
+	if (flash->erase_types[0].size)
+		return flash->erase_types[0].size;
+
+	return flash->erase_size;
+}
+
+static bool spi_flash_is_erased(const u8 *buf, size_t len)
+{
+	while (len--) {
+		if (*buf++ != 0xff)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Program @data into the pages of [start, end) in the block, skipping those
+ * which are left as they are: unchanged from @old, or all 0xff after an
+ * erase. The skipped bytes which belong to the update, [new_start, new_end),
+ * are counted.
+ */
+static int spi_flash_update_pages(struct spi_flash *flash, u32 block,
+				  const u8 *data, const u8 *old, u32 start,
+				  u32 end, u32 new_start, u32 new_end,
+				  struct spi_flash_update_stats *stats)
+{
+	u32 pos, todo;
+	int ret;
+
+	for (pos = start; pos < end; pos += todo, data += todo) {
+		todo = min(end - pos, flash->page_size -
+			   (block + pos) % flash->page_size);
+		if (old ? !memcmp(data, old + pos, todo) :
+			  spi_flash_is_erased(data, todo)) {
+			if (pos < new_end && pos + todo > new_start)
+				stats->skipped += min(pos + todo, new_end) -
+						  max(pos, new_start);
+			continue;
+		}
+
+		ret = spi_flash_write(flash, block + pos, todo, data);
+		if (ret)
+			return ret;
+		stats->programmed += todo;
+	}
+
+	return 0;
+}
+
+/* One erase block of an update, with what the block held before */
+struct spi_flash_update_block {
+	u32 addr;
+	u32 start;
+	u32 end;
+	const u8 *data;
+	u8 *old;
+	bool need_erase;
+};
+
+/* Set up the block holding offset, returning how many bytes it takes */
+static u32 spi_flash_update_setup(struct spi_flash_update_block *blk,
+				  u32 block_size, u32 offset, size_t len,
+				  const u8 *buf)
+{
+	blk->addr = offset - offset % block_size;
+	blk->start = offset - blk->addr;
+	blk->end = min_t(size_t, block_size, blk->start + len);
+	blk->data = buf;
+
+	return blk->end - blk->start;
+}
+
+/* Programming can only clear bits, anything else needs an erase */
+static bool spi_flash_update_need_erase(struct spi_flash_update_block *blk)
+{
+	u32 pos;
+
+	for (pos = blk->start; pos < blk->end; pos++) {
+		if ((blk->old[pos] & blk->data[pos - blk->start]) !=
+		    blk->data[pos - blk->start])
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Start erasing a block in the background, or erase it outright if the
+ * flash cannot do that. Returns 1 if the erase is left running.
+ */
+static int spi_flash_update_erase_start(struct spi_flash *flash, u32 addr,
+					u32 size)
+{
+	int ret;
+
+#ifdef CONFIG_DM_SPI_FLASH
+	ret = spi_flash_erase_start_dm(flash->dev, addr, size);
+#else
+	ret = spi_flash_async_erase_start(flash, addr, size);
+#endif
+	if (ret != -ENOSYS)
+		return ret ? ret : 1;
+
+	return spi_flash_erase(flash, addr, size);
+}
+
+static int spi_flash_update_erase_wait(struct spi_flash *flash)
+{
+	int ret;
+
+	do {
+#ifdef CONFIG_DM_SPI_FLASH
+		ret = spi_flash_erase_poll_dm(flash->dev);
+#else
+		ret = spi_flash_async_erase_poll(flash);
+#endif
+	} while (ret == -EBUSY);
+
+	return ret == -ENOSYS ? 0 : ret;
+}
+
+/*
+ * Read what the block holds and start erasing it if the new data needs
+ * that. What is kept around the new data is merged in while the erase
+ * runs. Returns 1 if the erase is left running.
+ */
+static int spi_flash_update_prepare(struct spi_flash *flash, u32 block_size,
+				    struct spi_flash_update_block *blk,
+				    struct spi_flash_update_stats *stats)
+{
+	int ret;
+
+	ret = spi_flash_read(flash, blk->addr, block_size, blk->old);
+	if (ret)
+		return ret;
+
+	blk->need_erase = spi_flash_update_need_erase(blk);
+	if (!blk->need_erase)
+		return 0;
+
+	debug("SF: update erases block %#x\n", blk->addr);
+	ret = spi_flash_update_erase_start(flash, blk->addr, block_size);
+	if (ret < 0)
+		return ret;
+	stats->erased += block_size;
+	memcpy(blk->old + blk->start, blk->data, blk->end - blk->start);
+
+	return ret;
+}
+
+/*
+ * Program the block once its erase is done. A verify is left to
+ * spi_flash_update_check(), so the pages are not read back one by one.
+ */
+static int spi_flash_update_program(struct spi_flash *flash, u32 block_size,
+				    struct spi_flash_update_block *blk,
+				    struct spi_flash_update_stats *stats)
+{
+#if CONFIG_IS_ENABLED(SPI_FLASH_VERIFY)
+	struct spi_flash_verify *verify = flash->verify;
+#endif
+	int ret;
+
+	ret = spi_flash_update_erase_wait(flash);
+	if (ret)
+		return ret;
+
+#if CONFIG_IS_ENABLED(SPI_FLASH_VERIFY)
+	flash->verify = NULL;
+#endif
+	if (blk->need_erase)
+		ret = spi_flash_update_pages(flash, blk->addr, blk->old, NULL,
+					     0, block_size, blk->start,
+					     blk->end, stats);
+	else
+		ret = spi_flash_update_pages(flash, blk->addr, blk->data,
+					     blk->old, blk->start, blk->end,
+					     blk->start, blk->end, stats);
+#if CONFIG_IS_ENABLED(SPI_FLASH_VERIFY)
+	flash->verify = verify;
+#endif
+
+	return ret;
+}
+
+#if CONFIG_IS_ENABLED(SPI_FLASH_VERIFY)
+/*
+ * Read back a programmed block: all of it if it was erased, else just the
+ * new data. spi_flash_update_check() then compares it
+ */
+static int spi_flash_update_read_back(struct spi_flash *flash,
+				      u32 block_size,
+				      struct spi_flash_update_block *blk,
+				      u8 *readback)
+{
+	if (blk->need_erase)
+		return spi_flash_read(flash, blk->addr, block_size, readback);
+
+	return spi_flash_read(flash, blk->addr + blk->start,
+			      blk->end - blk->start, readback + blk->start);
+}
+
+static int spi_flash_update_check(struct spi_flash *flash, u32 block_size,
+				  struct spi_flash_update_block *blk,
+				  const u8 *readback)
+{
+	if (blk->need_erase)
+		return spi_flash_verify_data(flash, blk->addr, readback,
+					     blk->old, block_size);
+
+	return spi_flash_verify_data(flash, blk->addr + blk->start,
+				     readback + blk->start, blk->data,
+				     blk->end - blk->start);
+}
+#endif
+
+/*
+ * Blocks go through a two-stage pipeline. Once a block is programmed and
+ * read back, the next block is read and its erase started. The block just
+ * programmed is then compared with what was read back, and checksummed,
+ * while the flash erases the next one.
+ */
+int spi_flash_update(struct spi_flash *flash, u32 offset, size_t len,
+		     const void *buf, struct spi_flash_update_stats *stats)
+{
+	struct spi_flash_update_stats local_stats;
+	struct spi_flash_update_block blks[2], *blk, *next;
+	u32 block_size, todo;
+	__maybe_unused u8 *readback;
+	u8 *cmp_buf;
+	int ret, err;
+
+	if (!stats) {
+		memset(&local_stats, '\0', sizeof(local_stats));
+		stats = &local_stats;
+	}
+	if (!len)
+		return 0;
+
+	block_size = spi_flash_update_block_size(flash);
+	cmp_buf = memalign(ARCH_DMA_MINALIGN,
+			   block_size * (spi_flash_verifying(flash) ? 3 : 2));
+	if (!cmp_buf)
+		return -ENOMEM;
+	blks[0].old = cmp_buf;
+	blks[1].old = cmp_buf + block_size;
+	readback = cmp_buf + block_size * 2;
+
+	blk = &blks[0];
+	todo = spi_flash_update_setup(blk, block_size, offset, len, buf);
+	ret = spi_flash_update_prepare(flash, block_size, blk, stats);
+
+	while (ret >= 0) {
+		ret = spi_flash_update_program(flash, block_size, blk, stats);
+#if CONFIG_IS_ENABLED(SPI_FLASH_VERIFY)
+		if (!ret && flash->verify)
+			ret = spi_flash_update_read_back(flash, block_size, blk,
+							 readback);
+#endif
+		if (ret)
+			break;
+
+		stats->done += todo;
+		if (stats->progress)
+			stats->progress(stats);
+		offset += todo;
+		buf += todo;
+		len -= todo;
+		next = NULL;
+		if (len) {
+			next = blk == &blks[0] ? &blks[1] : &blks[0];
+			todo = spi_flash_update_setup(next, block_size, offset,
+						      len, buf);
+			ret = spi_flash_update_prepare(flash, block_size, next,
+						       stats);
+			if (ret < 0)
+				break;
+			if (ret)
+				stats->erased_ahead += block_size;
+		}
+
+#if CONFIG_IS_ENABLED(SPI_FLASH_VERIFY)
+		if (flash->verify) {
+			ret = spi_flash_update_check(flash, block_size, blk,
+						     readback);
+			if (ret)
+				break;
+		}
+#endif
+		if (!next)
+			break;
+		blk = next;
+	}
+
+	/* Do not leave an erase running, whatever happened */
+	err = spi_flash_update_erase_wait(flash);
+	if (!ret)
+		ret = err;
+	free(cmp_buf);
+
+	return ret;
+}
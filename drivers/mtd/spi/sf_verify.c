@@ -0,0 +1,143 @@
+/*
+ * SPI flash verify-after-write, with a checksum of what was written
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <malloc.h>
+#include <spi_flash.h>
+#include <u-boot/crc.h>
+#include <u-boot/sha256.h>
+#include <asm/unaligned.h>
+
+#include "sf_internal.h"
+
+int spi_flash_verify_begin(struct spi_flash *flash,
+			   struct spi_flash_verify *verify,
+			   enum spi_flash_verify_algo algo, u32 offset,
+			   size_t len)
+{
+	if (flash->verify)
+		return -EBUSY;
+
+	memset(verify, '\0', sizeof(*verify));
+	switch (algo) {
+	case SPI_FLASH_VERIFY_NONE:
+		break;
+	case SPI_FLASH_VERIFY_CRC32:
+		verify->crc32 = crc32(0, NULL, 0);
+		break;
+#ifdef CONFIG_SHA256
+	case SPI_FLASH_VERIFY_SHA256:
+		sha256_starts(&verify->sha256);
+		break;
+#endif
+	default:
+		return -EPROTONOSUPPORT;
+	}
+
+	verify->buf = malloc(flash->page_size);
+	if (!verify->buf)
+		return -ENOMEM;
+	verify->algo = algo;
+	verify->pos = offset;
+	verify->end = offset + len;
+	flash->verify = verify;
+
+	return 0;
+}
+
+int spi_flash_verify_end(struct spi_flash *flash,
+			 struct spi_flash_verify *verify)
+{
+	flash->verify = NULL;
+	free(verify->buf);
+	verify->buf = NULL;
+
+	switch (verify->algo) {
+	case SPI_FLASH_VERIFY_NONE:
+		break;
+	case SPI_FLASH_VERIFY_CRC32:
+		put_unaligned_be32(verify->crc32, verify->digest);
+		verify->digest_len = sizeof(verify->crc32);
+		break;
+#ifdef CONFIG_SHA256
+	case SPI_FLASH_VERIFY_SHA256:
+		sha256_finish(&verify->sha256, verify->digest);
+		verify->digest_len = SHA256_SUM_LEN;
+		break;
+#endif
+	}
+
+	if (verify->pos != verify->end) {
+		debug("SF: verify stopped at %#x of %#x\n", verify->pos,
+		      verify->end);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/* Checksum the bytes which carry on from where the checksum got to */
+static void spi_flash_verify_sum(struct spi_flash_verify *verify, u32 offset,
+				 const u8 *data, size_t len)
+{
+	u32 skip;
+
+	if (offset > verify->pos || offset + len <= verify->pos)
+		return;
+	skip = verify->pos - offset;
+	data += skip;
+	len = min_t(size_t, len - skip, verify->end - verify->pos);
+
+	switch (verify->algo) {
+	case SPI_FLASH_VERIFY_NONE:
+		break;
+	case SPI_FLASH_VERIFY_CRC32:
+		verify->crc32 = crc32(verify->crc32, data, len);
+		break;
+#ifdef CONFIG_SHA256
+	case SPI_FLASH_VERIFY_SHA256:
+		sha256_update(&verify->sha256, data, len);
+		break;
+#endif
+	}
+	verify->pos += len;
+}
+
+int spi_flash_verify_data(struct spi_flash *flash, u32 offset,
+			  const void *readback, const void *buf, size_t len)
+{
+	struct spi_flash_verify *verify = flash->verify;
+
+	if (memcmp(readback, buf, len)) {
+		printf("SF: verify failed in %zu bytes at %#x\n", len, offset);
+		return -EIO;
+	}
+	spi_flash_verify_sum(verify, offset, readback, len);
+
+	return 0;
+}
+
+int spi_flash_verify_range(struct spi_flash *flash, u32 offset, size_t len,
+			   const void *buf)
+{
+	struct spi_flash_verify *verify = flash->verify;
+	size_t todo;
+	int ret;
+
+	for (; len; len -= todo, offset += todo, buf += todo) {
+		todo = min_t(size_t, len, flash->page_size);
+		ret = spi_flash_read(flash, offset, todo, verify->buf);
+		if (ret)
+			return ret;
+		ret = spi_flash_verify_data(flash, offset, verify->buf, buf,
+					    todo);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
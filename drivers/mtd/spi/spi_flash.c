@@ -14,6 +14,7 @@
 #include <malloc.h>
 #include <mapmem.h>
 #include <spi.h>
+#include <spi-mem.h>
 #include <spi_flash.h>
 #include <linux/log2.h>
 #include <dma.h>
@@ -22,12 +23,66 @@
 
 DECLARE_GLOBAL_DATA_PTR;
 
-static void spi_flash_addr(u32 addr, u8 *cmd)
+/* Lines used by the address and data phases of a read or program opcode */
+static void spi_flash_op_buswidths(u8 opcode, u8 *addr_bw, u8 *data_bw)
 {
-	/* cmd[0] is actual command */
-	cmd[1] = addr >> 16;
-	cmd[2] = addr >> 8;
-	cmd[3] = addr >> 0;
+	switch (opcode) {
+	case CMD_READ_DUAL_OUTPUT_FAST:
+	case CMD_READ_DUAL_OUTPUT_FAST_4B:
+		*addr_bw = 1;
+		*data_bw = 2;
+		break;
+	case CMD_READ_DUAL_IO_FAST:
+	case CMD_READ_DUAL_IO_FAST_4B:
+		*addr_bw = 2;
+		*data_bw = 2;
+		break;
+	case CMD_READ_QUAD_OUTPUT_FAST:
+	case CMD_READ_QUAD_OUTPUT_FAST_4B:
+	case CMD_QUAD_PAGE_PROGRAM:
+	case CMD_QUAD_PAGE_PROGRAM_4B:
+		*addr_bw = 1;
+		*data_bw = 4;
+		break;
+	case CMD_READ_QUAD_IO_FAST:
+	case CMD_READ_QUAD_IO_FAST_4B:
+		*addr_bw = 4;
+		*data_bw = 4;
+		break;
+	default:
+		*addr_bw = 1;
+		*data_bw = 1;
+	}
+}
+
+/* Set up an operation for opcode at addr, sending data if there is any */
+static void spi_flash_op_init(struct spi_flash *flash, struct spi_mem_op *op,
+			      u8 opcode, u32 addr)
+{
+	u8 addr_bw, data_bw;
+
+	spi_flash_op_buswidths(opcode, &addr_bw, &data_bw);
+	memset(op, '\0', sizeof(*op));
+	op->cmd.opcode = opcode;
+	op->cmd.buswidth = 1;
+	op->addr.nbytes = flash->addr_width;
+	op->addr.buswidth = addr_bw;
+	op->addr.val = addr;
+	op->data.buswidth = data_bw;
+	op->data.dir = SPI_MEM_DATA_OUT;
+}
+
+/* Set up a read of len bytes at addr into buf with the flash's read_cmd */
+static void spi_flash_read_op_init(struct spi_flash *flash,
+				   struct spi_mem_op *op, u32 addr,
+				   void *buf, size_t len)
+{
+	spi_flash_op_init(flash, op, flash->read_cmd, addr);
+	op->dummy.nbytes = flash->dummy_byte;
+	op->dummy.buswidth = op->addr.buswidth;
+	op->data.dir = SPI_MEM_DATA_IN;
+	op->data.nbytes = len;
+	op->data.buf.in = buf;
 }
 
 static int read_sr(struct spi_flash *flash, u8 *rs)
@@ -229,12 +284,42 @@ static int spi_flash_ready(struct spi_flash *flash)
 	return sr && fsr;
 }
 
+/*
+ * Let the controller poll the status in hardware, if it can. Returns
+ * -ENOSYS if the polling has to be done here instead.
+ */
+static int spi_flash_hw_wait_till_ready(struct spi_flash *flash,
+					unsigned long timeout)
+{
+#ifdef CONFIG_DM_SPI
+	struct udevice *dev = flash->spi->dev;
+	int ret;
+
+	ret = dm_spi_wait_status(dev, CMD_READ_STATUS, STATUS_WIP, 0,
+				 timeout);
+	if (ret || !(flash->flags & SNOR_F_USE_FSR))
+		return ret;
+
+	return dm_spi_wait_status(dev, CMD_FLAG_STATUS, STATUS_PEC, STATUS_PEC,
+				  timeout);
+#else
+	return -ENOSYS;
+#endif
+}
+
 static int spi_flash_wait_till_ready(struct spi_flash *flash,
 				     unsigned long timeout)
 {
 	unsigned long timebase;
 	int ret;
 
+	ret = spi_flash_hw_wait_till_ready(flash, timeout);
+	if (ret != -ENOSYS) {
+		if (ret == -ETIMEDOUT)
+			printf("SF: Timeout!\n");
+		return ret;
+	}
+
 	timebase = get_timer(0);
 
 	while (get_timer(timebase) < timeout) {
@@ -250,15 +335,60 @@ static int spi_flash_wait_till_ready(struct spi_flash *flash,
 	return -ETIMEDOUT;
 }
 
-int spi_flash_write_common(struct spi_flash *flash, const u8 *cmd,
-		size_t cmd_len, const void *buf, size_t buf_len)
+/*
+ * Wait for a page program with the bus claimed. Without a hardware poller
+ * in the controller, the first poll comes once most of the usual program
+ * time has passed, then polls back off to a quarter of it, so the bus is
+ * not hammered with status reads. The usual time starts from the typical
+ * one found at probe and is learnt as pages complete.
+ */
+static int spi_flash_wait_prog(struct spi_flash *flash,
+			       struct spi_flash_write_stats *stats)
 {
-	struct spi_slave *spi = flash->spi;
-	unsigned long timeout = SPI_FLASH_PROG_TIMEOUT;
+	ulong start = timer_get_us();
+	ulong timebase = get_timer(0);
+	u32 delay, elapsed;
 	int ret;
 
-	if (buf == NULL)
-		timeout = SPI_FLASH_PAGE_ERASE_TIMEOUT;
+	ret = spi_flash_hw_wait_till_ready(flash, SPI_FLASH_PROG_TIMEOUT);
+	if (ret != -ENOSYS) {
+		if (ret == -ETIMEDOUT)
+			printf("SF: Timeout!\n");
+		return ret;
+	}
+
+	delay = flash->prog_time_us * 3 / 4;
+	for (;;) {
+		if (delay)
+			udelay(delay);
+
+		stats->polls++;
+		ret = spi_flash_ready(flash);
+		if (ret < 0)
+			return ret;
+		if (ret)
+			break;
+
+		if (get_timer(timebase) >= SPI_FLASH_PROG_TIMEOUT) {
+			printf("SF: Timeout!\n");
+			return -ETIMEDOUT;
+		}
+		delay = clamp_t(u32, delay * 2, 1,
+				max_t(u32, flash->prog_time_us / 4, 1));
+	}
+
+	elapsed = timer_get_us() - start;
+	flash->prog_time_us = (flash->prog_time_us * 7 + elapsed) / 8;
+
+	return 0;
+}
+
+static int spi_flash_write_wait(struct spi_flash *flash,
+				const struct spi_mem_op *op,
+				unsigned long timeout)
+{
+	struct spi_slave *spi = flash->spi;
+	int ret;
 
 	ret = spi_claim_bus(spi);
 	if (ret) {
@@ -272,7 +402,7 @@ int spi_flash_write_common(struct spi_flash *flash, const u8 *cmd,
 		return ret;
 	}
 
-	ret = spi_flash_cmd_write(spi, cmd, cmd_len, buf, buf_len);
+	ret = spi_mem_exec_op(spi, op);
 	if (ret < 0) {
 		debug("SF: write cmd failed\n");
 		return ret;
@@ -281,24 +411,159 @@ int spi_flash_write_common(struct spi_flash *flash, const u8 *cmd,
 	ret = spi_flash_wait_till_ready(flash, timeout);
 	if (ret < 0) {
 		debug("SF: write %s timed out\n",
-		      timeout == SPI_FLASH_PROG_TIMEOUT ?
-			"program" : "page erase");
+		      op->data.nbytes ? "program" : "erase");
+		return ret;
+	}
+
+	spi_release_bus(spi);
+
+	return ret;
+}
+
+/* The bytes after the opcode are sent as a single-line address */
+int spi_flash_write_common(struct spi_flash *flash, const u8 *cmd,
+		size_t cmd_len, const void *buf, size_t buf_len)
+{
+	struct spi_mem_op op = SPI_MEM_OP(SPI_MEM_OP_CMD(cmd[0], 1),
+					  SPI_MEM_OP_ADDR(cmd_len - 1, 0, 1),
+					  SPI_MEM_OP_NO_DUMMY,
+					  SPI_MEM_OP_DATA_OUT(buf_len, buf, 1));
+	unsigned long timeout = SPI_FLASH_PROG_TIMEOUT;
+	size_t i;
+
+	for (i = 1; i < cmd_len; i++)
+		op.addr.val = op.addr.val << 8 | cmd[i];
+
+	if (buf == NULL)
+		timeout = SPI_FLASH_PAGE_ERASE_TIMEOUT;
+
+	return spi_flash_write_wait(flash, &op, timeout);
+}
+
+/* Pick the largest erase command which fits at offset, NULL if none does */
+static struct spi_flash_erase_type *
+spi_flash_erase_type(struct spi_flash *flash, u32 offset, size_t len)
+{
+	struct spi_flash_erase_type *type;
+	int i;
+
+	for (i = SPI_FLASH_MAX_ERASE_TYPES - 1; i >= 0; i--) {
+		type = &flash->erase_types[i];
+		if (type->size && type->size <= len && !(offset % type->size))
+			return type;
+	}
+
+	return NULL;
+}
+
+/* Send a write-enabled command, leaving the flash to complete it */
+static int spi_flash_write_start(struct spi_flash *flash,
+				 const struct spi_mem_op *op)
+{
+	struct spi_slave *spi = flash->spi;
+	int ret;
+
+	ret = spi_claim_bus(spi);
+	if (ret) {
+		debug("SF: unable to claim SPI bus\n");
 		return ret;
 	}
 
+	ret = spi_flash_cmd_write_enable(flash);
+	if (!ret)
+		ret = spi_mem_exec_op(spi, op);
 	spi_release_bus(spi);
+	if (ret < 0)
+		debug("SF: write cmd failed\n");
 
 	return ret;
 }
 
+int spi_flash_wait_ready(struct spi_flash *flash, unsigned long timeout)
+{
+	struct spi_slave *spi = flash->spi;
+	int ret;
+
+	ret = spi_claim_bus(spi);
+	if (ret) {
+		debug("SF: unable to claim SPI bus\n");
+		return ret;
+	}
+
+	ret = spi_flash_wait_till_ready(flash, timeout);
+	spi_release_bus(spi);
+
+	return ret;
+}
+
+int spi_flash_erase_start(struct spi_flash *flash, u32 offset, size_t len,
+			  unsigned long *timeoutp)
+{
+	struct spi_mem_op chip_op =
+		SPI_MEM_OP(SPI_MEM_OP_CMD(CMD_ERASE_CHIP, 1), SPI_MEM_OP_NO_ADDR,
+			   SPI_MEM_OP_NO_DUMMY, SPI_MEM_OP_NO_DATA);
+	struct spi_flash_erase_type *type;
+	struct spi_mem_op op;
+	u32 erase_addr;
+	int ret;
+
+	if (flash->dual_flash == SF_SINGLE_FLASH && !offset &&
+	    len == flash->size) {
+		debug("SF: erase chip\n");
+		ret = spi_flash_write_start(flash, &chip_op);
+		if (ret < 0)
+			return ret;
+		flash->erase_chip_count++;
+		*timeoutp = SPI_FLASH_CHIP_ERASE_TIMEOUT(flash->size);
+
+		return flash->size;
+	}
+
+	type = spi_flash_erase_type(flash, offset, len);
+	if (!type)
+		return -EINVAL;
+	erase_addr = offset;
+
+#ifdef CONFIG_SF_DUAL_FLASH
+	if (flash->dual_flash > SF_SINGLE_FLASH)
+		spi_flash_dual(flash, &erase_addr);
+#endif
+#ifdef CONFIG_SPI_FLASH_BAR
+	if (flash->addr_width == SPI_FLASH_3B_ADDR_LEN) {
+		ret = write_bar(flash, erase_addr);
+		if (ret < 0)
+			return ret;
+	}
+#endif
+	spi_flash_op_init(flash, &op, type->opcode, erase_addr);
+
+	debug("SF: erase %2x (%x)\n", type->opcode, erase_addr);
+
+	ret = spi_flash_write_start(flash, &op);
+	if (ret < 0)
+		return ret;
+	type->count++;
+	*timeoutp = type->size > 4096 << flash->shift ?
+		    SPI_FLASH_SECTOR_ERASE_TIMEOUT :
+		    SPI_FLASH_PAGE_ERASE_TIMEOUT;
+
+	return type->size;
+}
+
+/*
+ * Erase the range with as few commands as possible: the largest erase
+ * command that is aligned and fits is used at each step, so small erases
+ * only appear at the unaligned edges. A whole single flash is erased with
+ * one chip erase.
+ */
 int spi_flash_cmd_erase_ops(struct spi_flash *flash, u32 offset, size_t len)
 {
-	u32 erase_size, erase_addr;
-	u8 cmd[SPI_FLASH_CMD_LEN];
-	int ret = -1;
+	unsigned long timeout;
+	u32 min_size, size;
+	int i, ret = -1;
 
-	erase_size = flash->erase_size;
-	if (offset % erase_size || len % erase_size) {
+	min_size = flash->erase_types[0].size;
+	if (!min_size || offset % min_size || len % min_size) {
 		debug("SF: Erase offset/length not multiple of erase size\n");
 		return -1;
 	}
@@ -311,48 +576,340 @@ int spi_flash_cmd_erase_ops(struct spi_flash *flash, u32 offset, size_t len)
 		}
 	}
 
-	cmd[0] = flash->erase_cmd;
-	while (len) {
-		erase_addr = offset;
+	for (i = 0; i < SPI_FLASH_MAX_ERASE_TYPES; i++)
+		flash->erase_types[i].count = 0;
+	flash->erase_chip_count = 0;
+	spi_mem_dirmap_invalidate(flash->dirmap);
 
-#ifdef CONFIG_SF_DUAL_FLASH
-		if (flash->dual_flash > SF_SINGLE_FLASH)
-			spi_flash_dual(flash, &erase_addr);
-#endif
-#ifdef CONFIG_SPI_FLASH_BAR
-		ret = write_bar(flash, erase_addr);
+	while (len) {
+		ret = spi_flash_erase_start(flash, offset, len, &timeout);
 		if (ret < 0)
-			return ret;
-#endif
-		spi_flash_addr(erase_addr, cmd);
-
-		debug("SF: erase %2x %2x %2x %2x (%x)\n", cmd[0], cmd[1],
-		      cmd[2], cmd[3], erase_addr);
+			break;
+		size = ret;
 
-		ret = spi_flash_write_common(flash, cmd, sizeof(cmd), NULL, 0);
+		ret = spi_flash_wait_ready(flash, timeout);
 		if (ret < 0) {
 			debug("SF: erase failed\n");
 			break;
 		}
 
-		offset += erase_size;
-		len -= erase_size;
+		offset += size;
+		len -= size;
 	}
 
 	return ret;
 }
 
+/*
+ * Background erase. Blocks are started one at a time as the erase is
+ * polled, so the flash can be used between blocks, and the block in flight
+ * can be suspended on flashes which support it.
+ */
+int spi_flash_async_erase_start(struct spi_flash *flash, u32 offset,
+				size_t len)
+{
+	struct spi_flash_async_erase *job = &flash->async_erase;
+	u32 min_size = flash->erase_types[0].size;
+	int i, ret;
+
+	if (job->len)
+		return -EBUSY;
+	if (!len || !min_size || offset % min_size || len % min_size) {
+		debug("SF: Erase offset/length not multiple of erase size\n");
+		return -EINVAL;
+	}
+	if (flash->flash_is_locked &&
+	    flash->flash_is_locked(flash, offset, len) > 0) {
+		printf("offset 0x%x is protected and cannot be erased\n",
+		       offset);
+		return -EINVAL;
+	}
+
+	for (i = 0; i < SPI_FLASH_MAX_ERASE_TYPES; i++)
+		flash->erase_types[i].count = 0;
+	flash->erase_chip_count = 0;
+	memset(job, '\0', sizeof(*job));
+	job->offset = offset;
+	job->len = len;
+
+	ret = spi_flash_async_erase_poll(flash);
+
+	return ret == -EBUSY ? 0 : ret;
+}
+
+/* Check whether the flash has finished the block in flight */
+static int spi_flash_async_erase_busy(struct spi_flash *flash)
+{
+	struct spi_flash_async_erase *job = &flash->async_erase;
+	int ret;
+
+	ret = spi_claim_bus(flash->spi);
+	if (ret) {
+		debug("SF: unable to claim SPI bus\n");
+		return ret;
+	}
+	ret = spi_flash_ready(flash);
+	spi_release_bus(flash->spi);
+	if (ret < 0)
+		return ret;
+	if (!ret) {
+		if (get_timer(job->timebase) < job->timeout)
+			return 1;
+		printf("SF: Timeout!\n");
+		return -ETIMEDOUT;
+	}
+
+	return 0;
+}
+
+/* Account for a finished block; returns true if that was the last one */
+static bool spi_flash_async_erase_done(struct spi_flash *flash)
+{
+	struct spi_flash_async_erase *job = &flash->async_erase;
+
+	job->offset += job->block;
+	job->len -= job->block;
+	job->block = 0;
+	spi_mem_dirmap_invalidate(flash->dirmap);
+
+	return !job->len;
+}
+
+int spi_flash_async_erase_poll(struct spi_flash *flash)
+{
+	struct spi_flash_async_erase *job = &flash->async_erase;
+	int ret;
+
+	if (!job->len)
+		return 0;
+	if (job->suspended)
+		return -EBUSY;
+
+	if (job->block) {
+		ret = spi_flash_async_erase_busy(flash);
+		if (ret)
+			goto out;
+		if (spi_flash_async_erase_done(flash))
+			return 0;
+	}
+
+	ret = spi_flash_erase_start(flash, job->offset, job->len,
+				    &job->timeout);
+	if (ret < 0)
+		goto out;
+	job->block = ret;
+	job->timebase = get_timer(0);
+	job->resume_us = timer_get_us();
+	spi_mem_dirmap_invalidate(flash->dirmap);
+	ret = 1;
+
+out:
+	if (ret > 0)
+		return -EBUSY;
+	debug("SF: background erase failed at %x: %d\n", job->offset, ret);
+	job->len = 0;
+	job->block = 0;
+
+	return ret;
+}
+
+int spi_flash_async_erase_hold(struct spi_flash *flash, u32 offset,
+			       size_t len)
+{
+	struct spi_flash_async_erase *job = &flash->async_erase;
+	struct spi_slave *spi = flash->spi;
+	ulong ran_us;
+	int ret;
+
+	if (!job->len || job->suspended)
+		return 0;
+	if (!job->block) {
+		job->suspended = true;
+		return 0;
+	}
+
+	/* Data in the block itself is not readable until it is erased */
+	if (!(flash->flags & SNOR_F_ERASE_SUSP) || job->block == flash->size ||
+	    (offset < job->offset + job->block && offset + len > job->offset)) {
+		ret = spi_flash_wait_ready(flash, job->timeout);
+		if (ret)
+			return ret;
+		job->suspended = true;
+		if (spi_flash_async_erase_done(flash))
+			job->suspended = false;
+		return 0;
+	}
+
+	/* Let the erase get somewhere between a resume and a suspend */
+	ran_us = timer_get_us() - job->resume_us;
+	if (ran_us < SPI_FLASH_RESUME_RUN_US)
+		udelay(SPI_FLASH_RESUME_RUN_US - ran_us);
+
+	ret = spi_claim_bus(spi);
+	if (ret) {
+		debug("SF: unable to claim SPI bus\n");
+		return ret;
+	}
+	ret = spi_flash_cmd(spi, CMD_ERASE_SUSPEND, NULL, 0);
+	if (!ret)
+		ret = spi_flash_wait_till_ready(flash,
+						SPI_FLASH_SUSPEND_TIMEOUT);
+	spi_release_bus(spi);
+	if (ret) {
+		debug("SF: erase suspend failed: %d\n", ret);
+		return ret;
+	}
+	/* Keep the time used so far, so the suspension does not count */
+	job->timebase = get_timer(job->timebase);
+	job->suspended = true;
+	debug("SF: erase suspended at %x\n", job->offset);
+
+	return 0;
+}
+
+int spi_flash_async_erase_suspend(struct spi_flash *flash)
+{
+	return spi_flash_async_erase_hold(flash, 0, 0);
+}
+
+int spi_flash_async_erase_resume(struct spi_flash *flash)
+{
+	struct spi_flash_async_erase *job = &flash->async_erase;
+	int ret;
+
+	if (!job->suspended)
+		return 0;
+
+	if (job->block) {
+		ret = spi_claim_bus(flash->spi);
+		if (ret) {
+			debug("SF: unable to claim SPI bus\n");
+			return ret;
+		}
+		ret = spi_flash_cmd(flash->spi, CMD_ERASE_RESUME, NULL, 0);
+		spi_release_bus(flash->spi);
+		if (ret) {
+			debug("SF: erase resume failed: %d\n", ret);
+			return ret;
+		}
+		/* Count from the time used before the suspension */
+		job->timebase = get_timer(job->timebase);
+		job->resume_us = timer_get_us();
+		debug("SF: erase resumed at %x\n", job->offset);
+	}
+	job->suspended = false;
+
+	return 0;
+}
+
+int spi_flash_async_erase_abort(struct spi_flash *flash)
+{
+	struct spi_flash_async_erase *job = &flash->async_erase;
+	int ret = 0;
+
+	if (!job->len)
+		return 0;
+
+	ret = spi_flash_async_erase_resume(flash);
+	if (!ret && job->block)
+		ret = spi_flash_wait_ready(flash, job->timeout);
+	spi_mem_dirmap_invalidate(flash->dirmap);
+	job->len = 0;
+	job->block = 0;
+
+	return ret;
+}
+
+int spi_flash_program_start(struct spi_flash *flash, u32 offset, size_t len,
+			    const void *buf)
+{
+	struct spi_mem_op op;
+	size_t chunk_len;
+	int ret;
+
+	chunk_len = min(len, (size_t)(flash->page_size -
+				      offset % flash->page_size));
+	if (flash->spi->max_write_size)
+		chunk_len = min(chunk_len, (size_t)flash->spi->max_write_size);
+
+#ifdef CONFIG_SPI_FLASH_BAR
+	if (flash->addr_width == SPI_FLASH_3B_ADDR_LEN) {
+		ret = write_bar(flash, offset);
+		if (ret < 0)
+			return ret;
+	}
+#endif
+	spi_flash_op_init(flash, &op, flash->write_cmd, offset);
+	op.data.nbytes = chunk_len;
+	op.data.buf.out = buf;
+
+	ret = spi_flash_write_start(flash, &op);
+	if (ret < 0)
+		return ret;
+
+	return chunk_len;
+}
+
+#if CONFIG_IS_ENABLED(SPI_FLASH_VERIFY)
+/*
+ * Read back a page just programmed, with the bus still claimed, and check
+ * it. The memory-mapped window is quicker where there is one. A direct
+ * mapping claims the bus itself, so it is called with the bus released
+ */
+static int spi_flash_write_verify(struct spi_flash *flash, u32 offset,
+				  u32 write_addr, const void *buf, size_t len)
+{
+	struct spi_slave *spi = flash->spi;
+	u8 *readback = flash->verify->buf;
+	struct spi_mem_op op;
+	int ret;
+
+	if (flash->memory_map) {
+		spi_xfer(spi, 0, NULL, NULL, SPI_XFER_MMAP);
+		spi_flash_copy_mmap(readback, flash->memory_map + offset, len);
+		spi_xfer(spi, 0, NULL, NULL, SPI_XFER_MMAP_END);
+	} else if (flash->dirmap) {
+		/*
+		 * The window shows the page as it was before it was programmed.
+		 * The read through it has a claim of its own, as in
+		 * spi_flash_cmd_read_ops(), so the caller releases the bus
+		 */
+		spi_mem_dirmap_invalidate(flash->dirmap);
+		ret = spi_claim_bus(spi);
+		if (ret) {
+			debug("SF: unable to claim SPI bus\n");
+			return ret;
+		}
+		ret = spi_mem_dirmap_read(flash->dirmap, offset, len, readback);
+		spi_release_bus(spi);
+		if (ret)
+			return ret;
+	} else {
+		spi_flash_read_op_init(flash, &op, write_addr, readback, len);
+		ret = spi_mem_exec_op(spi, &op);
+		if (ret < 0)
+			return ret;
+	}
+
+	return spi_flash_verify_data(flash, offset, readback, buf, len);
+}
+#endif
+
+/* Program page by page, with the bus claimed once for the whole operation */
 int spi_flash_cmd_write_ops(struct spi_flash *flash, u32 offset,
 		size_t len, const void *buf)
 {
 	struct spi_slave *spi = flash->spi;
+	struct spi_flash_write_stats *stats = &flash->write_stats;
 	unsigned long byte_addr, page_size;
+	ulong start = timer_get_us();
 	u32 write_addr;
 	size_t chunk_len, actual;
-	u8 cmd[SPI_FLASH_CMD_LEN];
-	int ret = -1;
+	struct spi_mem_op op;
+	int ret = 0;
 
 	page_size = flash->page_size;
+	memset(stats, '\0', sizeof(*stats));
 
 	if (flash->flash_is_locked) {
 		if (flash->flash_is_locked(flash, offset, len) > 0) {
@@ -362,7 +919,13 @@ int spi_flash_cmd_write_ops(struct spi_flash *flash, u32 offset,
 		}
 	}
 
-	cmd[0] = flash->write_cmd;
+	spi_mem_dirmap_invalidate(flash->dirmap);
+	ret = spi_claim_bus(spi);
+	if (ret) {
+		debug("SF: unable to claim SPI bus\n");
+		return ret;
+	}
+
 	for (actual = 0; actual < len; actual += chunk_len) {
 		write_addr = offset;
 
@@ -371,9 +934,20 @@ int spi_flash_cmd_write_ops(struct spi_flash *flash, u32 offset,
 			spi_flash_dual(flash, &write_addr);
 #endif
 #ifdef CONFIG_SPI_FLASH_BAR
-		ret = write_bar(flash, write_addr);
-		if (ret < 0)
-			return ret;
+		/* A bank switch is a write of its own, with its own claim */
+		if (flash->addr_width == SPI_FLASH_3B_ADDR_LEN &&
+		    write_addr / (SPI_FLASH_16MB_BOUN << flash->shift) !=
+		    flash->bank_curr) {
+			spi_release_bus(spi);
+			ret = write_bar(flash, write_addr);
+			if (ret < 0)
+				return ret;
+			ret = spi_claim_bus(spi);
+			if (ret) {
+				debug("SF: unable to claim SPI bus\n");
+				return ret;
+			}
+		}
 #endif
 		byte_addr = offset % page_size;
 		chunk_len = min(len - actual, (size_t)(page_size - byte_addr));
@@ -382,21 +956,59 @@ int spi_flash_cmd_write_ops(struct spi_flash *flash, u32 offset,
 			chunk_len = min(chunk_len,
 					(size_t)spi->max_write_size);
 
-		spi_flash_addr(write_addr, cmd);
+		spi_flash_op_init(flash, &op, flash->write_cmd, write_addr);
+		op.data.nbytes = chunk_len;
+		op.data.buf.out = buf + actual;
 
-		debug("SF: 0x%p => cmd = { 0x%02x 0x%02x%02x%02x } chunk_len = %zu\n",
-		      buf + actual, cmd[0], cmd[1], cmd[2], cmd[3], chunk_len);
+		debug("SF: 0x%p => cmd = { 0x%02x 0x%08x } chunk_len = %zu\n",
+		      buf + actual, flash->write_cmd, write_addr, chunk_len);
+
+		ret = spi_flash_cmd_write_enable(flash);
+		if (ret < 0) {
+			debug("SF: enabling write failed\n");
+			break;
+		}
 
-		ret = spi_flash_write_common(flash, cmd, sizeof(cmd),
-					buf + actual, chunk_len);
+		ret = spi_mem_exec_op(spi, &op);
 		if (ret < 0) {
 			debug("SF: write failed\n");
 			break;
 		}
+		stats->pages++;
+
+		ret = spi_flash_wait_prog(flash, stats);
+		if (ret < 0) {
+			debug("SF: write program timed out\n");
+			break;
+		}
+
+#if CONFIG_IS_ENABLED(SPI_FLASH_VERIFY)
+		if (flash->verify) {
+			/* Like a bank switch, a window read has its own claim */
+			if (flash->dirmap)
+				spi_release_bus(spi);
+			ret = spi_flash_write_verify(flash, offset, write_addr,
+						     buf + actual, chunk_len);
+			if (flash->dirmap) {
+				if (ret < 0)
+					return ret;
+				ret = spi_claim_bus(spi);
+				if (ret) {
+					debug("SF: unable to claim SPI bus\n");
+					return ret;
+				}
+			}
+			if (ret < 0)
+				break;
+		}
+#endif
 
 		offset += chunk_len;
 	}
 
+	spi_release_bus(spi);
+	stats->time_us = timer_get_us() - start;
+
 	return ret;
 }
 
@@ -429,18 +1041,14 @@ int spi_flash_read_common(struct spi_flash *flash, const u8 *cmd,
  */
 void __weak spi_flash_copy_mmap(void *data, void *offset, size_t len)
 {
-#ifdef CONFIG_DMA
-	if (!dma_memcpy(data, offset, len))
-		return;
-#endif
-	memcpy(data, offset, len);
+	dma_mmap_copy(data, offset, len);
 }
 
 int spi_flash_cmd_read_ops(struct spi_flash *flash, u32 offset,
 		size_t len, void *data)
 {
 	struct spi_slave *spi = flash->spi;
-	u8 *cmd, cmdsz;
+	struct spi_mem_op op;
 	u32 remain_len, read_len, read_addr;
 	int bank_sel = 0;
 	int ret = -1;
@@ -459,14 +1067,18 @@ int spi_flash_cmd_read_ops(struct spi_flash *flash, u32 offset,
 		return 0;
 	}
 
-	cmdsz = SPI_FLASH_CMD_LEN + flash->dummy_byte;
-	cmd = calloc(1, cmdsz);
-	if (!cmd) {
-		debug("SF: Failed to allocate cmd\n");
-		return -ENOMEM;
+	/* The window stays where it is for the next read */
+	if (flash->dirmap) {
+		ret = spi_claim_bus(spi);
+		if (ret) {
+			debug("SF: unable to claim SPI bus\n");
+			return ret;
+		}
+		ret = spi_mem_dirmap_read(flash->dirmap, offset, len, data);
+		spi_release_bus(spi);
+		return ret;
 	}
 
-	cmd[0] = flash->read_cmd;
 	while (len) {
 		read_addr = offset;
 
@@ -474,22 +1086,43 @@ int spi_flash_cmd_read_ops(struct spi_flash *flash, u32 offset,
 		if (flash->dual_flash > SF_SINGLE_FLASH)
 			spi_flash_dual(flash, &read_addr);
 #endif
+		/* 4-byte addressing reaches the whole device in one go */
+		if (flash->addr_width == SPI_FLASH_4B_ADDR_LEN) {
+			read_len = len;
+		} else {
 #ifdef CONFIG_SPI_FLASH_BAR
-		ret = write_bar(flash, read_addr);
-		if (ret < 0)
-			return ret;
-		bank_sel = flash->bank_curr;
+			ret = write_bar(flash, read_addr);
+			if (ret < 0)
+				return ret;
+			bank_sel = flash->bank_curr;
+#endif
+			remain_len = ((SPI_FLASH_16MB_BOUN << flash->shift) *
+					(bank_sel + 1)) - offset;
+			if (len < remain_len)
+				read_len = len;
+			else
+				read_len = remain_len;
+		}
+
+#ifdef CONFIG_SF_DUAL_FLASH
+		/* Each die is read on its own, so stop at its end */
+		if (flash->dual_flash & SF_DUAL_STACKED_FLASH) {
+			remain_len = (flash->size >> 1) -
+					offset % (flash->size >> 1);
+			if (read_len > remain_len)
+				read_len = remain_len;
+		}
 #endif
-		remain_len = ((SPI_FLASH_16MB_BOUN << flash->shift) *
-				(bank_sel + 1)) - offset;
-		if (len < remain_len)
-			read_len = len;
-		else
-			read_len = remain_len;
 
-		spi_flash_addr(read_addr, cmd);
+		spi_flash_read_op_init(flash, &op, read_addr, data, read_len);
 
-		ret = spi_flash_read_common(flash, cmd, cmdsz, data, read_len);
+		ret = spi_claim_bus(spi);
+		if (ret) {
+			debug("SF: unable to claim SPI bus\n");
+			return ret;
+		}
+		ret = spi_mem_exec_op(spi, &op);
+		spi_release_bus(spi);
 		if (ret < 0) {
 			debug("SF: read failed\n");
 			break;
@@ -500,7 +1133,6 @@ int spi_flash_cmd_read_ops(struct spi_flash *flash, u32 offset,
 		data += read_len;
 	}
 
-	free(cmd);
 	return ret;
 }
 
@@ -538,6 +1170,7 @@ int sst_write_wp(struct spi_flash *flash, u32 offset, size_t len,
 	int ret;
 	u8 cmd[4];
 
+	spi_mem_dirmap_invalidate(flash->dirmap);
 	ret = spi_claim_bus(spi);
 	if (ret) {
 		debug("SF: Unable to claim SPI bus\n");
@@ -605,6 +1238,7 @@ int sst_write_bp(struct spi_flash *flash, u32 offset, size_t len,
 	size_t actual;
 	int ret;
 
+	spi_mem_dirmap_invalidate(flash->dirmap);
 	ret = spi_claim_bus(spi);
 	if (ret) {
 		debug("SF: Unable to claim SPI bus\n");
@@ -863,11 +1497,11 @@ static int spansion_quad_enable(struct spi_flash *flash)
 }
 #endif
 
-static const struct spi_flash_info *spi_flash_read_id(struct spi_flash *flash)
+/* Read the JEDEC ID, returning its ID table entry or NULL if it has none */
+static const struct spi_flash_info *spi_flash_read_id(struct spi_flash *flash,
+						      u8 *id)
 {
-	int				tmp;
-	u8				id[SPI_FLASH_MAX_ID_LEN];
-	const struct spi_flash_info	*info;
+	int tmp;
 
 	tmp = spi_flash_cmd(flash->spi, CMD_READ_ID, id, SPI_FLASH_MAX_ID_LEN);
 	if (tmp < 0) {
@@ -875,19 +1509,95 @@ static const struct spi_flash_info *spi_flash_read_id(struct spi_flash *flash)
 		return ERR_PTR(tmp);
 	}
 
-	info = spi_flash_ids;
-	for (; info->name != NULL; info++) {
-		if (info->id_len) {
-			if (!memcmp(info->id, id, info->id_len))
-				return info;
-		}
+	return spi_flash_find_id(id);
+}
+
+/*
+ * The table is sorted by JEDEC ID, so find the first entry with the ID
+ * by bisection and then try the entries which share it, in order
+ */
+const struct spi_flash_info *spi_flash_find_id(const u8 *id)
+{
+	const int jedec_len = SPI_FLASH_CMD_LEN - 1;
+	const struct spi_flash_info *info;
+	unsigned int lo = 0, hi = spi_flash_ids_count, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (memcmp(spi_flash_ids[mid].id, id, jedec_len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 
-	printf("SF: unrecognized JEDEC id bytes: %02x, %02x, %02x\n",
-	       id[0], id[1], id[2]);
-	return ERR_PTR(-ENODEV);
+	for (info = &spi_flash_ids[lo]; info->name; info++) {
+		if (memcmp(info->id, id, jedec_len))
+			break;
+		if (!memcmp(info->id, id, info->id_len))
+			return info;
+	}
+
+	return NULL;
 }
 
+#ifdef CONFIG_SPI_FLASH_SFDP
+/*
+ * Describe the flash from its SFDP, on top of its ID table entry if it has
+ * one. Flags which SFDP does not cover are kept from the table. Returns
+ * NULL if SFDP cannot be used.
+ */
+static const struct spi_flash_info *spi_flash_sfdp_info(
+		struct spi_flash *flash, const struct spi_flash_info *info,
+		const u8 *id, struct spi_flash_sfdp *sfdp,
+		struct spi_flash_info *sfdp_info)
+{
+	int ret;
+
+	/* Both halves of a dual flash would answer at once */
+	if (flash->dual_flash != SF_SINGLE_FLASH)
+		return NULL;
+
+	ret = spi_flash_parse_sfdp(flash, sfdp);
+	if (ret) {
+		if (ret != -ENOENT)
+			debug("SF: ignoring SFDP (err=%d)\n", ret);
+		return NULL;
+	}
+
+	if (info) {
+		*sfdp_info = *info;
+	} else {
+		memset(sfdp_info, '\0', sizeof(*sfdp_info));
+		sfdp_info->name = "SFDP";
+		memcpy(sfdp_info->id, id, SPI_FLASH_CMD_LEN - 1);
+		sfdp_info->id_len = SPI_FLASH_CMD_LEN - 1;
+		sfdp_info->page_size = 256;
+	}
+	sfdp_info->sector_size = sfdp->sector_size;
+	sfdp_info->n_sectors = sfdp->size / sfdp->sector_size;
+	if (sfdp->page_size)
+		sfdp_info->page_size = sfdp->page_size;
+	sfdp_info->flags = (sfdp_info->flags & ~sfdp->flags_known) |
+			   sfdp->flags;
+
+	return sfdp_info;
+}
+
+/* Take the wait cycles of the chosen read opcode from SFDP */
+static int spi_flash_sfdp_dummy(struct spi_flash *flash,
+				const struct spi_flash_sfdp *sfdp)
+{
+	const struct spi_flash_sfdp_read *read;
+
+	for (read = sfdp->read; read < sfdp->read + SFDP_READ_COUNT; read++) {
+		if (read->opcode && read->opcode == flash->read_cmd)
+			return read->wait * read->addr_lines / 8;
+	}
+
+	return -ENOENT;
+}
+#endif
+
 static int set_quad_mode(struct spi_flash *flash,
 			 const struct spi_flash_info *info)
 {
@@ -913,6 +1623,86 @@ static int set_quad_mode(struct spi_flash *flash,
 	}
 }
 
+/* Add a block erase command, keeping the list sorted by size */
+static void spi_flash_add_erase_type(struct spi_flash *flash, u32 size,
+				     u8 opcode)
+{
+	struct spi_flash_erase_type *types = flash->erase_types;
+	int i, j;
+
+	for (i = 0; i < SPI_FLASH_MAX_ERASE_TYPES; i++) {
+		if (types[i].size == size)
+			return;
+		if (!types[i].size || types[i].size > size)
+			break;
+	}
+	if (i == SPI_FLASH_MAX_ERASE_TYPES ||
+	    types[SPI_FLASH_MAX_ERASE_TYPES - 1].size)
+		return;
+
+	for (j = SPI_FLASH_MAX_ERASE_TYPES - 1; j > i; j--)
+		types[j] = types[j - 1];
+	types[i].size = size;
+	types[i].opcode = opcode;
+	types[i].count = 0;
+}
+
+/* Map a 3-byte address opcode onto its dedicated 4-byte counterpart */
+static u8 spi_flash_4b_opcode(u8 opcode)
+{
+	switch (opcode) {
+	case CMD_READ_ARRAY_SLOW:
+		return CMD_READ_ARRAY_SLOW_4B;
+	case CMD_READ_ARRAY_FAST:
+		return CMD_READ_ARRAY_FAST_4B;
+	case CMD_READ_DUAL_OUTPUT_FAST:
+		return CMD_READ_DUAL_OUTPUT_FAST_4B;
+	case CMD_READ_DUAL_IO_FAST:
+		return CMD_READ_DUAL_IO_FAST_4B;
+	case CMD_READ_QUAD_OUTPUT_FAST:
+		return CMD_READ_QUAD_OUTPUT_FAST_4B;
+	case CMD_READ_QUAD_IO_FAST:
+		return CMD_READ_QUAD_IO_FAST_4B;
+	case CMD_PAGE_PROGRAM:
+		return CMD_PAGE_PROGRAM_4B;
+	case CMD_QUAD_PAGE_PROGRAM:
+		return CMD_QUAD_PAGE_PROGRAM_4B;
+	case CMD_ERASE_4K:
+		return CMD_ERASE_4K_4B;
+	case CMD_ERASE_32K:
+		return CMD_ERASE_32K_4B;
+	case CMD_ERASE_64K:
+		return CMD_ERASE_64K_4B;
+	default:
+		return opcode;
+	}
+}
+
+/*
+ * Switch to the 4-byte address opcodes, so that the whole device can be
+ * reached without going through the bank/extended address register.
+ */
+static void spi_flash_set_4b_opcodes(struct spi_flash *flash)
+{
+	struct spi_flash_erase_type types[SPI_FLASH_MAX_ERASE_TYPES];
+	u8 opcode;
+	int i;
+
+	flash->read_cmd = spi_flash_4b_opcode(flash->read_cmd);
+	flash->write_cmd = spi_flash_4b_opcode(flash->write_cmd);
+	flash->erase_cmd = spi_flash_4b_opcode(flash->erase_cmd);
+	flash->addr_width = SPI_FLASH_4B_ADDR_LEN;
+
+	/* Erase commands without a 4-byte address form cannot be used */
+	memcpy(types, flash->erase_types, sizeof(types));
+	memset(flash->erase_types, '\0', sizeof(flash->erase_types));
+	for (i = 0; i < SPI_FLASH_MAX_ERASE_TYPES; i++) {
+		opcode = spi_flash_4b_opcode(types[i].opcode);
+		if (types[i].size && opcode != types[i].opcode)
+			spi_flash_add_erase_type(flash, types[i].size, opcode);
+	}
+}
+
 #if CONFIG_IS_ENABLED(OF_CONTROL)
 int spi_flash_decode_fdt(const void *blob, struct spi_flash *flash)
 {
@@ -942,11 +1732,30 @@ int spi_flash_scan(struct spi_flash *flash)
 {
 	struct spi_slave *spi = flash->spi;
 	const struct spi_flash_info *info = NULL;
+	u8 id[SPI_FLASH_MAX_ID_LEN];
+#ifdef CONFIG_SPI_FLASH_SFDP
+	const struct spi_flash_info *sfdp_info;
+	struct spi_flash_info sfdp_entry;
+	struct spi_flash_sfdp sfdp;
+	int i;
+#endif
+	struct spi_mem_op op;
 	int ret;
 
-	info = spi_flash_read_id(flash);
-	if (IS_ERR_OR_NULL(info))
+	info = spi_flash_read_id(flash, id);
+	if (IS_ERR(info))
+		return -ENOENT;
+
+#ifdef CONFIG_SPI_FLASH_SFDP
+	sfdp_info = spi_flash_sfdp_info(flash, info, id, &sfdp, &sfdp_entry);
+	if (sfdp_info)
+		info = sfdp_info;
+#endif
+	if (!info) {
+		printf("SF: unrecognized JEDEC id bytes: %02x, %02x, %02x\n",
+		       id[0], id[1], id[2]);
 		return -ENOENT;
+	}
 
 	/* Flash powers up read-only, so clear BP# bits */
 	if (JEDEC_MFR(info) == SPI_FLASH_CFI_MFR_ATMEL ||
@@ -959,6 +1768,8 @@ int spi_flash_scan(struct spi_flash *flash)
 
 	if (info->flags & SST_WR)
 		flash->flags |= SNOR_F_SST_WR;
+	if (info->flags & ERASE_SUSP)
+		flash->flags |= SNOR_F_ERASE_SUSP;
 
 #ifndef CONFIG_DM_SPI_FLASH
 	flash->write = spi_flash_cmd_write_ops;
@@ -998,6 +1809,12 @@ int spi_flash_scan(struct spi_flash *flash)
 		    (JEDEC_ID(info) != 0x0216))
 			flash->page_size = 512;
 	}
+	/* Start polling page programs from the usual time, then learn it */
+	if (sfdp_info && sfdp.prog_time_us)
+		flash->prog_time_us = sfdp.prog_time_us;
+	else
+		flash->prog_time_us = SPI_FLASH_PAGE_PROG_US *
+				      flash->page_size / 256;
 	flash->page_size <<= flash->shift;
 	flash->sector_size = info->sector_size << flash->shift;
 	flash->size = flash->sector_size * info->n_sectors << flash->shift;
@@ -1021,12 +1838,42 @@ int spi_flash_scan(struct spi_flash *flash)
 	/* Now erase size becomes valid sector size */
 	flash->sector_size = flash->erase_size;
 
+	/* All block erase commands the flash offers, for the erase planner */
+	memset(flash->erase_types, '\0', sizeof(flash->erase_types));
+	if (info->flags & SECT_4K)
+		spi_flash_add_erase_type(flash, 4096 << flash->shift,
+					 CMD_ERASE_4K);
+	spi_flash_add_erase_type(flash, info->sector_size << flash->shift,
+				 CMD_ERASE_64K);
+#ifdef CONFIG_SPI_FLASH_SFDP
+	for (i = 0; sfdp_info && i < SFDP_MAX_ERASE_TYPES; i++) {
+		if (!(sfdp.erase_mask & BIT(i)))
+			continue;
+		spi_flash_add_erase_type(flash,
+					 sfdp.erase[i].size << flash->shift,
+					 sfdp.erase[i].opcode);
+	}
+#endif
+
 	/* Look for read commands */
 	flash->read_cmd = CMD_READ_ARRAY_FAST;
 	if (spi->mode & SPI_RX_SLOW)
 		flash->read_cmd = CMD_READ_ARRAY_SLOW;
+#ifdef CONFIG_SPI_FLASH_SFDP
+	/* The IO modes need the dummy cycles which only SFDP tells us */
+	else if (sfdp_info && spi->mode & SPI_TX_QUAD &&
+		 spi->mode & SPI_RX_QUAD && info->flags & RD_QUADIO &&
+		 sfdp.read[SFDP_READ_1_4_4].opcode == CMD_READ_QUAD_IO_FAST)
+		flash->read_cmd = CMD_READ_QUAD_IO_FAST;
+#endif
 	else if (spi->mode & SPI_RX_QUAD && info->flags & RD_QUAD)
 		flash->read_cmd = CMD_READ_QUAD_OUTPUT_FAST;
+#ifdef CONFIG_SPI_FLASH_SFDP
+	else if (sfdp_info && spi->mode & SPI_TX_DUAL &&
+		 spi->mode & SPI_RX_DUAL && info->flags & RD_DUALIO &&
+		 sfdp.read[SFDP_READ_1_2_2].opcode == CMD_READ_DUAL_IO_FAST)
+		flash->read_cmd = CMD_READ_DUAL_IO_FAST;
+#endif
 	else if (spi->mode & SPI_RX_DUAL && info->flags & RD_DUAL)
 		flash->read_cmd = CMD_READ_DUAL_OUTPUT_FAST;
 
@@ -1037,18 +1884,6 @@ int spi_flash_scan(struct spi_flash *flash)
 		/* Go for default supported write cmd */
 		flash->write_cmd = CMD_PAGE_PROGRAM;
 
-	/* Set the quad enable bit - only for quad commands */
-	if ((flash->read_cmd == CMD_READ_QUAD_OUTPUT_FAST) ||
-	    (flash->read_cmd == CMD_READ_QUAD_IO_FAST) ||
-	    (flash->write_cmd == CMD_QUAD_PAGE_PROGRAM)) {
-		ret = set_quad_mode(flash, info);
-		if (ret) {
-			debug("SF: Fail to set QEB for %02x\n",
-			      JEDEC_MFR(info));
-			return -EINVAL;
-		}
-	}
-
 	/* Read dummy_byte: dummy byte is determined based on the
 	 * dummy cycles of a particular command.
 	 * Fast commands - dummy_byte = dummy_cycles/8
@@ -1067,17 +1902,69 @@ int spi_flash_scan(struct spi_flash *flash)
 	default:
 		flash->dummy_byte = 1;
 	}
+#ifdef CONFIG_SPI_FLASH_SFDP
+	if (sfdp_info) {
+		ret = spi_flash_sfdp_dummy(flash, &sfdp);
+		if (ret >= 0)
+			flash->dummy_byte = ret;
+	}
+#endif
+
+	/* Set the quad enable bit - only for quad commands */
+	if ((flash->read_cmd == CMD_READ_QUAD_OUTPUT_FAST) ||
+	    (flash->read_cmd == CMD_READ_QUAD_IO_FAST) ||
+	    (flash->write_cmd == CMD_QUAD_PAGE_PROGRAM)) {
+#ifdef CONFIG_SPI_FLASH_SFDP
+		if (sfdp_info && sfdp.quad_enable == SFDP_QER_NONE)
+			ret = 0;
+		else
+#endif
+			ret = set_quad_mode(flash, info);
+		if (ret) {
+			debug("SF: Fail to set QEB for %02x\n",
+			      JEDEC_MFR(info));
+			return -EINVAL;
+		}
+	}
 
 #ifdef CONFIG_SPI_FLASH_STMICRO
 	if (info->flags & E_FSR)
 		flash->flags |= SNOR_F_USE_FSR;
 #endif
 
+	/* Use native 4-byte addressing on large flashes which support it */
+	flash->addr_width = SPI_FLASH_3B_ADDR_LEN;
+	if ((info->flags & OPCODES_4B) &&
+	    info->sector_size * info->n_sectors > SPI_FLASH_16MB_BOUN)
+		spi_flash_set_4b_opcodes(flash);
+
+	/* Drop back to single-line commands the controller cannot run */
+	spi_flash_read_op_init(flash, &op, 0, NULL, 1);
+	if (!spi_mem_supports_op(spi, &op)) {
+		debug("SF: read %02x unsupported, using fast read\n",
+		      flash->read_cmd);
+		flash->read_cmd = CMD_READ_ARRAY_FAST;
+		if (flash->addr_width == SPI_FLASH_4B_ADDR_LEN)
+			flash->read_cmd = CMD_READ_ARRAY_FAST_4B;
+		flash->dummy_byte = 1;
+	}
+	spi_flash_op_init(flash, &op, flash->write_cmd, 0);
+	op.data.nbytes = 1;
+	if (!spi_mem_supports_op(spi, &op)) {
+		debug("SF: program %02x unsupported, using page program\n",
+		      flash->write_cmd);
+		flash->write_cmd = CMD_PAGE_PROGRAM;
+		if (flash->addr_width == SPI_FLASH_4B_ADDR_LEN)
+			flash->write_cmd = CMD_PAGE_PROGRAM_4B;
+	}
+
 	/* Configure the BAR - discover bank cmds and read current bank */
 #ifdef CONFIG_SPI_FLASH_BAR
-	ret = read_bar(flash, info);
-	if (ret < 0)
-		return ret;
+	if (flash->addr_width == SPI_FLASH_3B_ADDR_LEN) {
+		ret = read_bar(flash, info);
+		if (ret < 0)
+			return ret;
+	}
 #endif
 
 #if CONFIG_IS_ENABLED(OF_CONTROL) && !CONFIG_IS_ENABLED(OF_PLATDATA)
@@ -1088,6 +1975,17 @@ int spi_flash_scan(struct spi_flash *flash)
 	}
 #endif
 
+	/* Read through the controller's window if it has one */
+	if (!flash->memory_map && flash->dual_flash == SF_SINGLE_FLASH &&
+	    (flash->addr_width == SPI_FLASH_4B_ADDR_LEN ||
+	     flash->size <= SPI_FLASH_16MB_BOUN)) {
+		spi_flash_read_op_init(flash, &op, 0, NULL, 0);
+		ret = spi_mem_dirmap_create(spi, &op, flash->size,
+					    &flash->dirmap);
+		if (ret && ret != -ENOTSUPP)
+			debug("SF: No read window: %d\n", ret);
+	}
+
 #ifndef CONFIG_SPL_BUILD
 	printf("SF: Detected %s with page size ", flash->name);
 	print_size(flash->page_size, ", erase size ");
@@ -1099,10 +1997,11 @@ int spi_flash_scan(struct spi_flash *flash)
 #endif
 
 #ifndef CONFIG_SPI_FLASH_BAR
-	if (((flash->dual_flash == SF_SINGLE_FLASH) &&
+	if ((flash->addr_width == SPI_FLASH_3B_ADDR_LEN) &&
+	    (((flash->dual_flash == SF_SINGLE_FLASH) &&
 	     (flash->size > SPI_FLASH_16MB_BOUN)) ||
 	     ((flash->dual_flash > SF_SINGLE_FLASH) &&
-	     (flash->size > SPI_FLASH_16MB_BOUN << 1))) {
+	     (flash->size > SPI_FLASH_16MB_BOUN << 1)))) {
 		puts("SF: Warning - Only lower 16MiB accessible,");
 		puts(" Full access #define CONFIG_SPI_FLASH_BAR\n");
 	}
@@ -10,8 +10,10 @@
 
 #include <common.h>
 #include <dm.h>
+#include <fdtdec.h>
 #include <malloc.h>
 #include <spi.h>
+#include <spi-mem.h>
 #include <spi_flash.h>
 #include <os.h>
 
@@ -26,6 +28,9 @@ DECLARE_GLOBAL_DATA_PTR;
 # define CONFIG_SPI_IDLE_VAL 0xFF
 #endif
 
+/* Size of the emulated memory-mapped read window */
+#define SANDBOX_SPI_DIRMAP_SIZE	0x10000
+
 const char *sandbox_spi_parse_spec(const char *arg, unsigned long *bus,
 				   unsigned long *cs)
 {
@@ -124,6 +129,80 @@ static int sandbox_spi_xfer(struct udevice *slave, unsigned int bitlen,
 	return ret;
 }
 
+/*
+ * Poll the status the way a controller with a hardware poller would. Only
+ * slaves marked with "sandbox,status-poll" get this, so that the others
+ * keep testing the software polling in the flash core.
+ */
+static int sandbox_spi_wait_status(struct udevice *slave, u8 opcode, u8 mask,
+				   u8 match, ulong timeout_ms)
+{
+	ulong start = get_timer(0);
+	u8 tx[2] = { opcode }, rx[2];
+	int ret;
+
+	if (!fdtdec_get_bool(gd->fdt_blob, slave->of_offset,
+			     "sandbox,status-poll"))
+		return -ENOSYS;
+
+	do {
+		ret = sandbox_spi_xfer(slave, sizeof(tx) * 8, tx, rx,
+				       SPI_XFER_BEGIN | SPI_XFER_END);
+		if (ret)
+			return ret;
+		if ((rx[1] & mask) == match)
+			return 0;
+	} while (get_timer(start) < timeout_ms);
+
+	return -ETIMEDOUT;
+}
+
+/*
+ * Only slaves marked with "sandbox,dirmap" get a window, so that the others
+ * keep testing the command read path
+ */
+static int sandbox_spi_dirmap_create(struct spi_mem_dirmap_desc *desc)
+{
+	if (!fdtdec_get_bool(gd->fdt_blob, desc->slave->dev->of_offset,
+			     "sandbox,dirmap"))
+		return -ENOTSUPP;
+
+	desc->map = malloc(SANDBOX_SPI_DIRMAP_SIZE);
+	if (!desc->map)
+		return -ENOMEM;
+	desc->window_size = SANDBOX_SPI_DIRMAP_SIZE;
+
+	return 0;
+}
+
+/*
+ * There is no real aperture, so fill the window by reading the flash
+ * through the template, as a controller would on access
+ */
+static int sandbox_spi_dirmap_move(struct spi_mem_dirmap_desc *desc,
+				   u32 offset)
+{
+	struct spi_mem_op op = desc->op_tmpl;
+
+	op.addr.val = offset;
+	op.data.dir = SPI_MEM_DATA_IN;
+	op.data.nbytes = min(desc->window_size, desc->length - offset);
+	op.data.buf.in = desc->map;
+
+	return spi_mem_exec_op(desc->slave, &op);
+}
+
+static void sandbox_spi_dirmap_destroy(struct spi_mem_dirmap_desc *desc)
+{
+	free(desc->map);
+}
+
+static const struct spi_controller_mem_ops sandbox_spi_mem_ops = {
+	.dirmap_create	= sandbox_spi_dirmap_create,
+	.dirmap_move	= sandbox_spi_dirmap_move,
+	.dirmap_destroy	= sandbox_spi_dirmap_destroy,
+};
+
 static int sandbox_spi_set_speed(struct udevice *bus, uint speed)
 {
 	return 0;
@@ -149,6 +228,8 @@ static const struct dm_spi_ops sandbox_spi_ops = {
 	.set_speed	= sandbox_spi_set_speed,
 	.set_mode	= sandbox_spi_set_mode,
 	.cs_info	= sandbox_cs_info,
+	.wait_status	= sandbox_spi_wait_status,
+	.mem_ops	= &sandbox_spi_mem_ops,
 };
 
 static const struct udevice_id sandbox_spi_ids[] = {
@@ -0,0 +1,211 @@
+/*
+ * SPI memory operations, with a spi_xfer() fallback for controllers which
+ * do not understand them
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <dm.h>
+#include <dma.h>
+#include <errno.h>
+#include <malloc.h>
+#include <spi.h>
+#include <spi-mem.h>
+
+static const struct spi_controller_mem_ops *spi_mem_get_ops(
+		struct spi_slave *slave)
+{
+#ifdef CONFIG_DM_SPI
+	struct udevice *bus = slave->dev->parent;
+
+	if (bus->uclass->uc_drv->id == UCLASS_SPI)
+		return spi_get_ops(bus)->mem_ops;
+#endif
+
+	return NULL;
+}
+
+static bool spi_mem_buswidth_ok(uint mode, u8 buswidth, bool tx)
+{
+	switch (buswidth) {
+	case 0:
+	case 1:
+		return true;
+	case 2:
+		return mode & (tx ? SPI_TX_DUAL : SPI_RX_DUAL);
+	case 4:
+		return mode & (tx ? SPI_TX_QUAD : SPI_RX_QUAD);
+	default:
+		return false;
+	}
+}
+
+bool spi_mem_default_supports_op(struct spi_slave *slave,
+				 const struct spi_mem_op *op)
+{
+	uint mode = slave->mode;
+
+	if (!spi_mem_buswidth_ok(mode, op->cmd.buswidth, true))
+		return false;
+	if (op->addr.nbytes &&
+	    !spi_mem_buswidth_ok(mode, op->addr.buswidth, true))
+		return false;
+	if (op->dummy.nbytes &&
+	    !spi_mem_buswidth_ok(mode, op->dummy.buswidth, true))
+		return false;
+	if (op->data.nbytes &&
+	    !spi_mem_buswidth_ok(mode, op->data.buswidth,
+				 op->data.dir == SPI_MEM_DATA_OUT))
+		return false;
+
+	return true;
+}
+
+bool spi_mem_supports_op(struct spi_slave *slave, const struct spi_mem_op *op)
+{
+	const struct spi_controller_mem_ops *ops = spi_mem_get_ops(slave);
+
+	if (ops && ops->supports_op)
+		return ops->supports_op(slave, op);
+
+	return spi_mem_default_supports_op(slave, op);
+}
+
+int spi_mem_exec_op(struct spi_slave *slave, const struct spi_mem_op *op)
+{
+	const struct spi_controller_mem_ops *ops = spi_mem_get_ops(slave);
+	unsigned long flags = SPI_XFER_BEGIN;
+	u8 cmd[SPI_MEM_MAX_CMD_LEN];
+	uint len, i;
+	int ret;
+
+	if (!spi_mem_supports_op(slave, op))
+		return -ENOTSUPP;
+
+	if (ops && ops->exec_op) {
+		ret = ops->exec_op(slave, op);
+		if (ret != -ENOTSUPP)
+			return ret;
+	}
+
+	/* Send everything up to the data as one command transfer */
+	len = 1 + op->addr.nbytes + op->dummy.nbytes;
+	if (len > sizeof(cmd))
+		return -EINVAL;
+	cmd[0] = op->cmd.opcode;
+	for (i = 0; i < op->addr.nbytes; i++)
+		cmd[1 + i] = op->addr.val >> (8 * (op->addr.nbytes - i - 1));
+	memset(cmd + 1 + op->addr.nbytes, '\0', op->dummy.nbytes);
+
+	if (!op->data.nbytes)
+		flags |= SPI_XFER_END;
+
+	ret = spi_xfer(slave, len * 8, cmd, NULL, flags);
+	if (ret) {
+		debug("SPI: Failed to send command (%u bytes): %d\n", len,
+		      ret);
+		return ret;
+	}
+	if (!op->data.nbytes)
+		return 0;
+
+	if (op->data.dir == SPI_MEM_DATA_IN)
+		ret = spi_xfer(slave, op->data.nbytes * 8, NULL,
+			       op->data.buf.in, SPI_XFER_END);
+	else
+		ret = spi_xfer(slave, op->data.nbytes * 8, op->data.buf.out,
+			       NULL, SPI_XFER_END);
+	if (ret)
+		debug("SPI: Failed to transfer %u bytes of data: %d\n",
+		      op->data.nbytes, ret);
+
+	return ret;
+}
+
+int spi_mem_dirmap_create(struct spi_slave *slave,
+			  const struct spi_mem_op *op_tmpl, u32 length,
+			  struct spi_mem_dirmap_desc **descp)
+{
+	const struct spi_controller_mem_ops *ops = spi_mem_get_ops(slave);
+	struct spi_mem_dirmap_desc *desc;
+	int ret;
+
+	if (!ops || !ops->dirmap_create || !ops->dirmap_move)
+		return -ENOTSUPP;
+	if (!spi_mem_supports_op(slave, op_tmpl))
+		return -ENOTSUPP;
+
+	desc = calloc(1, sizeof(*desc));
+	if (!desc)
+		return -ENOMEM;
+	desc->slave = slave;
+	desc->op_tmpl = *op_tmpl;
+	desc->length = length;
+
+	ret = ops->dirmap_create(desc);
+	if (!ret && (!desc->map || !desc->window_size))
+		ret = -EINVAL;
+	if (ret) {
+		free(desc);
+		return ret;
+	}
+	*descp = desc;
+
+	return 0;
+}
+
+int spi_mem_dirmap_read(struct spi_mem_dirmap_desc *desc, u32 offset,
+			size_t len, void *buf)
+{
+	const struct spi_controller_mem_ops *ops = spi_mem_get_ops(desc->slave);
+	u32 base, skip;
+	size_t chunk;
+	int ret;
+
+	if (offset > desc->length || len > desc->length - offset)
+		return -EINVAL;
+
+	while (len) {
+		skip = offset % desc->window_size;
+		base = offset - skip;
+		if (!desc->window_valid || base != desc->window_offset) {
+			ret = ops->dirmap_move(desc, base);
+			if (ret) {
+				debug("SPI: Failed to move window to %x: %d\n",
+				      base, ret);
+				desc->window_valid = false;
+				return ret;
+			}
+			desc->window_offset = base;
+			desc->window_valid = true;
+		}
+
+		chunk = min(len, (size_t)(desc->window_size - skip));
+		dma_mmap_copy(buf, desc->map + skip, chunk);
+		offset += chunk;
+		buf += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+void spi_mem_dirmap_invalidate(struct spi_mem_dirmap_desc *desc)
+{
+	if (desc)
+		desc->window_valid = false;
+}
+
+void spi_mem_dirmap_destroy(struct spi_mem_dirmap_desc *desc)
+{
+	const struct spi_controller_mem_ops *ops;
+
+	if (!desc)
+		return;
+
+	ops = spi_mem_get_ops(desc->slave);
+	if (ops && ops->dirmap_destroy)
+		ops->dirmap_destroy(desc);
+	free(desc);
+}
@@ -10,6 +10,7 @@
 #include <fdtdec.h>
 #include <malloc.h>
 #include <spi.h>
+#include <spi-mem.h>
 #include <dm/device-internal.h>
 #include <dm/uclass-internal.h>
 #include <dm/lists.h>
@@ -92,6 +93,18 @@ int dm_spi_xfer(struct udevice *dev, unsigned int bitlen,
 	return spi_get_ops(bus)->xfer(dev, bitlen, dout, din, flags);
 }
 
+int dm_spi_wait_status(struct udevice *dev, u8 opcode, u8 mask, u8 match,
+		       ulong timeout_ms)
+{
+	struct udevice *bus = dev->parent;
+	struct dm_spi_ops *ops = spi_get_ops(bus);
+
+	if (bus->uclass->uc_drv->id != UCLASS_SPI || !ops->wait_status)
+		return -ENOSYS;
+
+	return ops->wait_status(dev, opcode, mask, match, timeout_ms);
+}
+
 int spi_claim_bus(struct spi_slave *slave)
 {
 	return dm_spi_claim_bus(slave->dev);
@@ -146,6 +159,23 @@ static int spi_post_probe(struct udevice *bus)
 		ops->set_mode += gd->reloc_off;
 	if (ops->cs_info)
 		ops->cs_info += gd->reloc_off;
+	if (ops->wait_status)
+		ops->wait_status += gd->reloc_off;
+	if (ops->mem_ops) {
+		struct spi_controller_mem_ops *mem_ops =
+			(struct spi_controller_mem_ops *)ops->mem_ops;
+
+		if (mem_ops->supports_op)
+			mem_ops->supports_op += gd->reloc_off;
+		if (mem_ops->exec_op)
+			mem_ops->exec_op += gd->reloc_off;
+		if (mem_ops->dirmap_create)
+			mem_ops->dirmap_create += gd->reloc_off;
+		if (mem_ops->dirmap_move)
+			mem_ops->dirmap_move += gd->reloc_off;
+		if (mem_ops->dirmap_destroy)
+			mem_ops->dirmap_destroy += gd->reloc_off;
+	}
 #endif
 
 	return 0;
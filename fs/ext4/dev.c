@@ -106,8 +106,8 @@ int ext4fs_devread(lbaint_t sector, int byte_offset, int byte_len, char *buf)
 		return 1;
 	}
 
-	if (blk_dread(ext4fs_blk_desc, part_info->start + sector,
-		      block_len >> log2blksz, (void *)buf) !=
+	if (blk_dread_bounce(ext4fs_blk_desc, part_info->start + sector,
+			     block_len >> log2blksz, (void *)buf) !=
 			block_len >> log2blksz) {
 		printf(" ** %s read error - block\n", __func__);
 		return 0;
@@ -1509,16 +1509,25 @@ void ext4fs_allocate_blocks(struct ext2_inode *file_inode,
 
 #endif
 
+/*
+ * Find the leaf of the extent tree which covers fileblock. If rangep is not
+ * NULL it is set to the file blocks the leaf covers: from rangep[0] up to,
+ * but not including, rangep[1].
+ */
 static struct ext4_extent_header *ext4fs_get_extent_block
 	(struct ext2_data *data, char *buf,
 		struct ext4_extent_header *ext_block,
-		uint32_t fileblock, int log2_blksz)
+		uint32_t fileblock, int log2_blksz, uint32_t *rangep)
 {
 	struct ext4_extent_idx *index;
 	unsigned long long block;
 	int blksz = EXT2_BLOCK_SIZE(data);
 	int i;
 
+	if (rangep) {
+		rangep[0] = 0;
+		rangep[1] = ~0U;
+	}
 	while (1) {
 		index = (struct ext4_extent_idx *)(ext_block + 1);
 
@@ -1534,8 +1543,12 @@ static struct ext4_extent_header *ext4fs_get_extent_block
 				break;
 		} while (fileblock >= le32_to_cpu(index[i].ei_block));
 
+		if (rangep && i < le16_to_cpu(ext_block->eh_entries))
+			rangep[1] = le32_to_cpu(index[i].ei_block);
 		if (--i < 0)
 			return NULL;
+		if (rangep)
+			rangep[0] = le32_to_cpu(index[i].ei_block);
 
 		block = le16_to_cpu(index[i].ei_leaf_hi);
 		block = (block << 32) + le32_to_cpu(index[i].ei_leaf_lo);
@@ -1628,7 +1641,7 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock)
 			ext4fs_get_extent_block(ext4fs_root, buf,
 						(struct ext4_extent_header *)
 						inode->b.blocks.dir_blocks,
-						fileblock, log2_blksz);
+						fileblock, log2_blksz, NULL);
 		if (!ext_block) {
 			printf("invalid extent block\n");
 			free(buf);
@@ -1944,6 +1957,152 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock)
 	return blknr;
 }
 
+/*
+ * The extents of the leaf last used by read_allocated_run(), with the root of
+ * the extent tree they came from and the file blocks the leaf covers
+ */
+static struct {
+	char root[sizeof(((struct ext2_inode *)0)->b)];
+	struct ext4_extent_header *leaf;
+	uint32_t range[2];
+	char *buf;
+} ext4fs_extent_cache;
+
+static void ext4fs_extent_cache_free(void)
+{
+	free(ext4fs_extent_cache.buf);
+	memset(&ext4fs_extent_cache, '\0', sizeof(ext4fs_extent_cache));
+}
+
+static struct ext4_extent_header *ext4fs_extent_leaf(struct ext2_inode *inode,
+						     uint32_t fileblock)
+{
+	struct ext4_extent_header *ext_block;
+	char *buf = ext4fs_extent_cache.buf;
+	int blksz = EXT2_BLOCK_SIZE(ext4fs_root);
+	int log2_blksz;
+
+	if (ext4fs_extent_cache.leaf &&
+	    !memcmp(ext4fs_extent_cache.root, &inode->b, sizeof(inode->b)) &&
+	    fileblock >= ext4fs_extent_cache.range[0] &&
+	    fileblock < ext4fs_extent_cache.range[1])
+		return ext4fs_extent_cache.leaf;
+
+	if (!buf) {
+		buf = malloc(blksz);
+		if (!buf)
+			return NULL;
+		ext4fs_extent_cache.buf = buf;
+	}
+	ext4fs_extent_cache.leaf = NULL;
+	log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root) -
+		get_fs()->dev_desc->log2blksz;
+	ext_block = ext4fs_get_extent_block(ext4fs_root, buf,
+					    (struct ext4_extent_header *)
+					    inode->b.blocks.dir_blocks,
+					    fileblock, log2_blksz,
+					    ext4fs_extent_cache.range);
+	if (!ext_block)
+		return NULL;
+	if ((char *)ext_block != buf)
+		memcpy(buf, ext_block, sizeof(inode->b));
+	memcpy(ext4fs_extent_cache.root, &inode->b, sizeof(inode->b));
+	ext4fs_extent_cache.leaf = (struct ext4_extent_header *)buf;
+
+	return ext4fs_extent_cache.leaf;
+}
+
+static long int ext4fs_extent_run(struct ext2_inode *inode, uint32_t fileblock,
+				  int max, int *lenp)
+{
+	struct ext4_extent_header *ext_block;
+	struct ext4_extent *extent;
+	unsigned long long start;
+	uint32_t startblock, endblock;
+	int entries, i;
+
+	ext_block = ext4fs_extent_leaf(inode, fileblock);
+	if (!ext_block) {
+		printf("invalid extent block\n");
+		return -EINVAL;
+	}
+
+	extent = (struct ext4_extent *)(ext_block + 1);
+	entries = le16_to_cpu(ext_block->eh_entries);
+	for (i = 0; i < entries; i++) {
+		startblock = le32_to_cpu(extent[i].ee_block);
+		endblock = startblock + le16_to_cpu(extent[i].ee_len);
+
+		if (startblock > fileblock) {
+			/* Sparse file */
+			*lenp = min_t(uint32_t, startblock - fileblock, max);
+			return 0;
+		} else if (fileblock < endblock) {
+			start = le16_to_cpu(extent[i].ee_start_hi);
+			start = (start << 32) +
+				le32_to_cpu(extent[i].ee_start_lo);
+			start += fileblock - startblock;
+
+			/* Carry on through extents which follow on the disk */
+			for (i++; i < entries && endblock - fileblock < max;
+			     i++) {
+				unsigned long long next;
+
+				if (le32_to_cpu(extent[i].ee_block) != endblock)
+					break;
+				next = le16_to_cpu(extent[i].ee_start_hi);
+				next = (next << 32) +
+					le32_to_cpu(extent[i].ee_start_lo);
+				if (next != start + endblock - fileblock)
+					break;
+				endblock += le16_to_cpu(extent[i].ee_len);
+			}
+			*lenp = min_t(uint32_t, endblock - fileblock, max);
+			return start;
+		}
+	}
+
+	/* A hole up to the end of the leaf */
+	*lenp = min_t(uint32_t, ext4fs_extent_cache.range[1] - fileblock, max);
+
+	return 0;
+}
+
+/**
+ * read_allocated_run() - Find where a run of blocks of a file is on the disk
+ *
+ * @inode:	Inode of the file
+ * @fileblock:	First block of the run, in the file
+ * @max:	Maximum number of blocks in the run
+ * @lenp:	Returns the number of blocks in the run, which follow each
+ *		other on the disk, or are all in a hole
+ * @return first disk block of the run, 0 for a hole, -ve on error
+ */
+long int read_allocated_run(struct ext2_inode *inode, int fileblock, int max,
+			    int *lenp)
+{
+	long int start, blknr;
+	int len;
+
+	if (le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL)
+		return ext4fs_extent_run(inode, fileblock, max, lenp);
+
+	/* Indirect blocks are cached, so walk along the file block by block */
+	start = read_allocated_block(inode, fileblock);
+	if (start < 0)
+		return start;
+	for (len = 1; len < max; len++) {
+		blknr = read_allocated_block(inode, fileblock + len);
+		if (blknr < 0)
+			return blknr;
+		if (start ? blknr != start + len : blknr != 0)
+			break;
+	}
+	*lenp = len;
+
+	return start;
+}
+
 /**
  * ext4fs_reinit_global() - Reinitialize values of ext4 write implementation's
  *			    global pointers
@@ -1958,6 +2117,7 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock)
  */
 void ext4fs_reinit_global(void)
 {
+	ext4fs_extent_cache_free();
 	if (ext4fs_indir1_block != NULL) {
 		free(ext4fs_indir1_block);
 		ext4fs_indir1_block = NULL;
@@ -12,6 +12,7 @@
 #include <common.h>
 #include <blk.h>
 #include <config.h>
+#include <div64.h>
 #include <exports.h>
 #include <fat.h>
 #include <asm/byteorder.h>
@@ -41,6 +42,33 @@ static void downcase(char *str)
 static struct blk_desc *cur_dev;
 static disk_partition_t cur_part_info;
 
+/*
+ * The cluster chain of the file last read, as runs of consecutive clusters.
+ * It is built as far as reads need it, and kept until a device is next set
+ * up or the FAT is written, so that further reads of the same file do not
+ * have to follow the chain from its start again.
+ */
+struct fat_run {
+	__u32 fileclust;	/* Index of the first cluster in the file */
+	__u32 clust;		/* First cluster of the run */
+	__u32 count;		/* Number of clusters in the run */
+};
+
+static struct {
+	__u32 start;		/* First cluster of the file, 0 if none */
+	__u32 nclust;		/* Number of clusters mapped so far */
+	int nruns;
+	int maxruns;
+	struct fat_run *runs;
+} fat_chain;
+
+static void fat_chain_invalidate(void)
+{
+	fat_chain.start = 0;
+	fat_chain.nclust = 0;
+	fat_chain.nruns = 0;
+}
+
 #define DOS_BOOT_MAGIC_OFFSET	0x1fe
 #define DOS_FS_TYPE_OFFSET	0x36
 #define DOS_FS32_TYPE_OFFSET	0x52
@@ -52,7 +80,8 @@ static int disk_read(__u32 block, __u32 nr_blocks, void *buf)
 	if (!cur_dev)
 		return -1;
 
-	ret = blk_dread(cur_dev, cur_part_info.start + block, nr_blocks, buf);
+	ret = blk_dread_bounce(cur_dev, cur_part_info.start + block, nr_blocks,
+			       buf);
 
 	if (nr_blocks && ret == 0)
 		return -1;
@@ -66,6 +95,7 @@ int fat_set_blk_dev(struct blk_desc *dev_desc, disk_partition_t *info)
 
 	cur_dev = dev_desc;
 	cur_part_info = *info;
+	fat_chain_invalidate();
 
 	/* Make sure it has a valid FAT header */
 	if (disk_read(0, 1, buffer) != 1) {
@@ -275,34 +305,17 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 
 	debug("gc - clustnum: %d, startsect: %d\n", clustnum, startsect);
 
-	if ((unsigned long)buffer & (ARCH_DMA_MINALIGN - 1)) {
-		ALLOC_CACHE_ALIGN_BUFFER(__u8, tmpbuf, mydata->sect_size);
-
-		printf("FAT: Misaligned buffer address (%p)\n", buffer);
-
-		while (size >= mydata->sect_size) {
-			ret = disk_read(startsect++, 1, tmpbuf);
-			if (ret != 1) {
-				debug("Error reading data (got %d)\n", ret);
-				return -1;
-			}
-
-			memcpy(buffer, tmpbuf, mydata->sect_size);
-			buffer += mydata->sect_size;
-			size -= mydata->sect_size;
-		}
-	} else {
-		idx = size / mydata->sect_size;
-		ret = disk_read(startsect, idx, buffer);
-		if (ret != idx) {
-			debug("Error reading data (got %d)\n", ret);
-			return -1;
-		}
-		startsect += idx;
-		idx *= mydata->sect_size;
-		buffer += idx;
-		size -= idx;
+	/* disk_read() copes with a buffer of any alignment */
+	idx = size / mydata->sect_size;
+	ret = disk_read(startsect, idx, buffer);
+	if (ret != idx) {
+		debug("Error reading data (got %d)\n", ret);
+		return -1;
 	}
+	startsect += idx;
+	idx *= mydata->sect_size;
+	buffer += idx;
+	size -= idx;
 	if (size) {
 		ALLOC_CACHE_ALIGN_BUFFER(__u8, tmpbuf, mydata->sect_size);
 
@@ -318,6 +331,79 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 	return 0;
 }
 
+/*
+ * Map the chain starting at 'start' as far as cluster 'last' of the file,
+ * or to its end if that comes first. Return 0 on success, -1 if out of
+ * memory.
+ */
+static int fat_chain_map(fsdata *mydata, __u32 start, __u32 last)
+{
+	struct fat_run *run;
+	__u32 clust;
+
+	if (fat_chain.start != start) {
+		fat_chain_invalidate();
+		fat_chain.start = start;
+	}
+
+	while (fat_chain.nclust <= last) {
+		if (fat_chain.nruns) {
+			run = &fat_chain.runs[fat_chain.nruns - 1];
+			clust = get_fatent(mydata, run->clust + run->count - 1);
+			if (CHECK_CLUST(clust, mydata->fatsize)) {
+				debug("curclust: 0x%x\n", clust);
+				return 0;
+			}
+			if (clust == run->clust + run->count) {
+				run->count++;
+				fat_chain.nclust++;
+				continue;
+			}
+		} else {
+			clust = start;
+		}
+
+		if (fat_chain.nruns == fat_chain.maxruns) {
+			int maxruns = fat_chain.maxruns ? fat_chain.maxruns * 2
+				: 16;
+
+			run = realloc(fat_chain.runs, maxruns * sizeof(*run));
+			if (!run) {
+				fat_chain_invalidate();
+				return -1;
+			}
+			fat_chain.runs = run;
+			fat_chain.maxruns = maxruns;
+		}
+		run = &fat_chain.runs[fat_chain.nruns++];
+		run->fileclust = fat_chain.nclust++;
+		run->clust = clust;
+		run->count = 1;
+	}
+
+	return 0;
+}
+
+/* Find the run holding cluster 'fileclust' of the file mapped */
+static struct fat_run *fat_chain_find(__u32 fileclust)
+{
+	struct fat_run *run;
+	int lo = 0, hi = fat_chain.nruns - 1, mid;
+
+	if (fileclust >= fat_chain.nclust)
+		return NULL;
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		run = &fat_chain.runs[mid];
+		if (run->fileclust > fileclust)
+			hi = mid - 1;
+		else
+			lo = mid;
+	}
+
+	return &fat_chain.runs[lo];
+}
+
 /*
  * Read at most 'maxsize' bytes from 'pos' in the file associated with 'dentptr'
  * into 'buffer'.
@@ -331,9 +417,9 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 {
 	loff_t filesize = FAT2CPU32(dentptr->size);
 	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
-	__u32 curclust = START(dentptr);
-	__u32 endclust, newclust;
-	loff_t actsize;
+	struct fat_run *run;
+	__u32 fileclust, clust, count;
+	loff_t actsize, skip;
 
 	*gotsize = 0;
 	debug("Filesize: %llu bytes\n", filesize);
@@ -348,92 +434,50 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 
 	debug("%llu bytes\n", filesize);
 
-	actsize = bytesperclust;
-
-	/* go to cluster at pos */
-	while (actsize <= pos) {
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			debug("Invalid FAT entry\n");
-			return 0;
-		}
-		actsize += bytesperclust;
+	if (fat_chain_map(mydata, START(dentptr),
+			  lldiv(filesize - 1, bytesperclust))) {
+		printf("Error mapping cluster chain\n");
+		return -1;
 	}
 
-	/* actsize > pos */
-	actsize -= bytesperclust;
-	filesize -= actsize;
-	pos -= actsize;
-
-	/* align to beginning of next cluster if any */
-	if (pos) {
-		actsize = min(filesize, (loff_t)bytesperclust);
-		if (get_cluster(mydata, curclust, get_contents_vfatname_block,
-				(int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		filesize -= actsize;
-		actsize -= pos;
-		memcpy(buffer, get_contents_vfatname_block + pos, actsize);
-		*gotsize += actsize;
-		if (!filesize)
-			return 0;
-		buffer += actsize;
-
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			debug("Invalid FAT entry\n");
+	while (pos < filesize) {
+		fileclust = lldiv(pos, bytesperclust);
+		run = fat_chain_find(fileclust);
+		if (!run) {
+			printf("Invalid FAT entry\n");
 			return 0;
 		}
-	}
-
-	actsize = bytesperclust;
-	endclust = curclust;
-
-	do {
-		/* search for consecutive clusters */
-		while (actsize < filesize) {
-			newclust = get_fatent(mydata, endclust);
-			if ((newclust - 1) != endclust)
-				goto getit;
-			if (CHECK_CLUST(newclust, mydata->fatsize)) {
-				debug("curclust: 0x%x\n", newclust);
-				debug("Invalid FAT entry\n");
-				return 0;
+		clust = run->clust + fileclust - run->fileclust;
+		count = run->count - (fileclust - run->fileclust);
+		skip = pos - (loff_t)fileclust * bytesperclust;
+
+		if (skip) {
+			/* The first cluster starts before pos */
+			actsize = min(filesize - pos + skip,
+				      (loff_t)bytesperclust);
+			if (get_cluster(mydata, clust,
+					get_contents_vfatname_block,
+					(int)actsize) != 0) {
+				printf("Error reading cluster\n");
+				return -1;
+			}
+			actsize -= skip;
+			memcpy(buffer, get_contents_vfatname_block + skip,
+			       actsize);
+		} else {
+			actsize = min(filesize - pos,
+				      (loff_t)count * bytesperclust);
+			if (get_cluster(mydata, clust, buffer, actsize) != 0) {
+				printf("Error reading cluster\n");
+				return -1;
 			}
-			endclust = newclust;
-			actsize += bytesperclust;
-		}
-
-		/* get remaining bytes */
-		actsize = filesize;
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
 		}
 		*gotsize += actsize;
-		return 0;
-getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += (int)actsize;
-		filesize -= actsize;
 		buffer += actsize;
+		pos += actsize;
+	}
 
-		curclust = get_fatent(mydata, endclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return 0;
-		}
-		actsize = bytesperclust;
-		endclust = curclust;
-	} while (1);
+	return 0;
 }
 
 /*
@@ -101,6 +101,17 @@ static void set_name(dir_entry *dirent, const char *filename)
 }
 
 static __u8 num_of_fats;
+
+/*
+ * Cluster allocation: where to look for a free cluster next, how many are
+ * free (FSINFO_UNKNOWN if not known) and the first cluster number past the
+ * end of the volume. On FAT32 the first two come from, and go back to, the
+ * FSInfo sector at 'fsinfo_sect', unless that is 0.
+ */
+static __u32 fat_next_free;
+static __u32 fat_free_count;
+static __u32 fat_max_clust;
+static __u16 fsinfo_sect;
 /*
  * Write fat buffer into block device
  */
@@ -365,7 +376,7 @@ get_long_file_name(fsdata *mydata, int curclust, __u8 *cluster,
  */
 static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 {
-	__u32 bufnum, offset, off16;
+	__u32 bufnum, offset, off16, old_value;
 	__u16 val1, val2;
 
 	switch (mydata->fatsize) {
@@ -386,6 +397,17 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 		return -1;
 	}
 
+	/* This reads the block of FAT entries into the cache, if needed */
+	old_value = get_fatent(mydata, entry);
+	if (!old_value && entry_value) {
+		if (fat_free_count != FSINFO_UNKNOWN)
+			fat_free_count--;
+		fat_next_free = entry + 1;
+	} else if (old_value && !entry_value) {
+		if (fat_free_count != FSINFO_UNKNOWN)
+			fat_free_count++;
+	}
+
 	/* Read a new block of FAT entries into the cache. */
 	if (bufnum != mydata->fatbufnum) {
 		int getsize = FATBUFBLOCKS;
@@ -466,23 +488,50 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 	return 0;
 }
 
+/*
+ * Find a free cluster, looking from 'entry' to the end of the FAT and then
+ * from its start, stopping short of 'stop' (which may be 0 to look at every
+ * cluster). Return 0 if there are none.
+ *
+ * The free count from FSInfo is only a hint, so the FAT is searched even
+ * when it says there are no free clusters.
+ */
+static __u32 find_free_cluster(fsdata *mydata, __u32 entry, __u32 stop)
+{
+	__u32 i;
+
+	if (entry < 2 || entry >= fat_max_clust)
+		entry = 2;
+	for (i = 2; i < fat_max_clust && entry != stop; i++) {
+		if (!get_fatent(mydata, entry)) {
+			if (!fat_free_count)
+				fat_free_count = FSINFO_UNKNOWN;
+			return entry;
+		}
+		if (++entry == fat_max_clust)
+			entry = 2;
+	}
+	if (!stop)
+		fat_free_count = 0;
+
+	return 0;
+}
+
 /*
  * Determine the next free cluster after 'entry' in a FAT (12/16/32) table
  * and link it to 'entry'. EOC marker is not set on returned entry.
+ * Return 0 if the FAT is full.
  */
 static __u32 determine_fatent(fsdata *mydata, __u32 entry)
 {
-	__u32 next_fat, next_entry = entry + 1;
+	__u32 next_entry;
 
-	while (1) {
-		next_fat = get_fatent(mydata, next_entry);
-		if (next_fat == 0) {
-			/* found free entry, link to entry */
-			set_fatent_value(mydata, entry, next_entry);
-			break;
-		}
-		next_entry++;
-	}
+	/* 'entry' is still free in the FAT until it is linked here */
+	next_entry = find_free_cluster(mydata, entry + 1, entry);
+	if (!next_entry)
+		return 0;
+	/* found free entry, link to entry */
+	set_fatent_value(mydata, entry, next_entry);
 	debug("FAT%d: entry: %08x, entry_value: %04x\n",
 	       mydata->fatsize, entry, next_entry);
 
@@ -554,22 +603,81 @@ set_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer,
 }
 
 /*
- * Find the first empty cluster
+ * Find an empty cluster, starting where the last one was allocated
  */
 static int find_empty_cluster(fsdata *mydata)
 {
-	__u32 fat_val, entry = 3;
+	__u32 entry;
 
-	while (1) {
-		fat_val = get_fatent(mydata, entry);
-		if (fat_val == 0)
-			break;
-		entry++;
-	}
+	entry = find_free_cluster(mydata, fat_next_free, 0);
+	if (!entry)
+		return -1;
 
 	return entry;
 }
 
+/*
+ * Work out how many clusters there are, and on FAT32 read where the next
+ * free one is, and how many are free, from the FSInfo sector
+ */
+static void init_cluster_alloc(fsdata *mydata, boot_sector *bs)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(__u8, block, mydata->sect_size);
+	struct fsinfo_sector *info = (struct fsinfo_sector *)block;
+	__u32 entries;
+
+	fat_max_clust = (total_sector - mydata->data_begin) /
+		mydata->clust_size;
+	entries = mydata->fatlength * mydata->sect_size * 8 / mydata->fatsize;
+	if (fat_max_clust > entries)
+		fat_max_clust = entries;
+	fat_next_free = 2;
+	fat_free_count = FSINFO_UNKNOWN;
+	fsinfo_sect = 0;
+
+	if (mydata->fatsize != 32 || !bs->info_sector ||
+	    bs->info_sector >= bs->reserved)
+		return;
+	if (disk_read(bs->info_sector, 1, block) < 0)
+		return;
+	if (FAT2CPU32(info->lead_sig) != FSINFO_LEAD_SIG ||
+	    FAT2CPU32(info->struct_sig) != FSINFO_STRUCT_SIG ||
+	    FAT2CPU32(info->trail_sig) != FSINFO_TRAIL_SIG) {
+		debug("FAT: invalid FSInfo sector\n");
+		return;
+	}
+	fsinfo_sect = bs->info_sector;
+	fat_next_free = FAT2CPU32(info->next_free);
+	fat_free_count = FAT2CPU32(info->free_count);
+	if (fat_free_count > fat_max_clust - 2)
+		fat_free_count = FSINFO_UNKNOWN;
+	debug("FAT: FSInfo next free %#x, free count %#x\n", fat_next_free,
+	      fat_free_count);
+}
+
+/*
+ * Write where the next free cluster is, and how many are free, back to
+ * the FSInfo sector
+ */
+static int flush_cluster_alloc(fsdata *mydata)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(__u8, block, mydata->sect_size);
+	struct fsinfo_sector *info = (struct fsinfo_sector *)block;
+
+	if (!fsinfo_sect)
+		return 0;
+	if (disk_read(fsinfo_sect, 1, block) < 0)
+		return -1;
+	info->next_free = cpu_to_le32(fat_next_free);
+	info->free_count = cpu_to_le32(fat_free_count);
+	if (disk_write(fsinfo_sect, 1, block) < 0) {
+		debug("error: writing FSInfo sector\n");
+		return -1;
+	}
+
+	return 0;
+}
+
 /*
  * Write directory entries in 'get_dentfromdir_block' to block device
  */
@@ -584,6 +692,10 @@ static void flush_dir_table(fsdata *mydata, dir_entry **dentptr)
 		return;
 	}
 	dir_newclust = find_empty_cluster(mydata);
+	if (dir_newclust < 0) {
+		printf("error: no free cluster for directory\n");
+		return;
+	}
 	set_fatent_value(mydata, dir_curclust, dir_newclust);
 	if (mydata->fatsize == 32)
 		set_fatent_value(mydata, dir_newclust, 0xffffff8);
@@ -665,6 +777,10 @@ set_contents(fsdata *mydata, dir_entry *dentptr, __u8 *buffer,
 		/* search for consecutive clusters */
 		while (actsize < filesize) {
 			newclust = determine_fatent(mydata, endclust);
+			if (!newclust) {
+				printf("Error: no free clusters\n");
+				return -1;
+			}
 
 			if ((newclust - 1) != endclust)
 				goto getit;
@@ -741,32 +857,6 @@ static void fill_dentry(fsdata *mydata, dir_entry *dentptr,
 	set_name(dentptr, filename);
 }
 
-/*
- * Check whether adding a file makes the file system to
- * exceed the size of the block device
- * Return -1 when overflow occurs, otherwise return 0
- */
-static int check_overflow(fsdata *mydata, __u32 clustnum, loff_t size)
-{
-	__u32 startsect, sect_num, offset;
-
-	if (clustnum > 0) {
-		startsect = mydata->data_begin +
-				clustnum * mydata->clust_size;
-	} else {
-		startsect = mydata->rootdir_sect;
-	}
-
-	sect_num = div_u64_rem(size, mydata->sect_size, &offset);
-
-	if (offset != 0)
-		sect_num++;
-
-	if (startsect + sect_num > cur_part_info.start + total_sector)
-		return -1;
-	return 0;
-}
-
 /*
  * Check if adding several entries exceed one cluster boundary
  */
@@ -916,9 +1006,11 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 	int cursect;
 	int ret = -1, name_len;
 	char l_filename[VFAT_MAXLEN_BYTES];
+	bool created = false;
 
 	*actwrite = size;
 	dir_curclust = 0;
+	fat_chain_invalidate();
 
 	if (read_bootsectandvi(&bs, &volinfo, &mydata->fatsize)) {
 		debug("error: reading boot sector\n");
@@ -965,6 +1057,7 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 		debug("Error: allocating memory\n");
 		return -1;
 	}
+	init_cluster_alloc(mydata, &bs);
 
 	if (disk_read(cursect,
 		(mydata->fatsize == 32) ?
@@ -992,15 +1085,6 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 		start_cluster = START(retdent);
 
 		if (start_cluster) {
-			if (size) {
-				ret = check_overflow(mydata, start_cluster,
-							size);
-				if (ret) {
-					printf("Error: %llu overflow\n", size);
-					goto exit;
-				}
-			}
-
 			ret = clear_fatent(mydata, start_cluster);
 			if (ret) {
 				printf("Error: clearing FAT entries\n");
@@ -1016,12 +1100,6 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 				goto exit;
 			}
 
-			ret = check_overflow(mydata, start_cluster, size);
-			if (ret) {
-				printf("Error: %llu overflow\n", size);
-				goto exit;
-			}
-
 			set_start_cluster(mydata, retdent, start_cluster);
 		}
 	} else {
@@ -1035,12 +1113,6 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 				printf("Error: finding empty cluster\n");
 				goto exit;
 			}
-
-			ret = check_overflow(mydata, start_cluster, size);
-			if (ret) {
-				printf("Error: %llu overflow\n", size);
-				goto exit;
-			}
 		} else {
 			start_cluster = 0;
 		}
@@ -1050,11 +1122,31 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 			start_cluster, size, 0x20);
 
 		retdent = empty_dentptr;
+		created = true;
 	}
 
 	ret = set_contents(mydata, retdent, buffer, size, actwrite);
 	if (ret < 0) {
 		printf("Error: writing contents\n");
+		/*
+		 * The old contents of a file being overwritten are gone, and
+		 * its entry on the device still points at the new chain, so
+		 * empty the entry before the chain is given back
+		 */
+		if (!created) {
+			retdent->size = 0;
+			set_start_cluster(mydata, retdent, 0);
+			if (set_cluster(mydata, dir_curclust,
+					get_dentfromdir_block,
+					mydata->clust_size *
+					mydata->sect_size)) {
+				printf("Error: writing directory entry\n");
+				goto exit;
+			}
+		}
+		/* Give back the clusters allocated so far */
+		if (start_cluster && !clear_fatent(mydata, start_cluster))
+			flush_cluster_alloc(mydata);
 		goto exit;
 	}
 	debug("attempt to write 0x%llx bytes\n", *actwrite);
@@ -1066,6 +1158,12 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 		goto exit;
 	}
 
+	ret = flush_cluster_alloc(mydata);
+	if (ret) {
+		printf("Error: writing FSInfo\n");
+		goto exit;
+	}
+
 	/* Write directory table to device */
 	ret = set_cluster(mydata, dir_curclust, get_dentfromdir_block,
 			mydata->clust_size * mydata->sect_size);
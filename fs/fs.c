@@ -302,9 +302,11 @@ int fs_read(const char *filename, ulong addr, loff_t offset, loff_t len,
 	 * We don't actually know how many bytes are being read, since len==0
 	 * means read the whole file.
 	 */
+	bootstage_start(BOOTSTAGE_ID_ACCUM_FS, "fs_read");
 	buf = map_sysmem(addr, len);
 	ret = info->read(filename, buf, offset, len, actread);
 	unmap_sysmem(buf);
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_FS);
 
 	/* If we requested a specific number of bytes, check we got it */
 	if (ret == 0 && len && *actread != len)
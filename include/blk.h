@@ -62,6 +62,9 @@ struct blk_desc {
 	char		vendor[40+1];	/* IDE model, SCSI Vendor */
 	char		product[20+1];	/* IDE Serial no, SCSI product */
 	char		revision[8+1];	/* firmware revision */
+#if CONFIG_IS_ENABLED(PARTITION_CACHE)
+	struct part_cache *part_cache;	/* parsed partition table, or NULL */
+#endif
 #ifdef CONFIG_BLK
 	/*
 	 * For now we have a few functions which take struct blk_desc as a
@@ -174,6 +177,20 @@ static inline void blkcache_invalidate(int iftype, int dev) {}
 
 #endif
 
+#if CONFIG_IS_ENABLED(PARTITION_CACHE)
+/**
+ * part_cache_invalidate() - drop the cached partition table of a device
+ *
+ * This must be called whenever the contents of the device may have changed,
+ * so that the partition table is read again on the next lookup.
+ *
+ * @dev_desc:	Block device descriptor
+ */
+void part_cache_invalidate(struct blk_desc *dev_desc);
+#else
+static inline void part_cache_invalidate(struct blk_desc *dev_desc) {}
+#endif
+
 #ifdef CONFIG_BLK
 struct udevice;
 
@@ -397,6 +414,7 @@ static inline ulong blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 			       lbaint_t blkcnt, const void *buffer)
 {
 	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	part_cache_invalidate(block_dev);
 	return block_dev->block_write(block_dev, start, blkcnt, buffer);
 }
 
@@ -404,6 +422,7 @@ static inline ulong blk_derase(struct blk_desc *block_dev, lbaint_t start,
 			       lbaint_t blkcnt)
 {
 	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	part_cache_invalidate(block_dev);
 	return block_dev->block_erase(block_dev, start, blkcnt);
 }
 
@@ -511,6 +530,23 @@ struct blk_desc *blk_get_devnum_by_typename(const char *if_typename,
  */
 int blk_dselect_hwpart(struct blk_desc *desc, int hwpart);
 
+/**
+ * blk_dread_bounce() - read blocks into a buffer of any alignment
+ *
+ * This is blk_dread() for a buffer which may not be aligned to
+ * ARCH_DMA_MINALIGN. Rather than a block at a time, all but the last block
+ * are read into the buffer at its first aligned address, then moved down
+ * into place. The last block is read through an aligned block buffer.
+ *
+ * @block_dev:	Block device descriptor
+ * @start:	First block to read
+ * @blkcnt:	Number of blocks to read
+ * @buffer:	Buffer to read into, of any alignment
+ * @return number of blocks read, or -ve on error
+ */
+ulong blk_dread_bounce(struct blk_desc *block_dev, lbaint_t start,
+		       lbaint_t blkcnt, void *buffer);
+
 /**
  * blk_list_part() - list the partitions for block devices of a given type
  *
@@ -198,6 +198,8 @@ enum bootstage_id {
 	BOOTSTAGE_ID_ACCUM_SCSI,
 	BOOTSTAGE_ID_ACCUM_SPI,
 	BOOTSTAGE_ID_ACCUM_DECOMP,
+	BOOTSTAGE_ID_ACCUM_MMC,
+	BOOTSTAGE_ID_ACCUM_FS,
 	BOOTSTAGE_ID_FPGA_INIT,
 
 	/* a few spare for the user, from here */
@@ -299,6 +301,18 @@ uint32_t bootstage_start(enum bootstage_id id, const char *name);
  */
 uint32_t bootstage_accum(enum bootstage_id id);
 
+/**
+ * Record how long an activity took, under a newly allocated id
+ *
+ * This is for activities timed elsewhere, such as one per device. Like
+ * bootstage_accum() records, it appears with the accumulated times.
+ *
+ * @param name	Textual name to display for the record
+ * @param duration_us	Time taken, in microseconds
+ * @return duration_us
+ */
+uint32_t bootstage_add_duration(const char *name, uint32_t duration_us);
+
 /* Print a report about boot time */
 void bootstage_report(void);
 
@@ -381,6 +395,12 @@ static inline uint32_t bootstage_accum(enum bootstage_id id)
 	return 0;
 }
 
+static inline uint32_t bootstage_add_duration(const char *name,
+					      uint32_t duration_us)
+{
+	return duration_us;
+}
+
 static inline int bootstage_stash(void *base, int size)
 {
 	return 0;	/* Pretend to succeed */
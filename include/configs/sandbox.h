@@ -79,6 +79,7 @@
 
 /* SPI - enable all SPI flash types for testing purposes */
 #define CONFIG_CMD_SF_TEST
+#define CONFIG_SF_DUAL_FLASH
 
 #define CONFIG_I2C_EDID
 
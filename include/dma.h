@@ -83,4 +83,26 @@ int dma_get_device(u32 transfer_type, struct udevice **devp);
  */
 int dma_memcpy(void *dst, void *src, size_t len);
 
+#ifdef CONFIG_DMA
+/*
+ * dma_mmap_copy - copy from a memory-mapped device window, using DMA
+ *		   for large copies
+ *
+ * Copies shorter than CONFIG_DMA_MMAP_COPY_MIN are done by the CPU. For
+ * longer ones, DMA fills the whole cache lines of @dst and the CPU copies
+ * the partial lines at either end, so that no cache maintenance can
+ * touch memory outside @dst. The CPU also takes over if DMA fails.
+ *
+ * @dst - destination pointer
+ * @src - source pointer, in the device window
+ * @len - data length to be copied
+ */
+void dma_mmap_copy(void *dst, void *src, size_t len);
+#else
+static inline void dma_mmap_copy(void *dst, void *src, size_t len)
+{
+	memcpy(dst, src, len);
+}
+#endif
+
 #endif	/* _DMA_H_ */
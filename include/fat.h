@@ -27,7 +27,13 @@
 #define DIRENTSPERCLUST	((mydata->clust_size * mydata->sect_size) / \
 			 sizeof(dir_entry))
 
-#define FATBUFBLOCKS	6
+#ifndef CONFIG_FS_FAT_BUF_SECTORS
+#define CONFIG_FS_FAT_BUF_SECTORS 6
+#endif
+#if CONFIG_FS_FAT_BUF_SECTORS % 3
+#error "CONFIG_FS_FAT_BUF_SECTORS must be a multiple of 3"
+#endif
+#define FATBUFBLOCKS	CONFIG_FS_FAT_BUF_SECTORS
 #define FATBUFSIZE	(mydata->sect_size * FATBUFBLOCKS)
 #define FAT12BUFSIZE	((FATBUFSIZE*2)/3)
 #define FAT16BUFSIZE	(FATBUFSIZE/2)
@@ -136,6 +142,22 @@ typedef struct volume_info
 	/* Boot sign comes last, 2 bytes */
 } volume_info;
 
+/* FAT32 filesystem information sector */
+struct fsinfo_sector {
+	__u32	lead_sig;	/* FSINFO_LEAD_SIG */
+	__u8	reserved1[480];
+	__u32	struct_sig;	/* FSINFO_STRUCT_SIG */
+	__u32	free_count;	/* Free clusters, FSINFO_UNKNOWN if not known */
+	__u32	next_free;	/* Where to look for a free cluster */
+	__u8	reserved2[12];
+	__u32	trail_sig;	/* FSINFO_TRAIL_SIG */
+};
+
+#define FSINFO_LEAD_SIG		0x41615252
+#define FSINFO_STRUCT_SIG	0x61417272
+#define FSINFO_TRAIL_SIG	0xaa550000
+#define FSINFO_UNKNOWN		0xffffffff
+
 typedef struct dir_entry {
 	char	name[8],ext[3];	/* Name and extension */
 	__u8	attr;		/* Attribute bits */
@@ -58,8 +58,21 @@
 #define MMC_MODE_8BIT		(1 << 3)
 #define MMC_MODE_SPI		(1 << 4)
 #define MMC_MODE_DDR_52MHz	(1 << 5)
+#define MMC_MODE_HS200		(1 << 6)
+#define MMC_MODE_HS400		(1 << 7)
+#define MMC_MODE_UHS_SDR50	(1 << 8)
+#define MMC_MODE_UHS_SDR104	(1 << 9)
+#define MMC_MODE_UHS_DDR50	(1 << 10)
+/* Multiple-block transfers are given their length with CMD23 */
+#define MMC_MODE_CMD23		(1 << 11)
+/* The host ends open-ended multiple-block transfers with CMD12 by itself */
+#define MMC_MODE_AUTO_CMD12	(1 << 12)
+
+#define MMC_MODE_UHS		(MMC_MODE_UHS_SDR50 | MMC_MODE_UHS_SDR104 | \
+				 MMC_MODE_UHS_DDR50)
 
 #define SD_DATA_4BIT	0x00040000
+#define SD_SCR_CMD23	0x00000002
 
 #define IS_SD(x)	((x)->version & SD_VERSION_SD)
 #define IS_MMC(x)	((x)->version & MMC_VERSION_MMC)
@@ -82,6 +95,8 @@
 #define MMC_CMD_SET_BLOCKLEN		16
 #define MMC_CMD_READ_SINGLE_BLOCK	17
 #define MMC_CMD_READ_MULTIPLE_BLOCK	18
+#define MMC_CMD_SEND_TUNING_BLOCK	19
+#define MMC_CMD_SEND_TUNING_BLOCK_HS200	21
 #define MMC_CMD_SET_BLOCK_COUNT         23
 #define MMC_CMD_WRITE_SINGLE_BLOCK	24
 #define MMC_CMD_WRITE_MULTIPLE_BLOCK	25
@@ -113,8 +128,16 @@
 #define SD_HIGHSPEED_BUSY	0x00020000
 #define SD_HIGHSPEED_SUPPORTED	0x00020000
 
+/* Access mode functions of SD_CMD_SWITCH_FUNC, group 1 */
+#define SD_SWITCH_SDR25		1	/* also High Speed */
+#define SD_SWITCH_SDR50		2
+#define SD_SWITCH_SDR104	3
+#define SD_SWITCH_DDR50		4
+#define SD_SWITCH_SUPPORTED(f)	(1 << (16 + (f)))
+
 #define OCR_BUSY		0x80000000
 #define OCR_HCS			0x40000000
+#define OCR_S18R		0x01000000	/* S18A in the response */
 #define OCR_VOLTAGE_MASK	0x007FFF80
 #define OCR_ACCESS_MODE		0x60000000
 
@@ -205,6 +228,19 @@
 #define EXT_CSD_CARD_TYPE_DDR_1_2V	(1 << 3)
 #define EXT_CSD_CARD_TYPE_DDR_52	(EXT_CSD_CARD_TYPE_DDR_1_8V \
 					| EXT_CSD_CARD_TYPE_DDR_1_2V)
+#define EXT_CSD_CARD_TYPE_HS200_1_8V	(1 << 4)
+#define EXT_CSD_CARD_TYPE_HS200_1_2V	(1 << 5)
+#define EXT_CSD_CARD_TYPE_HS200		(EXT_CSD_CARD_TYPE_HS200_1_8V \
+					| EXT_CSD_CARD_TYPE_HS200_1_2V)
+#define EXT_CSD_CARD_TYPE_HS400_1_8V	(1 << 6)
+#define EXT_CSD_CARD_TYPE_HS400_1_2V	(1 << 7)
+#define EXT_CSD_CARD_TYPE_HS400		(EXT_CSD_CARD_TYPE_HS400_1_8V \
+					| EXT_CSD_CARD_TYPE_HS400_1_2V)
+
+#define EXT_CSD_TIMING_LEGACY	0	/* no high speed */
+#define EXT_CSD_TIMING_HS	1	/* high speed */
+#define EXT_CSD_TIMING_HS200	2	/* HS200 */
+#define EXT_CSD_TIMING_HS400	3	/* HS400 */
 
 #define EXT_CSD_BUS_WIDTH_1	0	/* Card is in 1 bit mode */
 #define EXT_CSD_BUS_WIDTH_4	1	/* Card is in 4 bit mode */
@@ -321,6 +357,38 @@ struct mmc_data {
 /* forward decl. */
 struct mmc;
 
+/* Bus timing modes, from the slowest */
+enum bus_mode {
+	MMC_LEGACY,
+	SD_LEGACY,
+	MMC_HS,
+	SD_HS,
+	MMC_HS_52,
+	MMC_DDR_52,
+	UHS_SDR12,
+	UHS_SDR25,
+	UHS_SDR50,
+	UHS_DDR50,
+	UHS_SDR104,
+	MMC_HS_200,
+	MMC_HS_400,
+	MMC_MODES_END
+};
+
+/* I/O signalling voltage, which starts at 3.3V */
+enum mmc_voltage {
+	MMC_SIGNAL_VOLTAGE_330,
+	MMC_SIGNAL_VOLTAGE_180,
+};
+
+/**
+ * mmc_mode_name() - Get the name of a bus timing mode
+ *
+ * @mode:	Mode to look up
+ * @return name of the mode, e.g. "HS200"
+ */
+const char *mmc_mode_name(enum bus_mode mode);
+
 #ifdef CONFIG_DM_MMC_OPS
 struct dm_mmc_ops {
 	/**
@@ -357,6 +425,29 @@ struct dm_mmc_ops {
 	 * @return 0 if write-enabled, 1 if write-protected, -ve on error
 	 */
 	int (*get_wp)(struct udevice *dev);
+
+	/**
+	 * execute_tuning() - Find the sampling point for the current mode
+	 *
+	 * The host sends the tuning command until it reliably reads back the
+	 * tuning block. This is needed by HS200 and SD UHS-I SDR104.
+	 *
+	 * @dev:	Device to tune
+	 * @opcode:	Tuning command, MMC_CMD_SEND_TUNING_BLOCK(_HS200)
+	 * @return 0 if OK, -ve on error
+	 */
+	int (*execute_tuning)(struct udevice *dev, uint opcode);
+
+	/**
+	 * card_busy() - See whether the card holds its data lines low
+	 *
+	 * The SD card signals the progress of a switch to 1.8V (CMD11) on
+	 * DAT[3:0]. This lets the switch be checked.
+	 *
+	 * @dev:	Device to check
+	 * @return 1 if DAT[3:0] read 0000, 0 if they do not, -ve on error
+	 */
+	int (*card_busy)(struct udevice *dev);
 };
 
 #define mmc_get_ops(dev)        ((struct dm_mmc_ops *)(dev)->driver->ops)
@@ -366,11 +457,15 @@ int dm_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 int dm_mmc_set_ios(struct udevice *dev);
 int dm_mmc_get_cd(struct udevice *dev);
 int dm_mmc_get_wp(struct udevice *dev);
+int dm_mmc_execute_tuning(struct udevice *dev, uint opcode);
+int dm_mmc_card_busy(struct udevice *dev);
 
 /* Transition functions for compatibility */
 int mmc_set_ios(struct mmc *mmc);
 int mmc_getcd(struct mmc *mmc);
 int mmc_getwp(struct mmc *mmc);
+int mmc_execute_tuning(struct mmc *mmc, uint opcode);
+int mmc_card_busy(struct mmc *mmc);
 
 #else
 struct mmc_ops {
@@ -380,6 +475,8 @@ struct mmc_ops {
 	int (*init)(struct mmc *mmc);
 	int (*getcd)(struct mmc *mmc);
 	int (*getwp)(struct mmc *mmc);
+	int (*execute_tuning)(struct mmc *mmc, uint opcode);
+	int (*card_busy)(struct mmc *mmc);
 };
 #endif
 
@@ -450,7 +547,11 @@ struct mmc {
 	char op_cond_pending;	/* 1 if we are waiting on an op_cond command */
 	char init_in_progress;	/* 1 if we have done mmc_start_init() */
 	char preinit;		/* start init as early as possible */
+	ulong init_start_us;	/* timer_get_us() at mmc_start_init() */
+	uint init_time_us;	/* time the first init took, 0 until done */
 	int ddr_mode;
+	enum bus_mode selected_mode;	/* bus timing, for set_ios() */
+	enum mmc_voltage signal_voltage;	/* I/O voltage, for set_ios() */
 #ifdef CONFIG_DM_MMC
 	struct udevice *dev;	/* Device for this MMC controller */
 #endif
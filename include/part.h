@@ -165,6 +165,20 @@ int blk_get_device_part_str(const char *ifname, const char *dev_part_str,
 int part_get_info_by_name(struct blk_desc *dev_desc,
 			      const char *name, disk_partition_t *info);
 
+#ifdef CONFIG_PARTITION_UUIDS
+/**
+ * part_get_info_by_uuid() - Search for a partition by its unique UUID
+ *
+ * @param dev_desc - block device descriptor
+ * @param uuid - the partition UUID, as a string (case is ignored)
+ * @param info - returns the disk partition info
+ *
+ * @return - partition number (1 = first) on match, '-1' on no match
+ */
+int part_get_info_by_uuid(struct blk_desc *dev_desc, const char *uuid,
+			  disk_partition_t *info);
+#endif
+
 /**
  * part_set_generic_name() - create generic partition like hda1 or sdb2
  *
@@ -234,6 +248,20 @@ struct part_driver {
 	int (*get_info)(struct blk_desc *dev_desc, int part,
 			disk_partition_t *info);
 
+	/**
+	 * get_all_info() - Get information about all partitions at once
+	 *
+	 * This is optional. It lets the whole table be read and parsed in
+	 * one go when it is cached, rather than once per partition.
+	 *
+	 * @dev_desc:	Block device descriptor
+	 * @info:	Returns partition information, with room for
+	 *		max_entries partitions. Partition n goes in info[n - 1],
+	 *		and unused entries have a size of 0.
+	 * @return 0 if OK, -ve on error
+	 */
+	int (*get_all_info)(struct blk_desc *dev_desc, disk_partition_t *info);
+
 	/**
 	 * print() - Print partition information
 	 *
@@ -19,6 +19,7 @@
  */
 
 #define SDHCI_DMA_ADDRESS	0x00
+#define SDHCI_ARGUMENT2		SDHCI_DMA_ADDRESS
 
 #define SDHCI_BLOCK_SIZE	0x04
 #define  SDHCI_MAKE_BLKSZ(dma, blksz) (((dma & 0x7) << 12) | (blksz & 0xFFF))
@@ -31,6 +32,7 @@
 #define  SDHCI_TRNS_DMA		BIT(0)
 #define  SDHCI_TRNS_BLK_CNT_EN	BIT(1)
 #define  SDHCI_TRNS_ACMD12	BIT(2)
+#define  SDHCI_TRNS_AUTO_CMD23	BIT(3)
 #define  SDHCI_TRNS_READ	BIT(4)
 #define  SDHCI_TRNS_MULTI	BIT(5)
 
@@ -140,7 +142,8 @@
 #define  SDHCI_INT_DATA_MASK	(SDHCI_INT_DATA_END | SDHCI_INT_DMA_END | \
 		SDHCI_INT_DATA_AVAIL | SDHCI_INT_SPACE_AVAIL | \
 		SDHCI_INT_DATA_TIMEOUT | SDHCI_INT_DATA_CRC | \
-		SDHCI_INT_DATA_END_BIT | SDHCI_INT_ADMA_ERROR)
+		SDHCI_INT_DATA_END_BIT | SDHCI_INT_ACMD12ERR | \
+		SDHCI_INT_ADMA_ERROR)
 #define SDHCI_INT_ALL_MASK	((unsigned int)-1)
 
 #define SDHCI_ACMD12_ERR	0x3C
@@ -182,6 +185,7 @@
 /* 55-57 reserved */
 
 #define SDHCI_ADMA_ADDRESS	0x58
+#define SDHCI_ADMA_ADDRESS_HI	0x5C
 
 /* 60-FB reserved */
 
@@ -216,6 +220,13 @@
 #define SDHCI_QUIRK_WAIT_SEND_CMD	(1 << 6)
 #define SDHCI_QUIRK_USE_WIDE8		(1 << 8)
 
+/*
+ * host flags, found out from the capabilities
+ */
+#define SDHCI_USE_ADMA			(1 << 0)
+#define SDHCI_USE_ADMA64		(1 << 1)
+#define SDHCI_AUTO_CMD23		(1 << 2)
+
 /* to make gcc happy */
 struct sdhci_host;
 
@@ -224,6 +235,34 @@ struct sdhci_host;
  */
 #define SDHCI_DEFAULT_BOUNDARY_SIZE	(512 * 1024)
 #define SDHCI_DEFAULT_BOUNDARY_ARG	(7)
+
+/*
+ * ADMA2 descriptor table. Each descriptor moves up to 64 KiB (a length of
+ * zero stands for 64 KiB), so one table covers the biggest transfer the
+ * MMC core asks for.
+ */
+#define ADMA_DESC_ATTR_VALID		BIT(0)
+#define ADMA_DESC_ATTR_END		BIT(1)
+#define ADMA_DESC_ATTR_INT		BIT(2)
+#define ADMA_DESC_ATTR_ACT_TRAN		(0x2 << 4)
+#define ADMA_DESC_ATTR_ACT_LINK		(0x3 << 4)
+
+#define ADMA_MAX_LEN			(64 * 1024)
+#define ADMA_DESC_LEN			8
+#define ADMA_DESC_64_LEN		12
+#define ADMA_TABLE_NUM_DESC		\
+	DIV_ROUND_UP(CONFIG_SYS_MMC_MAX_BLK_COUNT * MMC_MAX_BLOCK_LEN, \
+		     ADMA_MAX_LEN)
+#define ADMA_TABLE_SZ			\
+	ALIGN(ADMA_TABLE_NUM_DESC * ADMA_DESC_64_LEN, CONFIG_SYS_CACHELINE_SIZE)
+
+/* addr_hi is only there in the 64-bit table */
+struct sdhci_adma_desc {
+	u16 attr;
+	u16 len;
+	u32 addr_lo;
+	u32 addr_hi;
+};
 struct sdhci_ops {
 #ifdef CONFIG_MMC_SDHCI_IO_ACCESSORS
 	u32	(*read_l)(struct sdhci_host *host, int reg);
@@ -249,6 +288,12 @@ struct sdhci_host {
 	struct mmc *mmc;
 	const struct sdhci_ops *ops;
 	int index;
+	unsigned int flags;	/* SDHCI_USE_... */
+#ifdef CONFIG_MMC_SDHCI_ADMA
+	void *adma_desc_table;
+#endif
+	bool sbc_pending;	/* CMD23 came before the next command */
+	u32 sbc_arg;		/* CMD23 argument, for Auto-CMD23 */
 
 	int bus_width;
 	struct gpio_desc pwr_gpio;	/* Power GPIO */
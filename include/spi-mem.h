@@ -0,0 +1,261 @@
+/*
+ * SPI memory operations
+ *
+ * A SPI memory operation is a command, an optional address, optional dummy
+ * bytes and optional data, each with its own bus width. Describing it this
+ * way lets controllers see the structure of what they are asked to do,
+ * rather than a buffer of command bytes they would have to parse.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef _SPI_MEM_H_
+#define _SPI_MEM_H_
+
+#include <linux/types.h>
+
+struct spi_slave;
+
+#define SPI_MEM_OP_CMD(__opcode, __buswidth)			\
+	{							\
+		.buswidth = __buswidth,				\
+		.opcode = __opcode,				\
+	}
+
+#define SPI_MEM_OP_ADDR(__nbytes, __val, __buswidth)		\
+	{							\
+		.nbytes = __nbytes,				\
+		.val = __val,					\
+		.buswidth = __buswidth,				\
+	}
+
+#define SPI_MEM_OP_NO_ADDR	{ }
+
+#define SPI_MEM_OP_DUMMY(__nbytes, __buswidth)			\
+	{							\
+		.nbytes = __nbytes,				\
+		.buswidth = __buswidth,				\
+	}
+
+#define SPI_MEM_OP_NO_DUMMY	{ }
+
+#define SPI_MEM_OP_DATA_IN(__nbytes, __buf, __buswidth)		\
+	{							\
+		.dir = SPI_MEM_DATA_IN,				\
+		.nbytes = __nbytes,				\
+		.buf.in = __buf,				\
+		.buswidth = __buswidth,				\
+	}
+
+#define SPI_MEM_OP_DATA_OUT(__nbytes, __buf, __buswidth)	\
+	{							\
+		.dir = SPI_MEM_DATA_OUT,			\
+		.nbytes = __nbytes,				\
+		.buf.out = __buf,				\
+		.buswidth = __buswidth,				\
+	}
+
+#define SPI_MEM_OP_NO_DATA	{ }
+
+#define SPI_MEM_OP(__cmd, __addr, __dummy, __data)		\
+	{							\
+		.cmd = __cmd,					\
+		.addr = __addr,					\
+		.dummy = __dummy,				\
+		.data = __data,					\
+	}
+
+/* Direction of the data phase of an operation */
+enum spi_mem_data_dir {
+	SPI_MEM_DATA_IN,
+	SPI_MEM_DATA_OUT,
+};
+
+/* Longest opcode, address and dummy phase the generic fallback can send */
+#define SPI_MEM_MAX_CMD_LEN	16
+
+/**
+ * struct spi_mem_op - A SPI memory operation
+ *
+ * @cmd.buswidth:	Number of lines the opcode is sent on
+ * @cmd.opcode:		Operation opcode
+ * @addr.nbytes:	Number of address bytes, 0 for no address
+ * @addr.buswidth:	Number of lines the address is sent on
+ * @addr.val:		Address, sent MSB first
+ * @dummy.nbytes:	Number of dummy bytes, 0 for none. The number of dummy
+ *			clock cycles is nbytes * 8 / buswidth
+ * @dummy.buswidth:	Number of lines the dummy bytes are sent on
+ * @data.buswidth:	Number of lines the data is transferred on
+ * @data.dir:		Direction of the transfer
+ * @data.nbytes:	Number of data bytes, 0 for no data phase
+ * @data.buf.in:	Buffer to receive into, for SPI_MEM_DATA_IN
+ * @data.buf.out:	Buffer to send from, for SPI_MEM_DATA_OUT
+ */
+struct spi_mem_op {
+	struct {
+		u8 buswidth;
+		u8 opcode;
+	} cmd;
+
+	struct {
+		u8 nbytes;
+		u8 buswidth;
+		u64 val;
+	} addr;
+
+	struct {
+		u8 nbytes;
+		u8 buswidth;
+	} dummy;
+
+	struct {
+		u8 buswidth;
+		enum spi_mem_data_dir dir;
+		unsigned int nbytes;
+		union {
+			void *in;
+			const void *out;
+		} buf;
+	} data;
+};
+
+/**
+ * struct spi_mem_dirmap_desc - A direct (memory-mapped) read window
+ *
+ * Controllers with a memory-mapped aperture expose the memory through a
+ * window of their own size. For memories larger than the window, the
+ * window is moved to wherever the next read falls, and is left in place
+ * between reads so that reads close together need no reprogramming.
+ *
+ * @slave:		SPI slave the window is for
+ * @op_tmpl:		Read operation the controller issues for accesses
+ *			through the window. Its address and data are unused
+ * @length:		Size of the memory behind the window
+ * @map:		Window base, set by dirmap_create
+ * @window_size:	Size of the window, set by dirmap_create
+ * @window_offset:	Memory offset currently shown at @map
+ * @window_valid:	true if @map shows @window_offset with the current
+ *			memory contents
+ * @priv:		Controller private data
+ */
+struct spi_mem_dirmap_desc {
+	struct spi_slave *slave;
+	struct spi_mem_op op_tmpl;
+	u32 length;
+	void *map;
+	u32 window_size;
+	u32 window_offset;
+	bool window_valid;
+	void *priv;
+};
+
+/**
+ * struct spi_controller_mem_ops - Controller support for SPI memory ops
+ *
+ * Controllers which understand SPI memory operations provide these in
+ * struct dm_spi_ops. Others are driven through spi_xfer() instead.
+ *
+ * @supports_op:	Check whether the controller can run an operation.
+ *			If NULL, the generic check against the slave's
+ *			SPI_TX_xxx / SPI_RX_xxx mode is used
+ * @exec_op:		Run an operation. Return -ENOTSUPP to have it sent
+ *			through spi_xfer() instead
+ * @dirmap_create:	Set up a read window for a descriptor, filling in
+ *			map and window_size. Return -ENOTSUPP if there is no
+ *			window for this slave. May be NULL
+ * @dirmap_move:	Point the window at an offset, which is a multiple of
+ *			window_size. The controller must leave mapped mode by
+ *			itself before running any other operation
+ * @dirmap_destroy:	Release what dirmap_create set up. May be NULL
+ */
+struct spi_controller_mem_ops {
+	bool (*supports_op)(struct spi_slave *slave,
+			    const struct spi_mem_op *op);
+	int (*exec_op)(struct spi_slave *slave, const struct spi_mem_op *op);
+	int (*dirmap_create)(struct spi_mem_dirmap_desc *desc);
+	int (*dirmap_move)(struct spi_mem_dirmap_desc *desc, u32 offset);
+	void (*dirmap_destroy)(struct spi_mem_dirmap_desc *desc);
+};
+
+/**
+ * spi_mem_default_supports_op() - Check an op against the slave's mode
+ *
+ * Each phase wider than one line needs the matching SPI_TX_xxx or
+ * SPI_RX_xxx flag in the slave's mode.
+ *
+ * @slave:	SPI slave the operation is for
+ * @op:		Operation to check
+ * @return true if the bus widths of @op are allowed
+ */
+bool spi_mem_default_supports_op(struct spi_slave *slave,
+				 const struct spi_mem_op *op);
+
+/**
+ * spi_mem_supports_op() - Check whether an operation can be run
+ *
+ * @slave:	SPI slave the operation is for
+ * @op:		Operation to check
+ * @return true if spi_mem_exec_op() can run @op
+ */
+bool spi_mem_supports_op(struct spi_slave *slave, const struct spi_mem_op *op);
+
+/**
+ * spi_mem_exec_op() - Run a SPI memory operation
+ *
+ * The controller runs the operation itself if it can. Otherwise the
+ * opcode, address and dummy bytes are sent with spi_xfer(), followed by
+ * the data. The bus must already be claimed.
+ *
+ * @slave:	SPI slave to run the operation on
+ * @op:		Operation to run
+ * @return 0 if OK, -ENOTSUPP if @op is not supported, other -ve on error
+ */
+int spi_mem_exec_op(struct spi_slave *slave, const struct spi_mem_op *op);
+
+/**
+ * spi_mem_dirmap_create() - Set up a direct-mapped read window
+ *
+ * @slave:	SPI slave to map
+ * @op_tmpl:	Read operation to use for accesses through the window
+ * @length:	Size of the memory to map
+ * @descp:	Returns the new window descriptor
+ * @return 0 if OK, -ENOTSUPP if the controller has no window, other -ve
+ * on error
+ */
+int spi_mem_dirmap_create(struct spi_slave *slave,
+			  const struct spi_mem_op *op_tmpl, u32 length,
+			  struct spi_mem_dirmap_desc **descp);
+
+/**
+ * spi_mem_dirmap_read() - Read through a direct-mapped window
+ *
+ * The window is moved only when the data lies outside it. The bus must
+ * already be claimed.
+ *
+ * @desc:	Window to read through
+ * @offset:	Memory offset to read from
+ * @len:	Number of bytes to read
+ * @buf:	Buffer to read into
+ * @return 0 if OK, -ve on error
+ */
+int spi_mem_dirmap_read(struct spi_mem_dirmap_desc *desc, u32 offset,
+			size_t len, void *buf);
+
+/**
+ * spi_mem_dirmap_invalidate() - Drop what a window shows
+ *
+ * Call this after changing the memory, so that the next read through the
+ * window sees the new contents.
+ *
+ * @desc:	Window to invalidate, or NULL
+ */
+void spi_mem_dirmap_invalidate(struct spi_mem_dirmap_desc *desc);
+
+/**
+ * spi_mem_dirmap_destroy() - Remove a direct-mapped window
+ *
+ * @desc:	Window to remove, or NULL
+ */
+void spi_mem_dirmap_destroy(struct spi_mem_dirmap_desc *desc);
+
+#endif /* _SPI_MEM_H_ */
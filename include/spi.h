@@ -344,6 +344,8 @@ struct spi_slave *spi_base_setup_slave_fdt(const void *blob, int busnum,
 
 #ifdef CONFIG_DM_SPI
 
+struct spi_controller_mem_ops;
+
 /**
  * struct spi_cs_info - Information about a bus chip select
  *
@@ -464,6 +466,32 @@ struct dm_spi_ops {
 	 *	   is invalid, other -ve value on error
 	 */
 	int (*cs_info)(struct udevice *bus, uint cs, struct spi_cs_info *info);
+
+	/**
+	 * Wait for a status register bit, polling it in hardware
+	 *
+	 * This repeatedly sends @opcode and reads back one status byte until
+	 * the bits in @mask equal @match. Controllers which can poll in
+	 * hardware provide this to save a full transfer for each poll. The
+	 * bus is already claimed.
+	 *
+	 * @dev:	The SPI slave
+	 * @opcode:	Command which reads the status register
+	 * @mask:	Status bits to check
+	 * @match:	Value which the bits in @mask must reach
+	 * @timeout_ms:	Time to wait before giving up, in milliseconds
+	 * @return 0 if the status matched, -ETIMEDOUT on timeout, -ENOSYS
+	 *	   if the controller cannot poll for this, other -ve on error
+	 */
+	int (*wait_status)(struct udevice *dev, u8 opcode, u8 mask, u8 match,
+			   ulong timeout_ms);
+
+	/*
+	 * Support for SPI memory operations (see spi-mem.h), for controllers
+	 * which can run an opcode, address, dummy and data sequence with
+	 * their own bus widths themselves. May be NULL.
+	 */
+	const struct spi_controller_mem_ops *mem_ops;
 };
 
 struct dm_spi_emul_ops {
@@ -651,6 +679,22 @@ void dm_spi_release_bus(struct udevice *dev);
 int dm_spi_xfer(struct udevice *dev, unsigned int bitlen,
 		const void *dout, void *din, unsigned long flags);
 
+/**
+ * dm_spi_wait_status() - Wait for a status register bit in hardware
+ *
+ * See struct dm_spi_ops->wait_status for details.
+ *
+ * @dev:	The SPI slave device
+ * @opcode:	Command which reads the status register
+ * @mask:	Status bits to check
+ * @match:	Value which the bits in @mask must reach
+ * @timeout_ms:	Time to wait before giving up, in milliseconds
+ * @return 0 if the status matched, -ETIMEDOUT on timeout, -ENOSYS if the
+ *	   controller cannot poll in hardware, so the caller must do it
+ */
+int dm_spi_wait_status(struct udevice *dev, u8 opcode, u8 mask, u8 match,
+		       ulong timeout_ms);
+
 /* Access the operations for a SPI device */
 #define spi_get_ops(dev)	((struct dm_spi_ops *)(dev)->driver->ops)
 #define spi_emul_get_ops(dev)	((struct dm_spi_emul_ops *)(dev)->driver->ops)
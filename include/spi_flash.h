@@ -12,6 +12,7 @@
 
 #include <dm.h>	/* Because we dereference struct udevice here */
 #include <linux/types.h>
+#include <u-boot/sha256.h>
 
 #ifndef CONFIG_SF_DEFAULT_SPEED
 # define CONFIG_SF_DEFAULT_SPEED	1000000
@@ -27,6 +28,96 @@
 #endif
 
 struct spi_slave;
+struct spi_mem_dirmap_desc;
+
+/* Maximum number of block erase commands a flash can offer */
+#define SPI_FLASH_MAX_ERASE_TYPES	4
+
+/**
+ * struct spi_flash_erase_type - A block erase command of the flash
+ *
+ * @size:	Bytes erased by the command, 0 if this slot is unused
+ * @opcode:	Erase command
+ * @count:	Number of times the last erase operation issued it
+ */
+struct spi_flash_erase_type {
+	u32 size;
+	u8 opcode;
+	u32 count;
+};
+
+/**
+ * struct spi_flash_write_stats - How the last write operation went
+ *
+ * @pages:	Number of page program commands issued
+ * @polls:	Number of status reads while waiting for programming, not
+ *		counting those done by a hardware poller in the controller
+ * @time_us:	Wall time taken, in microseconds
+ */
+struct spi_flash_write_stats {
+	u32 pages;
+	u32 polls;
+	ulong time_us;
+};
+
+/**
+ * struct spi_flash_async_erase - An erase running in the background
+ *
+ * @offset:	Offset of the block being erased, or of the next one
+ * @len:	Bytes left to erase, counting the block being erased. 0 if
+ *		no erase is running
+ * @block:	Size of the block being erased, 0 if none is in flight
+ * @timeout:	How long the block may take, in milliseconds
+ * @timebase:	get_timer() base for the block, not counting time it spent
+ *		suspended
+ * @resume_us:	timer_get_us() when the block was last resumed
+ * @suspended:	true if the erase is suspended. If @block is set, the flash
+ *		is in erase suspend
+ */
+struct spi_flash_async_erase {
+	u32 offset;
+	size_t len;
+	u32 block;
+	ulong timeout;
+	ulong timebase;
+	ulong resume_us;
+	bool suspended;
+};
+
+/* Checksum a verified write accumulates */
+enum spi_flash_verify_algo {
+	SPI_FLASH_VERIFY_NONE,		/* compare only */
+	SPI_FLASH_VERIFY_CRC32,
+	SPI_FLASH_VERIFY_SHA256,
+};
+
+/**
+ * struct spi_flash_verify - Verify-after-write of a write operation
+ *
+ * Set up by spi_flash_verify_begin() and finished by spi_flash_verify_end()
+ *
+ * @algo:	Checksum to accumulate
+ * @pos:	Next offset to add to the checksum
+ * @end:	End of the range being written
+ * @buf:	Page buffer for the read-back
+ * @crc32:	Running CRC32
+ * @sha256:	Running SHA256
+ * @digest:	Checksum of the range, set by spi_flash_verify_end(). A CRC32
+ *		is stored big-endian
+ * @digest_len:	Number of bytes in @digest
+ */
+struct spi_flash_verify {
+	enum spi_flash_verify_algo algo;
+	u32 pos;
+	u32 end;
+	u8 *buf;
+	u32 crc32;
+#ifdef CONFIG_SHA256
+	sha256_context sha256;
+#endif
+	u8 digest[SHA256_SUM_LEN];
+	uint digest_len;
+};
 
 /**
  * struct spi_flash - SPI flash structure
@@ -35,20 +126,37 @@ struct spi_slave;
  * @dev:		SPI flash device
  * @name:		Name of SPI flash
  * @dual_flash:		Indicates dual flash memories - dual stacked, parallel
+ * @dual_chips:		The two chips of a dual flash combined in software,
+ *			NULL otherwise
  * @shift:		Flash shift useful in dual parallel
  * @flags:		Indication of spi flash flags
  * @size:		Total flash size
  * @page_size:		Write (page) size
  * @sector_size:	Sector size
  * @erase_size:		Erase size
+ * @addr_width:		Number of address bytes sent with each cmd - 3 or 4
  * @bank_read_cmd:	Bank read cmd
  * @bank_write_cmd:	Bank write cmd
  * @bank_curr:		Current flash bank
  * @erase_cmd:		Erase cmd 4K, 32K, 64K
+ * @erase_types:	Block erase commands, smallest first. Erases are
+ *			planned over all of these, not just @erase_cmd
+ * @erase_chip_count:	Number of chip erases the last erase operation issued
+ * @write_stats:	Statistics of the last write operation
+ * @prog_time_us:	Running estimate of the page program time, used to
+ *			space out status polls, seeded at probe
+ * @async_erase:	Erase running in the background, if any
+ * @verify:		Verify-after-write in progress, if any. Only with
+ *			CONFIG_SPI_FLASH_VERIFY
+ * @probe_hz:		SPI speed the flash was probed for, 0 for the device
+ *			tree setting
+ * @probe_mode:		SPI mode the flash was probed for, with @probe_hz
  * @read_cmd:		Read cmd - Array Fast, Extn read and quad read.
  * @write_cmd:		Write cmd - page and quad program.
  * @dummy_byte:		Dummy cycles for read operation.
  * @memory_map:		Address of read-only SPI flash access
+ * @dirmap:		Controller read window, used when there is no
+ *			@memory_map. NULL if the controller has none
  * @flash_lock:		lock a region of the SPI Flash
  * @flash_unlock:	unlock a region of the SPI Flash
  * @flash_is_locked:	check if a region of the SPI Flash is completely locked
@@ -69,11 +177,15 @@ struct spi_flash {
 	u8 dual_flash;
 	u8 shift;
 	u16 flags;
+#ifdef CONFIG_SPI_FLASH_DUAL
+	struct spi_flash *dual_chips;
+#endif
 
 	u32 size;
 	u32 page_size;
 	u32 sector_size;
 	u32 erase_size;
+	u8 addr_width;
 #ifdef CONFIG_SPI_FLASH_BAR
 	u8 bank_read_cmd;
 	u8 bank_write_cmd;
@@ -83,8 +195,19 @@ struct spi_flash {
 	u8 read_cmd;
 	u8 write_cmd;
 	u8 dummy_byte;
+	struct spi_flash_erase_type erase_types[SPI_FLASH_MAX_ERASE_TYPES];
+	u32 erase_chip_count;
+	struct spi_flash_write_stats write_stats;
+	u32 prog_time_us;
+	struct spi_flash_async_erase async_erase;
+#if CONFIG_IS_ENABLED(SPI_FLASH_VERIFY)
+	struct spi_flash_verify *verify;
+#endif
+	uint probe_hz;
+	uint probe_mode;
 
 	void *memory_map;
+	struct spi_mem_dirmap_desc *dirmap;
 
 	int (*flash_lock)(struct spi_flash *flash, u32 ofs, size_t len);
 	int (*flash_unlock)(struct spi_flash *flash, u32 ofs, size_t len);
@@ -113,6 +236,10 @@ struct dm_spi_flash_ops {
 	int (*write)(struct udevice *dev, u32 offset, size_t len,
 		     const void *buf);
 	int (*erase)(struct udevice *dev, u32 offset, size_t len);
+	int (*erase_start)(struct udevice *dev, u32 offset, size_t len);
+	int (*erase_poll)(struct udevice *dev);
+	int (*erase_suspend)(struct udevice *dev);
+	int (*erase_resume)(struct udevice *dev);
 };
 
 /* Access the serial operations for a device */
@@ -154,6 +281,131 @@ int spi_flash_write_dm(struct udevice *dev, u32 offset, size_t len,
  */
 int spi_flash_erase_dm(struct udevice *dev, u32 offset, size_t len);
 
+/**
+ * spi_flash_erase_start_dm() - Start erasing blocks in the background
+ *
+ * This returns once the first block erase has been issued. The flash
+ * stays usable while the erase runs: a read suspends the erase if the
+ * flash supports erase suspend, and otherwise waits just for the block in
+ * flight, not the whole erase. Writes and other erases fail with -EBUSY
+ * until the erase is done.
+ *
+ * @dev:	SPI flash device
+ * @offset:	Offset into device in bytes to start erasing
+ * @len:	Number of bytes to erase, a multiple of the smallest erase size
+ * @return 0 if OK, -EBUSY if an erase is already running, other -ve on
+ * error
+ */
+int spi_flash_erase_start_dm(struct udevice *dev, u32 offset, size_t len);
+
+/**
+ * spi_flash_erase_poll_dm() - Make progress with a background erase
+ *
+ * This checks whether the block in flight has finished and, if so, starts
+ * the next one. It does not wait.
+ *
+ * @dev:	SPI flash device
+ * @return 0 if the erase has finished (or none was running), -EBUSY while
+ * it is still running or suspended, other -ve on error, which also ends
+ * the erase
+ */
+int spi_flash_erase_poll_dm(struct udevice *dev);
+
+/**
+ * spi_flash_erase_suspend_dm() - Suspend a background erase
+ *
+ * The block in flight is suspended with the erase suspend command if the
+ * flash has one; otherwise it is left to finish first. Either way, no
+ * block is started until spi_flash_erase_resume_dm() is called.
+ *
+ * @dev:	SPI flash device
+ * @return 0 if OK, -ve on error
+ */
+int spi_flash_erase_suspend_dm(struct udevice *dev);
+
+/**
+ * spi_flash_erase_resume_dm() - Resume a suspended background erase
+ *
+ * @dev:	SPI flash device
+ * @return 0 if OK, -ve on error
+ */
+int spi_flash_erase_resume_dm(struct udevice *dev);
+
+/**
+ * struct spi_flash_cache_stats - How the SPI flash read cache is doing
+ *
+ * @hits:	Lines reads were served from without going to the flash
+ * @misses:	Lines which had to be read from the flash
+ * @readahead:	Lines read ahead of a sequential read
+ * @lines:	Lines in the cache
+ * @max_lines:	Lines the cache can hold
+ */
+struct spi_flash_cache_stats {
+	uint hits;
+	uint misses;
+	uint readahead;
+	uint lines;
+	uint max_lines;
+};
+
+#ifdef CONFIG_SPI_FLASH_CACHE
+/**
+ * spi_flash_cache_read() - Read from SPI flash through the read cache
+ *
+ * Reads of up to a cache line are served from the cache, reading the
+ * lines they need from the flash if they are not there yet.
+ *
+ * @dev:	SPI flash device
+ * @offset:	Offset into the device in bytes to read from
+ * @len:	Number of bytes to read
+ * @buf:	Buffer to put the data that is read
+ * @return 1 if the data was read, 0 if it is to be read from the flash
+ */
+int spi_flash_cache_read(struct udevice *dev, u32 offset, size_t len,
+			 void *buf);
+
+/**
+ * spi_flash_cache_invalidate() - Drop the cached lines of a range
+ *
+ * @dev:	SPI flash device
+ * @offset:	Offset of the range, which is about to change
+ * @len:	Length of the range
+ */
+void spi_flash_cache_invalidate(struct udevice *dev, u32 offset, size_t len);
+
+/**
+ * spi_flash_cache_stats() - Get the read cache statistics
+ *
+ * @stats:	Returns the statistics
+ * @reset:	true to reset the hit, miss and read-ahead counts
+ */
+void spi_flash_cache_stats(struct spi_flash_cache_stats *stats, bool reset);
+#else
+static inline int spi_flash_cache_read(struct udevice *dev, u32 offset,
+				       size_t len, void *buf)
+{
+	return 0;
+}
+
+static inline void spi_flash_cache_invalidate(struct udevice *dev,
+					      u32 offset, size_t len) {}
+#endif
+
+/**
+ * spi_flash_probe_bus_cs() - Find and probe the SPI flash at a chip select
+ *
+ * A flash which is already probed is used as it is, without scanning it
+ * again, as long as @max_hz and @spi_mode are those it was probed for or
+ * @max_hz is 0. Otherwise it is removed and probed afresh. Remove the
+ * device first to force a new scan.
+ *
+ * @busnum:	SPI bus number
+ * @cs:		Chip select
+ * @max_hz:	SPI speed, 0 to use the device tree settings
+ * @spi_mode:	SPI mode, used when @max_hz is not 0
+ * @devp:	Returns the SPI flash device
+ * @return 0 if OK, -ve on error
+ */
 int spi_flash_probe_bus_cs(unsigned int busnum, unsigned int cs,
 			   unsigned int max_hz, unsigned int spi_mode,
 			   struct udevice **devp);
@@ -190,6 +442,23 @@ int sandbox_sf_bind_emul(struct sandbox_state *state, int busnum, int cs,
 
 void sandbox_sf_unbind_emul(struct sandbox_state *state, int busnum, int cs);
 
+/**
+ * sandbox_sf_set_erase_time() - Set how long the emulated flash erases for
+ *
+ * @dev:	SPI flash emulator device
+ * @erase_us:	Time to erase each 4KiB in microseconds, 0 to erase at once
+ */
+void sandbox_sf_set_erase_time(struct udevice *dev, uint erase_us);
+
+/**
+ * sandbox_sf_set_prog_time() - Set how long the emulated flash programs for
+ *
+ * @dev:	SPI flash emulator device
+ * @prog_us:	Time to program each page in microseconds, 0 to program at
+ *		once
+ */
+void sandbox_sf_set_prog_time(struct udevice *dev, uint prog_us);
+
 #else
 struct spi_flash *spi_flash_probe(unsigned int bus, unsigned int cs,
 		unsigned int max_hz, unsigned int spi_mode);
@@ -239,4 +508,80 @@ static inline int spi_flash_protect(struct spi_flash *flash, u32 ofs, u32 len,
 		return flash->flash_unlock(flash, ofs, len);
 }
 
+/**
+ * struct spi_flash_update_stats - What spi_flash_update() did to the flash
+ *
+ * @erased:	Bytes erased
+ * @programmed:	Bytes programmed, including data restored after an erase
+ * @skipped:	Bytes of the update which needed no programming
+ * @erased_ahead: Bytes of @erased which were erased while the block before
+ *		was checked
+ * @done:	Bytes of the update handled so far
+ * @progress:	Called after each block is handled, if not NULL
+ */
+struct spi_flash_update_stats {
+	size_t erased;
+	size_t programmed;
+	size_t skipped;
+	size_t erased_ahead;
+	size_t done;
+	void (*progress)(struct spi_flash_update_stats *stats);
+};
+
+/**
+ * spi_flash_update() - Write data to SPI flash, touching only what changed
+ *
+ * Each block of the smallest erase size is compared with the new data.
+ * Blocks where the new data only clears bits are programmed without an
+ * erase; other blocks are erased and reprogrammed. Pages which already
+ * hold the new data, or would be left erased, are not programmed. Erases
+ * run in the background where the flash supports that, while the block
+ * before is checked.
+ *
+ * @flash:	SPI flash to update
+ * @offset:	Offset into the flash in bytes to write to
+ * @len:	Number of bytes to write
+ * @buf:	Buffer containing the new data
+ * @stats:	Statistics to add this update to, or NULL
+ * @return 0 if OK, -ve on error
+ */
+int spi_flash_update(struct spi_flash *flash, u32 offset, size_t len,
+		     const void *buf, struct spi_flash_update_stats *stats);
+
+#if CONFIG_IS_ENABLED(SPI_FLASH_VERIFY)
+/**
+ * spi_flash_verify_begin() - Verify the writes to a range as they are done
+ *
+ * Until spi_flash_verify_end(), each page programmed by spi_flash_write()
+ * is read back as soon as it is done, through the memory-mapped window if
+ * there is one, and compared with what was written. spi_flash_update()
+ * reads back each block once it is programmed, pages it left alone
+ * included, and compares it while the next block erases. A mismatch fails
+ * the write with -EIO. The data of [offset, offset + len) is checksummed on
+ * the way, in order.
+ *
+ * @flash:	SPI flash to write to
+ * @verify:	Verify state, which must stay around until the end
+ * @algo:	Checksum to accumulate
+ * @offset:	Offset of the range to be written
+ * @len:	Length of the range
+ * @return 0 if OK, -EPROTONOSUPPORT if @algo is not built in, -EBUSY if a
+ * verify is already in progress, -ve on other error
+ */
+int spi_flash_verify_begin(struct spi_flash *flash,
+			   struct spi_flash_verify *verify,
+			   enum spi_flash_verify_algo algo, u32 offset,
+			   size_t len);
+
+/**
+ * spi_flash_verify_end() - Finish a verify and work out the checksum
+ *
+ * @flash:	SPI flash written to
+ * @verify:	Verify state from spi_flash_verify_begin()
+ * @return 0 if OK, -EIO if not all of the range was written and verified
+ */
+int spi_flash_verify_end(struct spi_flash *flash,
+			 struct spi_flash_verify *verify);
+#endif
+
 #endif /* _SPI_FLASH_H_ */
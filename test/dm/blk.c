@@ -6,8 +6,12 @@
 
 #include <common.h>
 #include <dm.h>
+#include <os.h>
+#include <part.h>
+#include <sandboxblockdev.h>
 #include <usb.h>
 #include <asm/state.h>
+#include <asm/unaligned.h>
 #include <dm/test.h>
 #include <test/ut.h>
 
@@ -83,14 +87,158 @@ static int dm_test_blk_usb(struct unit_test_state *uts)
 	ut_asserteq_ptr(usb_dev, dev_get_parent(dev));
 
 	/* Check we have one block device for each mass storage device */
-	ut_asserteq(4, count_blk_devices());
+	ut_asserteq(6, count_blk_devices());
 
 	/* Now go around again, making sure the old devices were unbound */
 	ut_assertok(usb_stop());
 	ut_assertok(usb_init());
-	ut_asserteq(4, count_blk_devices());
+	ut_asserteq(6, count_blk_devices());
 	ut_assertok(usb_stop());
 
 	return 0;
 }
 DM_TEST(dm_test_blk_usb, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+#ifdef CONFIG_PARTITION_CACHE
+/* Write a GPT with two partitions, named @name1 and @name2 */
+static int write_gpt(struct blk_desc *dev_desc, const char *name1,
+		     const char *name2)
+{
+	char disk_guid[] = "01234567-89ab-cdef-0123-456789abcdef";
+	disk_partition_t parts[2];
+
+	memset(parts, '\0', sizeof(parts));
+	parts[0].start = 34;
+	parts[0].size = 0x80;
+	strcpy((char *)parts[0].name, name1);
+	strcpy(parts[0].uuid, "11111111-2222-3333-4444-555555555555");
+	parts[1].size = 0x100;
+	strcpy((char *)parts[1].name, name2);
+	strcpy(parts[1].uuid, "66666666-7777-8888-9999-aaaaaaaaaaaa");
+
+	return gpt_restore(dev_desc, disk_guid, parts, 2);
+}
+
+/*
+ * Write a DOS partition table sector at @sector, with @count entries of
+ * {type, start, size}
+ */
+static int write_dos_table(struct blk_desc *dev_desc, lbaint_t sector,
+			   const u32 entries[][3], int count)
+{
+	u8 buf[512];
+	u8 *pt;
+	int i;
+
+	memset(buf, '\0', sizeof(buf));
+	for (i = 0, pt = buf + 0x1be; i < count; i++, pt += 16) {
+		pt[4] = entries[i][0];
+		put_unaligned_le32(entries[i][1], pt + 8);
+		put_unaligned_le32(entries[i][2], pt + 12);
+	}
+	buf[510] = 0x55;
+	buf[511] = 0xaa;
+
+	return blk_dwrite(dev_desc, sector, 1, buf) == 1 ? 0 : -EIO;
+}
+
+/*
+ * Write an MBR with partition 1 and an extended partition holding the
+ * logical partitions 5 to 10, each in its own 32-sector slot
+ */
+static int write_dos(struct blk_desc *dev_desc)
+{
+	const u32 mbr[][3] = { { 0x83, 32, 32 }, { 0x05, 64, 6 * 32 } };
+	u32 ebr[][3] = { { 0x83, 1, 16 }, { 0x05, 0, 32 } };
+	int i, ret;
+
+	ret = write_dos_table(dev_desc, 0, mbr, ARRAY_SIZE(mbr));
+	for (i = 0; !ret && i < 6; i++) {
+		/* The link to the next one is relative to the extended one */
+		ebr[1][1] = (i + 1) * 32;
+		ret = write_dos_table(dev_desc, 64 + i * 32, ebr,
+				      i < 5 ? 2 : 1);
+	}
+
+	return ret;
+}
+
+/* Test that the partition table is cached, and dropped on a write */
+static int dm_test_blk_part_cache(struct unit_test_state *uts)
+{
+	char fname[] = "blk_part_cache.img";
+	char zero[512] = { 0 };
+	struct blk_desc *dev_desc;
+	disk_partition_t info;
+	char uuid[37];
+	off_t backup;
+	int fd;
+
+	/* Make an empty disk image and give it a GPT */
+	os_unlink(fname);
+	fd = os_open(fname, OS_O_CREAT | OS_O_RDWR);
+	ut_assert(fd >= 0);
+	ut_asserteq(0xfffff, os_lseek(fd, 0xfffff, OS_SEEK_SET));
+	ut_asserteq(1, os_write(fd, zero, 1));
+	ut_assertok(host_dev_bind(0, fname));
+	ut_assertok(blk_get_device_by_str("host", "0", &dev_desc));
+	ut_assertok(write_gpt(dev_desc, "boot", "rootfs"));
+	part_init(dev_desc);
+	ut_asserteq(PART_TYPE_EFI, dev_desc->part_type);
+	ut_asserteq_ptr(NULL, dev_desc->part_cache);
+
+	/* The first lookup reads the table, and the rest use it */
+	ut_assertok(part_get_info(dev_desc, 2, &info));
+	ut_assertnonnull(dev_desc->part_cache);
+	ut_asserteq_str("rootfs", (char *)info.name);
+	ut_asserteq(34 + 0x80, info.start);
+	ut_asserteq(0x100, info.size);
+	strcpy(uuid, info.uuid);
+	ut_asserteq(-1, part_get_info(dev_desc, 3, &info));
+	ut_assertok(part_get_info_by_name(dev_desc, "boot", &info));
+	ut_asserteq(34, info.start);
+	ut_asserteq(-1, part_get_info_by_name(dev_desc, "data", &info));
+	ut_asserteq(2, part_get_info_by_uuid(dev_desc, uuid, &info));
+	ut_asserteq_str("rootfs", (char *)info.name);
+
+	/* Wipe both tables behind its back: the cached copy is still used */
+	ut_asserteq(512, os_lseek(fd, 512, OS_SEEK_SET));
+	ut_asserteq(sizeof(zero), os_write(fd, zero, sizeof(zero)));
+	backup = (dev_desc->lba - 1) * 512;
+	ut_asserteq(backup, os_lseek(fd, backup, OS_SEEK_SET));
+	ut_asserteq(sizeof(zero), os_write(fd, zero, sizeof(zero)));
+	ut_assertok(part_get_info_by_name(dev_desc, "rootfs", &info));
+
+	/* Writing through the block device drops it */
+	ut_assertok(write_gpt(dev_desc, "kernel", "data"));
+	ut_asserteq_ptr(NULL, dev_desc->part_cache);
+	ut_asserteq(-1, part_get_info_by_name(dev_desc, "rootfs", &info));
+	ut_assertok(part_get_info_by_name(dev_desc, "data", &info));
+	ut_asserteq(34 + 0x80, info.start);
+	ut_asserteq(2, part_get_info_by_uuid(dev_desc, uuid, &info));
+
+	/* DOS logical partitions past the cached ones are still found */
+	ut_assertok(write_dos(dev_desc));
+	part_init(dev_desc);
+	ut_asserteq(PART_TYPE_DOS, dev_desc->part_type);
+	ut_assertok(part_get_info(dev_desc, 1, &info));
+	ut_asserteq(32, info.start);
+	ut_asserteq(-1, part_get_info(dev_desc, 2, &info));
+	ut_assertok(part_get_info(dev_desc, 8, &info));
+	ut_assertnonnull(dev_desc->part_cache);
+	ut_asserteq(64 + 3 * 32 + 1, info.start);
+	ut_assertok(part_get_info(dev_desc, 9, &info));
+	ut_asserteq(64 + 4 * 32 + 1, info.start);
+	ut_asserteq(16, info.size);
+	ut_assertok(part_get_info(dev_desc, 10, &info));
+	ut_asserteq(64 + 5 * 32 + 1, info.start);
+	ut_asserteq(-1, part_get_info(dev_desc, 11, &info));
+
+	os_close(fd);
+	ut_assertok(host_dev_bind(0, NULL));
+	os_unlink(fname);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_part_cache, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+#endif
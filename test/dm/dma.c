@@ -0,0 +1,57 @@
+/*
+ * Tests for the DMA uclass
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <dm.h>
+#include <dma.h>
+#include <malloc.h>
+#include <asm/test.h>
+#include <dm/test.h>
+#include <test/ut.h>
+
+/* Test that mapped-window copies use DMA only for whole cache lines */
+static int dm_test_dma_mmap_copy(struct unit_test_state *uts)
+{
+	const size_t len = CONFIG_DMA_MMAP_COPY_MIN + 100;
+	struct udevice *dev;
+	u8 *src, *dst, *last_dst;
+	size_t last_len;
+	ulong count;
+	int i;
+
+	ut_assertok(uclass_get_device(UCLASS_DMA, 0, &dev));
+	src = malloc(len);
+	dst = memalign(ARCH_DMA_MINALIGN, len + ARCH_DMA_MINALIGN);
+	ut_assertnonnull(src);
+	ut_assertnonnull(dst);
+	for (i = 0; i < len; i++)
+		src[i] = i;
+
+	/* Short copies stay with the CPU */
+	count = sandbox_dma_get_last(dev, (void **)&last_dst, &last_len);
+	dma_mmap_copy(dst, src, 100);
+	ut_asserteq(count, sandbox_dma_get_last(dev, (void **)&last_dst,
+						&last_len));
+	ut_assertok(memcmp(dst, src, 100));
+
+	/* Long ones go to the engine, minus the partial lines at each end */
+	memset(dst, '\0', len + ARCH_DMA_MINALIGN);
+	dma_mmap_copy(dst + 1, src, len);
+	ut_asserteq(count + 1, sandbox_dma_get_last(dev, (void **)&last_dst,
+						    &last_len));
+	ut_asserteq_ptr(dst + ARCH_DMA_MINALIGN, last_dst);
+	ut_asserteq(0, last_len % ARCH_DMA_MINALIGN);
+	ut_assert(last_len > len - 2 * ARCH_DMA_MINALIGN);
+	ut_assertok(memcmp(dst + 1, src, len));
+	ut_asserteq(0, dst[0]);
+	ut_asserteq(0, dst[len + 1]);
+
+	free(dst);
+	free(src);
+
+	return 0;
+}
+DM_TEST(dm_test_dma_mmap_copy, DM_TESTF_SCAN_FDT);
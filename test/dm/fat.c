@@ -0,0 +1,189 @@
+/*
+ * Tests for FAT writes on full volumes
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <dm.h>
+#include <fat.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <os.h>
+#include <sandboxblockdev.h>
+#include <asm/unaligned.h>
+#include <dm/test.h>
+#include <test/ut.h>
+
+#define FAT_TEST_SECT_SIZE	512
+#define FAT_TEST_CLUSTERS	128
+
+/*
+ * Write an empty FAT12, FAT16 or FAT32 volume with one sector per cluster
+ * and FAT_TEST_CLUSTERS data clusters to @fname. The FAT32 root directory
+ * uses the first of them. Return the number of clusters left free.
+ */
+static int fat_test_mkfs(struct unit_test_state *uts, const char *fname,
+			 int fatsize)
+{
+	const int sect_size = FAT_TEST_SECT_SIZE;
+	int reserved = fatsize == 32 ? 8 : 1;
+	int root_secs = fatsize == 32 ? 0 : 1;
+	int fat_secs = DIV_ROUND_UP((FAT_TEST_CLUSTERS + 2) * fatsize / 8,
+				    sect_size);
+	int total = reserved + 2 * fat_secs + root_secs + FAT_TEST_CLUSTERS;
+	struct fsinfo_sector *info;
+	volume_info *vi;
+	boot_sector *bs;
+	u8 *img, *fat;
+	int avail = FAT_TEST_CLUSTERS;
+	int fd, i;
+
+	img = calloc(total, sect_size);
+	ut_assertnonnull(img);
+	bs = (boot_sector *)img;
+	memcpy(bs->system_id, "U-BOOT  ", 8);
+	put_unaligned_le16(sect_size, bs->sector_size);
+	bs->cluster_size = 1;
+	bs->reserved = cpu_to_le16(reserved);
+	bs->fats = 2;
+	put_unaligned_le16(root_secs * sect_size / sizeof(dir_entry),
+			   bs->dir_entries);
+	bs->media = 0xf8;
+	bs->total_sect = cpu_to_le32(total);
+	if (fatsize == 32) {
+		bs->fat32_length = cpu_to_le32(fat_secs);
+		bs->root_cluster = cpu_to_le32(2);
+		bs->info_sector = cpu_to_le16(1);
+		vi = (volume_info *)(img + sizeof(boot_sector));
+		memcpy(vi->fs_type, FAT32_SIGN, SIGNLEN);
+
+		info = (struct fsinfo_sector *)(img + sect_size);
+		info->lead_sig = cpu_to_le32(FSINFO_LEAD_SIG);
+		info->struct_sig = cpu_to_le32(FSINFO_STRUCT_SIG);
+		info->free_count = cpu_to_le32(--avail);
+		info->next_free = cpu_to_le32(3);
+		info->trail_sig = cpu_to_le32(FSINFO_TRAIL_SIG);
+	} else {
+		bs->fat_length = cpu_to_le16(fat_secs);
+		vi = (volume_info *)&bs->fat32_length;
+		memcpy(vi->fs_type, fatsize == 12 ? FAT12_SIGN : FAT16_SIGN,
+		       SIGNLEN);
+	}
+	vi->ext_boot_sign = 0x29;
+	img[510] = 0x55;
+	img[511] = 0xaa;
+
+	/* Entries 0 and 1 hold the media byte, FAT32 adds the root's end */
+	for (i = 0; i < 2; i++) {
+		fat = img + (reserved + i * fat_secs) * sect_size;
+		memset(fat, 0xff, fatsize == 32 ? 12 : fatsize * 2 / 8);
+		fat[0] = 0xf8;
+		if (fatsize == 32) {
+			fat[3] = 0x0f;
+			fat[7] = 0x0f;
+			fat[11] = 0x0f;
+		}
+	}
+
+	os_unlink(fname);
+	fd = os_open(fname, OS_O_CREAT | OS_O_RDWR);
+	ut_assert(fd >= 0);
+	ut_asserteq(total * sect_size,
+		    os_write(fd, img, total * sect_size));
+	os_close(fd);
+	free(img);
+
+	return avail;
+}
+
+/* Run a command made from @fmt and return its result */
+static int fat_test_run(const char *fmt, ...)
+{
+	char cmd[100];
+	va_list args;
+
+	va_start(args, fmt);
+	vsnprintf(cmd, sizeof(cmd), fmt, args);
+	va_end(args);
+
+	return run_command(cmd, 0);
+}
+
+/* Check that writes which do not fit fail and leave the volume usable */
+static int fat_test_full(struct unit_test_state *uts, int fatsize)
+{
+	const int clust = FAT_TEST_SECT_SIZE;
+	char fname[] = "fat_full.img";
+	ulong src, dst;
+	int avail;
+	u8 *buf;
+
+	avail = fat_test_mkfs(uts, fname, fatsize);
+	ut_assert(avail > 0);
+	ut_assertok(host_dev_bind(0, fname));
+
+	buf = memalign(ARCH_DMA_MINALIGN, 2 * FAT_TEST_CLUSTERS * clust);
+	ut_assertnonnull(buf);
+	memset(buf, 0x5a, FAT_TEST_CLUSTERS * clust);
+	memset(buf + 32 * clust, 0xa5, 32 * clust);
+	src = map_to_sysmem(buf);
+	dst = src + FAT_TEST_CLUSTERS * clust;
+
+	/*
+	 * Leave a gap in front of keep.bin, so that the search for free
+	 * clusters has to wrap around the end of the FAT
+	 */
+	ut_assertok(fat_test_run("fatwrite host 0:0 %lx remove.bin %x", src,
+				 32 * clust));
+	ut_assertok(fat_test_run("fatwrite host 0:0 %lx keep.bin %x",
+				 src + 32 * clust, 32 * clust));
+	ut_assertok(fat_test_run("fatwrite host 0:0 %lx remove.bin 0", src));
+	avail -= 32;
+
+	/* A new file one cluster too large is refused */
+	ut_assert(fat_test_run("fatwrite host 0:0 %lx full.bin %x", src,
+			       (avail + 1) * clust));
+	ut_assert(fat_test_run("fatsize host 0:0 full.bin"));
+
+	/* So is an overwrite, which leaves the file empty */
+	ut_assertok(fat_test_run("fatwrite host 0:0 %lx full.bin %x", src,
+				 clust));
+	ut_assert(fat_test_run("fatwrite host 0:0 %lx full.bin %x", src,
+			       (avail + 1) * clust));
+	ut_assertok(fat_test_run("fatsize host 0:0 full.bin"));
+	ut_asserteq_str("0", getenv("filesize"));
+
+	/* All the clusters came back, so the volume can be filled exactly */
+	ut_assertok(fat_test_run("fatwrite host 0:0 %lx full.bin %x", src,
+				 avail * clust));
+	memset(buf + FAT_TEST_CLUSTERS * clust, 0, FAT_TEST_CLUSTERS * clust);
+	ut_assertok(fat_test_run("fatload host 0:0 %lx full.bin", dst));
+	ut_asserteq(avail * clust, getenv_hex("filesize", 0));
+	ut_assertok(memcmp(buf, buf + FAT_TEST_CLUSTERS * clust,
+			   avail * clust));
+	ut_assert(fat_test_run("fatwrite host 0:0 %lx more.bin %x", src,
+			       clust));
+
+	/* The file in the way is untouched */
+	ut_assertok(fat_test_run("fatload host 0:0 %lx keep.bin", dst));
+	ut_asserteq(32 * clust, getenv_hex("filesize", 0));
+	ut_assertok(memcmp(buf + 32 * clust, buf + FAT_TEST_CLUSTERS * clust,
+			   32 * clust));
+
+	free(buf);
+	ut_assertok(host_dev_bind(0, NULL));
+	os_unlink(fname);
+
+	return 0;
+}
+
+static int dm_test_fat_full(struct unit_test_state *uts)
+{
+	ut_assertok(fat_test_full(uts, 12));
+	ut_assertok(fat_test_full(uts, 16));
+	ut_assertok(fat_test_full(uts, 32));
+
+	return 0;
+}
+DM_TEST(dm_test_fat_full, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
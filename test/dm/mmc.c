@@ -7,6 +7,8 @@
 #include <common.h>
 #include <dm.h>
 #include <mmc.h>
+#include <asm/test.h>
+#include <dm/device-internal.h>
 #include <dm/test.h>
 #include <test/ut.h>
 
@@ -44,3 +46,203 @@ static int dm_test_mmc_blk(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_mmc_blk, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Bring up a card, with tuning working or not */
+static int mmc_test_init(struct unit_test_state *uts, const char *name,
+			 bool tuning_fails, struct mmc **mmcp)
+{
+	struct udevice *dev;
+	struct mmc *mmc;
+
+	ut_assertok(uclass_get_device_by_name(UCLASS_MMC, name, &dev));
+	sandbox_mmc_set_tuning_fails(dev, tuning_fails);
+	mmc = mmc_get_mmc_dev(dev);
+	mmc->has_init = 0;
+	ut_assertok(mmc_init(mmc));
+	*mmcp = mmc;
+
+	return 0;
+}
+
+/* Test that an eMMC goes to HS400, and falls back if tuning fails */
+static int dm_test_mmc_hs400(struct unit_test_state *uts)
+{
+	struct mmc *mmc;
+
+	ut_assertok(mmc_test_init(uts, "mmc-emmc", false, &mmc));
+	ut_asserteq(MMC_HS_400, mmc->selected_mode);
+	ut_asserteq(8, mmc->bus_width);
+	ut_asserteq(1, mmc->ddr_mode);
+	ut_asserteq(MMC_SIGNAL_VOLTAGE_180, mmc->signal_voltage);
+	ut_asserteq_str("HS400 (200MHz)", mmc_mode_name(mmc->selected_mode));
+
+	ut_assertok(mmc_test_init(uts, "mmc-emmc", true, &mmc));
+	ut_asserteq(MMC_HS_52, mmc->selected_mode);
+	ut_asserteq(8, mmc->bus_width);
+	ut_asserteq(MMC_SIGNAL_VOLTAGE_330, mmc->signal_voltage);
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_hs400, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test that a UHS-I card goes to SDR104, and falls back if tuning fails */
+static int dm_test_mmc_uhs(struct unit_test_state *uts)
+{
+	struct mmc *mmc;
+
+	ut_assertok(mmc_test_init(uts, "mmc-uhs", false, &mmc));
+	ut_asserteq(UHS_SDR104, mmc->selected_mode);
+	ut_asserteq(208000000, mmc->clock);
+	ut_asserteq(4, mmc->bus_width);
+	ut_asserteq(MMC_SIGNAL_VOLTAGE_180, mmc->signal_voltage);
+
+	ut_assertok(mmc_test_init(uts, "mmc-uhs", true, &mmc));
+	ut_asserteq(UHS_SDR50, mmc->selected_mode);
+	ut_asserteq(100000000, mmc->clock);
+
+	/* A card which does not finish the 1.8V switch is power cycled */
+	sandbox_mmc_set_switch_fails(mmc->dev, true);
+	ut_assertok(mmc_test_init(uts, "mmc-uhs", false, &mmc));
+	ut_asserteq(SD_HS, mmc->selected_mode);
+	ut_asserteq(MMC_SIGNAL_VOLTAGE_330, mmc->signal_voltage);
+	sandbox_mmc_set_switch_fails(mmc->dev, false);
+
+	/*
+	 * The card without UHS-I always reports its high-speed function as
+	 * busy, so it stays at the default speed
+	 */
+	ut_assertok(mmc_test_init(uts, "mmc", false, &mmc));
+	ut_asserteq(SD_LEGACY, mmc->selected_mode);
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_uhs, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Read two blocks, counting the commands which set up and stop the transfer */
+static int mmc_test_multi_read(struct unit_test_state *uts, const char *name,
+			       uint *cmd23, uint *cmd12)
+{
+	struct udevice *dev;
+	struct mmc *mmc;
+	char buf[1024];
+
+	ut_assertok(mmc_test_init(uts, name, false, &mmc));
+	dev = mmc->dev;
+	*cmd23 = sandbox_mmc_get_cmd_count(dev, MMC_CMD_SET_BLOCK_COUNT);
+	*cmd12 = sandbox_mmc_get_cmd_count(dev, MMC_CMD_STOP_TRANSMISSION);
+	ut_asserteq(2, blk_dread(mmc_get_blk_desc(mmc), 0, 2, buf));
+	ut_assertok(strcmp(buf, "this is a test"));
+	*cmd23 = sandbox_mmc_get_cmd_count(dev, MMC_CMD_SET_BLOCK_COUNT) -
+		*cmd23;
+	*cmd12 = sandbox_mmc_get_cmd_count(dev, MMC_CMD_STOP_TRANSMISSION) -
+		*cmd12;
+
+	return 0;
+}
+
+/* Test that multiple-block reads use CMD23 instead of CMD12 if they can */
+static int dm_test_mmc_cmd23(struct unit_test_state *uts)
+{
+	uint cmd23, cmd12;
+
+	ut_assertok(mmc_test_multi_read(uts, "mmc-emmc", &cmd23, &cmd12));
+	ut_asserteq(1, cmd23);
+	ut_asserteq(0, cmd12);
+
+	ut_assertok(mmc_test_multi_read(uts, "mmc-uhs", &cmd23, &cmd12));
+	ut_asserteq(1, cmd23);
+	ut_asserteq(0, cmd12);
+
+	/* This card does not have CMD23 in its SCR */
+	ut_assertok(mmc_test_multi_read(uts, "mmc", &cmd23, &cmd12));
+	ut_asserteq(0, cmd23);
+	ut_asserteq(1, cmd12);
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_cmd23, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Start the init of a card, then let its block device finish it */
+static int mmc_test_async_init(struct unit_test_state *uts, const char *name,
+			       struct mmc **mmcp)
+{
+	struct udevice *dev, *bdev;
+	struct mmc *mmc;
+
+	/* Like preinit, the probe starts it; the card is still powering up */
+	ut_assertok(uclass_get_device_by_name(UCLASS_MMC, name, &dev));
+	mmc = mmc_get_mmc_dev(dev);
+	ut_asserteq(1, mmc->init_in_progress);
+	ut_asserteq(1, mmc->op_cond_pending);
+	ut_asserteq(0, mmc->has_init);
+
+	ut_assertok(device_find_first_child(dev, &bdev));
+	ut_assertok(device_probe(bdev));
+	ut_asserteq(0, mmc->init_in_progress);
+	ut_asserteq(1, mmc->has_init);
+	*mmcp = mmc;
+
+	return 0;
+}
+
+/* Test that an init which was started is completed on first use */
+static int dm_test_mmc_async_init(struct unit_test_state *uts)
+{
+	struct mmc *mmc;
+	uint init_time_us;
+
+	ut_assertok(mmc_test_async_init(uts, "mmc-emmc", &mmc));
+	ut_asserteq(MMC_HS_400, mmc->selected_mode);
+
+	/* Its init time is kept from the first init, not a later one */
+	init_time_us = mmc->init_time_us;
+	ut_assert(init_time_us);
+	ut_assertok(mmc_test_init(uts, "mmc-emmc", false, &mmc));
+	ut_asserteq(init_time_us, mmc->init_time_us);
+
+	ut_assertok(mmc_test_async_init(uts, "mmc-uhs", &mmc));
+	ut_asserteq(UHS_SDR104, mmc->selected_mode);
+	ut_asserteq(MMC_SIGNAL_VOLTAGE_180, mmc->signal_voltage);
+
+	ut_assertok(mmc_test_async_init(uts, "mmc", &mmc));
+	ut_asserteq(SD_LEGACY, mmc->selected_mode);
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_async_init, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test that an empty slot does not stop the block devices being probed */
+static int dm_test_mmc_no_card(struct unit_test_state *uts)
+{
+	struct udevice *dev, *bdev, *blk;
+	struct blk_desc *desc;
+	struct mmc *mmc;
+	char cmp[1024];
+
+	ut_assertok(uclass_get_device_by_name(UCLASS_MMC, "mmc", &dev));
+	mmc = mmc_get_mmc_dev(dev);
+	sandbox_mmc_set_no_card(dev, true);
+	ut_asserteq(-ENOMEDIUM, mmc_start_init(mmc));
+	ut_asserteq(0, mmc->init_in_progress);
+	ut_assertok(device_find_first_child(dev, &bdev));
+
+	/* With no init started, a card put back is left to the next init */
+	sandbox_mmc_set_no_card(dev, false);
+	ut_assertok(uclass_first_device(UCLASS_BLK, &blk));
+	while (blk)
+		ut_assertok(uclass_next_device(&blk));
+	ut_assert(device_active(bdev));
+	ut_asserteq(0, mmc->has_init);
+
+	/* Nothing can be read until the card is rescanned */
+	desc = dev_get_uclass_platdata(bdev);
+	ut_asserteq(0, blk_dread(desc, 0, 2, cmp));
+	ut_assertok(mmc_init(mmc));
+	memset(cmp, '\0', sizeof(cmp));
+	ut_asserteq(2, blk_dread(desc, 0, 2, cmp));
+	ut_assertok(strcmp(cmp, "this is a test"));
+	ut_asserteq(1, mmc->has_init);
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_no_card, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
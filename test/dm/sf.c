@@ -7,13 +7,22 @@
 #include <common.h>
 #include <dm.h>
 #include <fdtdec.h>
+#include <mapmem.h>
 #include <spi.h>
+#include <spi-mem.h>
 #include <spi_flash.h>
+#include <u-boot/crc.h>
+#include <u-boot/sha256.h>
 #include <asm/state.h>
+#include <asm/test.h>
+#include <asm/unaligned.h>
+#include <dm/device-internal.h>
 #include <dm/test.h>
 #include <dm/util.h>
 #include <test/ut.h>
 
+#include "sf_internal.h"
+
 /* Test that sandbox SPI flash works correctly */
 static int dm_test_spi_flash(struct unit_test_state *uts)
 {
@@ -41,3 +50,740 @@ static int dm_test_spi_flash(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_spi_flash, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test that a flash larger than 16MiB is driven with 4-byte addresses */
+static int dm_test_spi_flash_4b(struct unit_test_state *uts)
+{
+	struct sandbox_state *state = state_get_current();
+	struct spi_flash *flash;
+	struct udevice *bus;
+	const int busnum = 0, cs = 1;
+
+	/* Attach a 32MiB emulated flash to the second chip select */
+	ut_assertok(uclass_get_device_by_seq(UCLASS_SPI, busnum, &bus));
+	state->spi[busnum][cs].spec = "s25fl256s_64k:spi4b.bin";
+	ut_assertok(sandbox_sf_bind_emul(state, busnum, cs, bus, -1,
+					 "s25fl256s_64k"));
+
+	/* Erase, write and read back across the 16MiB boundary */
+	ut_asserteq(0, run_command_list(
+		"sb save hostfs - 0 spi4b.bin 2000000;"
+		"sf probe 0:1;"
+		"sf test ff0000 20000", -1, 0));
+
+	flash = spi_flash_probe(busnum, cs, 0, 0);
+	ut_assertnonnull(flash);
+	ut_asserteq(32 << 20, flash->size);
+	ut_asserteq(4, flash->addr_width);
+
+	sandbox_sf_unbind_emul(state, busnum, cs);
+	state->spi[busnum][cs].spec = NULL;
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_4b, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test that a 4-byte address read is split at the stacked die boundary */
+static int dm_test_spi_flash_stacked(struct unit_test_state *uts)
+{
+	struct sandbox_state *state = state_get_current();
+	u8 lower[16], upper[16], buf[32];
+	struct spi_flash *flash;
+	struct udevice *bus;
+	const int busnum = 0, cs = 1;
+	u32 die;
+	int i;
+
+	ut_assertok(uclass_get_device_by_seq(UCLASS_SPI, busnum, &bus));
+	state->spi[busnum][cs].spec = "s25fl256s_64k:spi4b.bin";
+	ut_assertok(sandbox_sf_bind_emul(state, busnum, cs, bus, -1,
+					 "s25fl256s_64k"));
+	ut_assertok(run_command("sb save hostfs - 0 spi4b.bin 2000000", 0));
+	flash = spi_flash_probe(busnum, cs, 0, 0);
+	ut_assertnonnull(flash);
+	ut_asserteq(4, flash->addr_width);
+
+	/*
+	 * Pretend that the flash is made of two stacked 16MiB dies. The
+	 * emulator does not tell them apart, so the upper die reads back the
+	 * start of the flash, but only if the read is split and readdressed
+	 * at the boundary. Otherwise it runs on into the erased flash above.
+	 */
+	die = flash->size >> 1;
+	for (i = 0; i < sizeof(lower); i++) {
+		lower[i] = 0x10 + i;
+		upper[i] = 0x80 + i;
+	}
+	ut_assertok(spi_flash_erase(flash, 0, flash->erase_size));
+	ut_assertok(spi_flash_erase(flash, die - flash->erase_size,
+				    flash->erase_size * 2));
+	ut_assertok(spi_flash_write(flash, die - sizeof(lower), sizeof(lower),
+				    lower));
+	ut_assertok(spi_flash_write(flash, 0, sizeof(upper), upper));
+
+	flash->dual_flash = SF_DUAL_STACKED_FLASH;
+	memset(buf, '\0', sizeof(buf));
+	ut_assertok(spi_flash_cmd_read_ops(flash, die - sizeof(lower),
+					   sizeof(buf), buf));
+	flash->dual_flash = SF_SINGLE_FLASH;
+	flash->flags &= ~SNOR_F_USE_UPAGE;
+	ut_assertok(memcmp(lower, buf, sizeof(lower)));
+	ut_assertok(memcmp(upper, buf + sizeof(lower), sizeof(upper)));
+
+	sandbox_sf_unbind_emul(state, busnum, cs);
+	state->spi[busnum][cs].spec = NULL;
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_stacked, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/*
+ * Attach the emulated flash which is only described by its SFDP tables to
+ * chip select 1 of bus 0, with a blank backing file, and probe it
+ */
+static int sf_sfdp_setup(struct unit_test_state *uts, uint mode,
+			 struct spi_flash **flashp)
+{
+	struct sandbox_state *state = state_get_current();
+	struct udevice *bus;
+
+	ut_assertok(uclass_get_device_by_seq(UCLASS_SPI, 0, &bus));
+	state->spi[0][1].spec = "sandbox_sfdp:spisfdp.bin";
+	ut_assertok(sandbox_sf_bind_emul(state, 0, 1, bus, -1,
+					 "sandbox_sfdp"));
+	ut_assertok(run_command("sb save hostfs - 0 spisfdp.bin 2000000", 0));
+	*flashp = spi_flash_probe(0, 1, 0, mode);
+	ut_assertnonnull(*flashp);
+
+	return 0;
+}
+
+/* Detach the flash attached by sf_sfdp_setup() */
+static void sf_sfdp_teardown(void)
+{
+	struct sandbox_state *state = state_get_current();
+
+	sandbox_sf_unbind_emul(state, 0, 1);
+	state->spi[0][1].spec = NULL;
+}
+
+/* Test that a flash missing from the ID table is set up from its SFDP */
+static int dm_test_spi_flash_sfdp(struct unit_test_state *uts)
+{
+	struct spi_flash *flash;
+
+	ut_assertok(sf_sfdp_setup(uts, SPI_TX_QUAD | SPI_RX_QUAD, &flash));
+	ut_asserteq_str("SFDP", flash->name);
+	ut_asserteq(32 << 20, flash->size);
+	ut_asserteq(256, flash->page_size);
+	ut_asserteq(4096, flash->erase_size);
+	ut_asserteq(4, flash->addr_width);
+	ut_asserteq(0xec, flash->read_cmd);	/* 4-byte quad I/O read */
+	ut_asserteq(3, flash->dummy_byte);
+
+	/* Quad I/O reads only work with the dummy cycles given by SFDP */
+	ut_asserteq(0, run_command_list(
+		"sf probe 0:1 0 2400;"
+		"sf test fff000 2000", -1, 0));
+
+	sf_sfdp_teardown();
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_sfdp, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test that erases use the largest erase commands which fit */
+static int dm_test_spi_flash_erase(struct unit_test_state *uts)
+{
+	struct spi_flash *flash;
+	u8 buf[0x1000];
+	int i;
+
+	ut_assertok(sf_sfdp_setup(uts, 0, &flash));
+	ut_asserteq(4096, flash->erase_types[0].size);
+	ut_asserteq(32 << 10, flash->erase_types[1].size);
+	ut_asserteq(64 << 10, flash->erase_types[2].size);
+
+	/* 4K at the edges, then 32K and 64K as alignment allows */
+	memset(buf, '\0', sizeof(buf));
+	for (i = 0x6000; i < 0x22000; i += sizeof(buf))
+		ut_assertok(spi_flash_write(flash, i, sizeof(buf), buf));
+	ut_assertok(spi_flash_erase(flash, 0x7000, 0x1a000));
+	ut_asserteq(2, flash->erase_types[0].count);
+	ut_asserteq(1, flash->erase_types[1].count);
+	ut_asserteq(1, flash->erase_types[2].count);
+	ut_asserteq(0, flash->erase_chip_count);
+
+	ut_assertok(spi_flash_read(flash, 0x6fff, 2, buf));
+	ut_asserteq(0x00, buf[0]);
+	ut_asserteq(0xff, buf[1]);
+	ut_assertok(spi_flash_read(flash, 0x20fff, 2, buf));
+	ut_asserteq(0xff, buf[0]);
+	ut_asserteq(0x00, buf[1]);
+
+	/* Not aligned to the smallest erase size */
+	ut_assert(spi_flash_erase(flash, 0x7800, 0x1000));
+
+	/* The whole flash goes with a single chip erase */
+	ut_assertok(spi_flash_erase(flash, 0, flash->size));
+	ut_asserteq(1, flash->erase_chip_count);
+	ut_asserteq(0, flash->erase_types[0].count);
+	ut_assertok(spi_flash_read(flash, 0x20fff, 2, buf));
+	ut_asserteq(0xff, buf[1]);
+
+	sf_sfdp_teardown();
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_erase, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+static int sf_update_calls;
+
+static void sf_update_count(struct spi_flash_update_stats *stats)
+{
+	sf_update_calls++;
+}
+
+/* Test that updates only erase and program what changed */
+static int dm_test_spi_flash_update(struct unit_test_state *uts)
+{
+	struct sandbox_state *state = state_get_current();
+	struct spi_flash_update_stats stats;
+	struct spi_flash_verify verify;
+	struct spi_flash *flash;
+	u8 buf[0x2000], cmp[0x2000];
+	int i;
+
+	ut_assertok(sf_sfdp_setup(uts, 0, &flash));
+	ut_assertok(spi_flash_erase(flash, 0, 0x10000));
+
+	/* Erased flash only needs programming, reporting each block done */
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i * 7 + 3;
+	memset(&stats, '\0', sizeof(stats));
+	stats.progress = sf_update_count;
+	sf_update_calls = 0;
+	ut_assertok(spi_flash_update(flash, 0x1000, sizeof(buf), buf, &stats));
+	ut_asserteq(0, stats.erased);
+	ut_asserteq(0x2000, stats.programmed);
+	ut_asserteq(0, stats.skipped);
+	ut_asserteq(0x2000, stats.done);
+	ut_asserteq(2, sf_update_calls);
+
+	/* Nothing to do when the data is already there */
+	memset(&stats, '\0', sizeof(stats));
+	ut_assertok(spi_flash_update(flash, 0x1000, sizeof(buf), buf, &stats));
+	ut_asserteq(0, stats.erased);
+	ut_asserteq(0, stats.programmed);
+	ut_asserteq(0x2000, stats.skipped);
+
+	/* Clearing bits in one page programs just that page */
+	buf[0x1200] = 0;
+	memset(&stats, '\0', sizeof(stats));
+	ut_assertok(spi_flash_update(flash, 0x1000, sizeof(buf), buf, &stats));
+	ut_asserteq(0, stats.erased);
+	ut_asserteq(0x100, stats.programmed);
+	ut_asserteq(0x1f00, stats.skipped);
+
+	/* Setting bits erases the 4K block and restores the rest of it */
+	buf[0x100] |= 0xf0;
+	memset(&stats, '\0', sizeof(stats));
+	ut_assertok(spi_flash_update(flash, 0x1000, sizeof(buf), buf, &stats));
+	ut_asserteq(0x1000, stats.erased);
+	ut_asserteq(0x1000, stats.programmed);
+	ut_asserteq(0x1000, stats.skipped);
+
+	ut_assertok(spi_flash_read(flash, 0x1000, sizeof(cmp), cmp));
+	ut_assertok(memcmp(buf, cmp, sizeof(buf)));
+
+	/* The first block is checked while the second erases */
+	sandbox_sf_set_erase_time(state->spi[0][1].emul, 500);
+	memset(buf, '\0', sizeof(buf));
+	ut_assertok(spi_flash_write(flash, 0x4000, sizeof(buf), buf));
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i * 5 + 1;
+	memset(&stats, '\0', sizeof(stats));
+	ut_assertok(spi_flash_verify_begin(flash, &verify,
+					   SPI_FLASH_VERIFY_CRC32, 0x4000,
+					   sizeof(buf)));
+	ut_assertok(spi_flash_update(flash, 0x4000, sizeof(buf), buf, &stats));
+	ut_assertok(spi_flash_verify_end(flash, &verify));
+	ut_asserteq(crc32(0, buf, sizeof(buf)),
+		    get_unaligned_be32(verify.digest));
+	ut_asserteq(0x2000, stats.erased);
+	ut_asserteq(0x2000, stats.programmed);
+	ut_asserteq(0x1000, stats.erased_ahead);
+	ut_asserteq(0, flash->async_erase.len);
+	ut_assertok(spi_flash_read(flash, 0x4000, sizeof(cmp), cmp));
+	ut_assertok(memcmp(buf, cmp, sizeof(buf)));
+
+	sf_sfdp_teardown();
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_update, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test reading back pages as they are programmed, with a checksum */
+static int dm_test_spi_flash_verify(struct unit_test_state *uts)
+{
+	struct spi_flash_verify verify, other;
+	u8 buf[0x1f00], sum[SHA256_SUM_LEN];
+	sha256_context ctx;
+	struct spi_flash *flash;
+	int i;
+
+	ut_assertok(sf_sfdp_setup(uts, 0, &flash));
+	ut_assertok(spi_flash_erase(flash, 0, 0x10000));
+
+	/* A write which starts and ends part way into a page */
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i * 7 + 3;
+	ut_assertok(spi_flash_verify_begin(flash, &verify,
+					   SPI_FLASH_VERIFY_CRC32, 0x1080,
+					   sizeof(buf)));
+	ut_asserteq(-EBUSY, spi_flash_verify_begin(flash, &other,
+						   SPI_FLASH_VERIFY_NONE, 0,
+						   1));
+	ut_assertok(spi_flash_write(flash, 0x1080, sizeof(buf), buf));
+	ut_assertok(spi_flash_verify_end(flash, &verify));
+	ut_asserteq(4, verify.digest_len);
+	ut_asserteq(crc32(0, buf, sizeof(buf)),
+		    get_unaligned_be32(verify.digest));
+	ut_asserteq_ptr(NULL, flash->verify);
+
+	/* Pages an update leaves alone still count towards the checksum */
+	buf[0x1000] = 0;
+	buf[0x200] |= 0xf0;
+	ut_assertok(spi_flash_verify_begin(flash, &verify,
+					   SPI_FLASH_VERIFY_SHA256, 0x1080,
+					   sizeof(buf)));
+	ut_assertok(spi_flash_update(flash, 0x1080, sizeof(buf), buf, NULL));
+	ut_assertok(spi_flash_verify_end(flash, &verify));
+	ut_asserteq(SHA256_SUM_LEN, verify.digest_len);
+	sha256_starts(&ctx);
+	sha256_update(&ctx, buf, sizeof(buf));
+	sha256_finish(&ctx, sum);
+	ut_assertok(memcmp(sum, verify.digest, SHA256_SUM_LEN));
+
+	/* Programming cannot set bits, which the read-back catches */
+	ut_assertok(spi_flash_verify_begin(flash, &verify,
+					   SPI_FLASH_VERIFY_NONE, 0x1080,
+					   0x100));
+	memset(buf, 0xff, 0x100);
+	ut_asserteq(-EIO, spi_flash_write(flash, 0x1080, 0x100, buf));
+	ut_asserteq(-EIO, spi_flash_verify_end(flash, &verify));
+
+	sf_sfdp_teardown();
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_verify, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test looking up flash IDs in the sorted table */
+static int dm_test_spi_flash_ids(struct unit_test_state *uts)
+{
+	const struct spi_flash_info *info, *first;
+	u8 id[SPI_FLASH_MAX_ID_LEN];
+	int i;
+
+	for (i = 0; i < spi_flash_ids_count; i++) {
+		info = &spi_flash_ids[i];
+		if (i)
+			ut_assert(memcmp(info[-1].id, info->id, 3) <= 0);
+
+		/* The first entry to match wins, as with a linear search */
+		for (first = spi_flash_ids; first->name; first++) {
+			if (!memcmp(first->id, info->id, first->id_len))
+				break;
+		}
+		ut_asserteq_ptr(first, spi_flash_find_id(info->id));
+	}
+	ut_asserteq_ptr(NULL, spi_flash_ids[spi_flash_ids_count].name);
+
+	memset(id, '\0', sizeof(id));
+	ut_asserteq_ptr(NULL, spi_flash_find_id(id));
+	memset(id, 0xff, sizeof(id));
+	ut_asserteq_ptr(NULL, spi_flash_find_id(id));
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_ids, 0);
+
+/* Test that probing a flash again uses it as it is */
+static int dm_test_spi_flash_probe_cache(struct unit_test_state *uts)
+{
+	struct spi_flash *flash;
+	struct udevice *dev, *again;
+
+	ut_assertok(spi_flash_probe_bus_cs(0, 0, 1000000, SPI_MODE_3, &dev));
+	flash = dev_get_uclass_priv(dev);
+	ut_asserteq(1000000, flash->probe_hz);
+
+	/* A scan would not leave this behind */
+	flash->prog_time_us = 12345;
+	ut_assertok(spi_flash_probe_bus_cs(0, 0, 1000000, SPI_MODE_3, &again));
+	ut_asserteq_ptr(dev, again);
+	ut_asserteq(12345, flash->prog_time_us);
+	ut_assertok(spi_flash_probe_bus_cs(0, 0, 0, 0, &again));
+	ut_asserteq(12345, flash->prog_time_us);
+	ut_assertok(run_command("sf probe 0:0", 0));
+	ut_asserteq(12345, flash->prog_time_us);
+
+	/* A new speed or mode, or sf probe -f, scans it again */
+	ut_assertok(spi_flash_probe_bus_cs(0, 0, 2000000, SPI_MODE_3, &again));
+	flash = dev_get_uclass_priv(again);
+	ut_assert(flash->prog_time_us != 12345);
+	ut_asserteq(2000000, flash->probe_hz);
+	flash->prog_time_us = 12345;
+	ut_assertok(run_command("sf probe -f 0:0", 0));
+	flash = dev_get_uclass_priv(again);
+	ut_assert(flash->prog_time_us != 12345);
+
+	/* The full form takes all its arguments */
+	flash->prog_time_us = 12345;
+	ut_assertok(run_command("sf probe -f 0:0 50000000 3", 0));
+	ut_assertok(spi_find_bus_and_cs(0, 0, &dev, &again));
+	flash = dev_get_uclass_priv(again);
+	ut_assert(flash->prog_time_us != 12345);
+	ut_asserteq(50000000, flash->probe_hz);
+
+	sandbox_sf_unbind_emul(state_get_current(), 0, 0);
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_probe_cache, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test that page programming records its statistics and spaces out polls */
+static int dm_test_spi_flash_write_stats(struct unit_test_state *uts)
+{
+	struct sandbox_state *state = state_get_current();
+	struct spi_flash *flash;
+	u8 buf[0x1000];
+	u32 pages;
+
+	ut_assertok(run_command("sb save hostfs - 0 spi.bin 200000", 0));
+	flash = spi_flash_probe(0, 0, 0, 0);
+	ut_assertnonnull(flash);
+
+	/* Even the first page waits for the typical time from SFDP to poll */
+	ut_asserteq(704, flash->prog_time_us);
+
+	/* An unaligned write touches one more page than it covers */
+	memset(buf, 0x5a, sizeof(buf));
+	ut_assertok(spi_flash_erase(flash, 0, 0x20000));
+	ut_assertok(spi_flash_write(flash, 0x80, sizeof(buf), buf));
+	pages = sizeof(buf) / flash->page_size + 1;
+	ut_asserteq(pages, flash->write_stats.pages);
+
+	/* This flash is polled by the core, and its pages program at once */
+	ut_asserteq(pages, flash->write_stats.polls);
+
+	/*
+	 * Once the program time is learnt, the first poll waits for most of
+	 * it and the rest back off, so each page takes only a few polls
+	 * rather than a busy loop of them
+	 */
+	sandbox_sf_set_prog_time(state->spi[0][0].emul, 400);
+	ut_assertok(spi_flash_write(flash, 0x2000, sizeof(buf), buf));
+	ut_assertok(spi_flash_write(flash, 0x4000, sizeof(buf), buf));
+	pages = sizeof(buf) / flash->page_size;
+	ut_asserteq(pages, flash->write_stats.pages);
+	ut_assert(flash->write_stats.polls >= pages);
+	ut_assert(flash->write_stats.polls <= pages * 4);
+	ut_assert(flash->prog_time_us >= 300);
+	sandbox_sf_set_prog_time(state->spi[0][0].emul, 0);
+	sandbox_sf_unbind_emul(state, 0, 0);
+
+	/* A controller with a hardware poller leaves none to the core */
+	ut_assertok(run_command("sb save hostfs - 0 spi6.bin 200000", 0));
+	flash = spi_flash_probe(0, 6, 0, 0);
+	ut_assertnonnull(flash);
+	ut_assertok(spi_flash_erase(flash, 0, 0x10000));
+	ut_assertok(spi_flash_write(flash, 0, sizeof(buf), buf));
+	ut_asserteq(pages, flash->write_stats.pages);
+	ut_asserteq(0, flash->write_stats.polls);
+	sandbox_sf_unbind_emul(state, 0, 6);
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_write_stats, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test that reads go through the controller's window and follow writes */
+static int dm_test_spi_flash_dirmap(struct unit_test_state *uts)
+{
+	struct spi_flash_verify verify;
+	struct spi_flash *flash;
+	u8 buf[0x200], rbuf[0x200];
+
+	/* Only the flash given a window uses one */
+	ut_assertok(run_command("sb save hostfs - 0 spi.bin 200000", 0));
+	flash = spi_flash_probe(0, 0, 0, 0);
+	ut_assertnonnull(flash);
+	ut_asserteq_ptr(NULL, flash->dirmap);
+	sandbox_sf_unbind_emul(state_get_current(), 0, 0);
+
+	ut_assertok(run_command("sb save hostfs - 0 spi6.bin 200000", 0));
+	flash = spi_flash_probe(0, 6, 0, 0);
+	ut_assertnonnull(flash);
+	ut_assertnonnull(flash->dirmap);
+
+	/* A read across a window boundary moves the window once */
+	memset(buf, 0xa5, sizeof(buf));
+	ut_assertok(spi_flash_erase(flash, 0x10000, 0x20000));
+	ut_assertok(spi_flash_write(flash, 0x1ff00, sizeof(buf), buf));
+	ut_assertok(spi_flash_read(flash, 0x1ff00, sizeof(rbuf), rbuf));
+	ut_assertok(memcmp(buf, rbuf, sizeof(buf)));
+	ut_asserteq(0x20000, flash->dirmap->window_offset);
+	ut_assert(flash->dirmap->window_valid);
+
+	/* Writing drops the window, so the new data is seen */
+	memset(buf, 0x3c, sizeof(buf));
+	ut_assertok(spi_flash_write(flash, 0x20100, sizeof(buf), buf));
+	ut_assert(!flash->dirmap->window_valid);
+	ut_assertok(spi_flash_read(flash, 0x20100, sizeof(rbuf), rbuf));
+	ut_assertok(memcmp(buf, rbuf, sizeof(buf)));
+
+	/* A verified write reads each page back through the window */
+	ut_assertok(spi_flash_erase(flash, 0x10000, 0x20000));
+	ut_assertok(spi_flash_verify_begin(flash, &verify,
+					   SPI_FLASH_VERIFY_CRC32, 0x1ff00,
+					   sizeof(buf)));
+	ut_assertok(spi_flash_write(flash, 0x1ff00, sizeof(buf), buf));
+	ut_assertok(spi_flash_verify_end(flash, &verify));
+	ut_asserteq(crc32(0, buf, sizeof(buf)),
+		    get_unaligned_be32(verify.digest));
+	ut_asserteq(0x20000, flash->dirmap->window_offset);
+	ut_assert(flash->dirmap->window_valid);
+
+	/* Reads past the end are refused */
+	ut_asserteq(-EINVAL, spi_flash_read(flash, flash->size - 4, 8, rbuf));
+
+	sandbox_sf_unbind_emul(state_get_current(), 0, 6);
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_dirmap, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test that small reads are cached, read ahead and dropped on a write */
+static int dm_test_spi_flash_cache(struct unit_test_state *uts)
+{
+	struct spi_flash_cache_stats stats;
+	struct spi_flash *flash;
+	u8 buf[0x100], rbuf[0x100], big[0x2000];
+
+	ut_assertok(run_command("sb save hostfs - 0 spi.bin 200000", 0));
+	flash = spi_flash_probe(0, 0, 0, 0);
+	ut_assertnonnull(flash);
+	memset(buf, 0x69, sizeof(buf));
+	ut_assertok(spi_flash_erase(flash, 0, 0x10000));
+	ut_assertok(spi_flash_write(flash, 0x2080, sizeof(buf), buf));
+	spi_flash_cache_stats(&stats, true);
+
+	/* The second read of a line does not go to the flash */
+	ut_assertok(spi_flash_read(flash, 0x1000, 0x10, rbuf));
+	ut_assertok(spi_flash_read(flash, 0x1010, 0x10, rbuf));
+	spi_flash_cache_stats(&stats, true);
+	ut_asserteq(1, stats.hits);
+	ut_asserteq(1, stats.misses);
+	ut_asserteq(0, stats.readahead);
+
+	/* Missing the next line reads the one after it too */
+	ut_assertok(spi_flash_read(flash, 0x1ff0, 0x20, rbuf));
+	ut_assertok(spi_flash_read(flash, 0x2080, sizeof(rbuf), rbuf));
+	ut_assertok(memcmp(buf, rbuf, sizeof(buf)));
+	spi_flash_cache_stats(&stats, true);
+	ut_asserteq(2, stats.hits);
+	ut_asserteq(1, stats.misses);
+	ut_asserteq(1, stats.readahead);
+	ut_asserteq(3, stats.lines);
+
+	/* Writes and erases drop what they touch, and nothing else */
+	memset(buf, 0x18, sizeof(buf));
+	ut_assertok(spi_flash_write(flash, 0x2180, sizeof(buf), buf));
+	ut_assertok(spi_flash_read(flash, 0x2180, sizeof(rbuf), rbuf));
+	ut_assertok(memcmp(buf, rbuf, sizeof(buf)));
+	ut_assertok(spi_flash_read(flash, 0x1000, 0x10, rbuf));
+	ut_assertok(spi_flash_erase(flash, 0, 0x10000));
+	ut_assertok(spi_flash_read(flash, 0x2180, sizeof(rbuf), rbuf));
+	memset(buf, 0xff, sizeof(buf));
+	ut_assertok(memcmp(buf, rbuf, sizeof(buf)));
+	spi_flash_cache_stats(&stats, true);
+	ut_asserteq(1, stats.hits);
+	ut_asserteq(2, stats.misses);
+
+	/* Big reads go around the cache */
+	ut_assertok(spi_flash_read(flash, 0x4000, sizeof(big), big));
+	spi_flash_cache_stats(&stats, true);
+	ut_asserteq(0, stats.hits + stats.misses);
+
+	/* Removing the flash empties the cache */
+	ut_assertok(run_command("sf cache reset", 0));
+	ut_assertok(device_remove(flash->dev));
+	spi_flash_cache_stats(&stats, false);
+	ut_asserteq(0, stats.lines);
+	sandbox_sf_unbind_emul(state_get_current(), 0, 0);
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_cache, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Check that a chip's file holds the given data at an offset */
+static int check_chip_file(struct unit_test_state *uts, const char *fname,
+			   ulong offset, const u8 *data, size_t len)
+{
+	char cmd[80];
+
+	snprintf(cmd, sizeof(cmd), "sb load hostfs - 0 %s %zx %lx", fname,
+		 len, offset);
+	ut_assertok(run_command(cmd, 0));
+	ut_assertok(memcmp(map_sysmem(0, len), data, len));
+
+	return 0;
+}
+
+/* Test dual stacked and interleaved flash made of two sandbox chips */
+static int dm_test_spi_flash_dual(struct unit_test_state *uts)
+{
+	struct spi_flash *flash;
+	struct udevice *dev, *upper;
+	u8 buf[0x400], rbuf[0x400];
+	int i;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i / 0x100 + 1;
+	ut_assertok(run_command("sb save hostfs - 0 spi2.bin 200000", 0));
+	ut_assertok(run_command("sb save hostfs - 0 spi3.bin 200000", 0));
+	ut_assertok(run_command("sb save hostfs - 0 spi4.bin 200000", 0));
+	ut_assertok(run_command("sb save hostfs - 0 spi5.bin 200000", 0));
+
+	/* Stacked: the second chip follows the first */
+	ut_assertok(uclass_get_device_by_name(UCLASS_SPI_FLASH, "spi-dual@2",
+					      &dev));
+	flash = dev_get_uclass_priv(dev);
+	ut_asserteq(0x400000, flash->size);
+	ut_assertok(spi_flash_erase_dm(dev, 0, flash->size));
+	ut_asserteq(2, flash->erase_chip_count);
+	ut_assertok(spi_flash_write_dm(dev, 0x1ffe00, sizeof(buf), buf));
+	ut_assertok(spi_flash_read_dm(dev, 0x1ffe00, sizeof(rbuf), rbuf));
+	ut_assertok(memcmp(buf, rbuf, sizeof(buf)));
+	ut_assertok(check_chip_file(uts, "spi2.bin", 0x1ffe00, buf, 0x200));
+	ut_assertok(check_chip_file(uts, "spi3.bin", 0, buf + 0x200, 0x200));
+
+	/* Interleaved: pages alternate between the chips */
+	ut_assertok(uclass_get_device_by_name(UCLASS_SPI_FLASH, "spi-dual@4",
+					      &dev));
+	flash = dev_get_uclass_priv(dev);
+	ut_asserteq(0x400000, flash->size);
+	ut_asserteq(0x200, flash->page_size);
+	ut_asserteq(0x20000, flash->erase_size);
+	ut_assertok(spi_flash_erase_dm(dev, 0x20000, 0x20000));
+	ut_asserteq(1, flash->erase_types[0].count);
+	ut_assertok(spi_flash_write_dm(dev, 0x20000, sizeof(buf), buf));
+	ut_asserteq(4, flash->write_stats.pages);
+	ut_assertok(spi_flash_read_dm(dev, 0x20000, sizeof(rbuf), rbuf));
+	ut_assertok(memcmp(buf, rbuf, sizeof(buf)));
+	ut_assertok(check_chip_file(uts, "spi4.bin", 0x10000, buf, 0x100));
+	ut_assertok(check_chip_file(uts, "spi5.bin", 0x10000, buf + 0x100,
+				    0x100));
+	ut_assertok(check_chip_file(uts, "spi4.bin", 0x10100, buf + 0x200,
+				    0x100));
+
+	/* Removing the flash unbinds the chip select bound for it */
+	ut_assertok(spi_find_chip_select(dev->parent, 5, &upper));
+	ut_assertok(device_remove(dev));
+	ut_asserteq(-ENODEV, spi_find_chip_select(dev->parent, 5, &upper));
+	ut_assertok(spi_find_chip_select(dev->parent, 4, &upper));
+	ut_asserteq_ptr(dev, upper);
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_dual, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test that reads are served in the middle of a background erase */
+static int dm_test_spi_flash_async_erase(struct unit_test_state *uts)
+{
+	struct sandbox_state *state = state_get_current();
+	struct spi_flash_async_erase *job;
+	struct spi_flash *flash;
+	struct udevice *bus, *dev;
+	const int busnum = 0, cs = 1;
+	u8 buf[0x100], rbuf[0x100], erased[0x100];
+	int i, ret;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i;
+	memset(erased, 0xff, sizeof(erased));
+
+	/* A flash with erase suspend, taking 64ms for each 64KiB block */
+	ut_assertok(uclass_get_device_by_seq(UCLASS_SPI, busnum, &bus));
+	state->spi[busnum][cs].spec = "w25q16cl:spisusp.bin";
+	ut_assertok(sandbox_sf_bind_emul(state, busnum, cs, bus, -1,
+					 "w25q16cl"));
+	ut_assertok(run_command("sb save hostfs - 0 spisusp.bin 200000", 0));
+	ut_assertok(spi_flash_probe_bus_cs(busnum, cs, 0, 0, &dev));
+	ut_assertok(spi_flash_erase_dm(dev, 0x20000, 0x10000));
+	sandbox_sf_set_erase_time(state->spi[busnum][cs].emul, 4000);
+	flash = dev_get_uclass_priv(dev);
+	job = &flash->async_erase;
+	ut_assertok(spi_flash_write_dm(dev, 0x20000, sizeof(buf), buf));
+
+	/* The block in flight is suspended for the read, then resumed */
+	ut_assertok(spi_flash_erase_start_dm(dev, 0, 0x20000));
+	ut_asserteq(0x10000, job->block);
+	ut_asserteq(-EBUSY, spi_flash_write_dm(dev, 0, sizeof(buf), buf));
+	ut_asserteq(-EBUSY, spi_flash_erase_start_dm(dev, 0x30000, 0x10000));
+	ut_assertok(spi_flash_read_dm(dev, 0x20000, sizeof(rbuf), rbuf));
+	ut_assertok(memcmp(buf, rbuf, sizeof(rbuf)));
+	ut_asserteq(0, job->offset);
+	ut_asserteq(0x10000, job->block);
+	ut_asserteq(false, job->suspended);
+
+	/* Suspended, the erase does not move on however long it is left */
+	ut_assertok(spi_flash_erase_suspend_dm(dev));
+	sandbox_timer_add_offset(1000);
+	ut_asserteq(-EBUSY, spi_flash_erase_poll_dm(dev));
+	ut_asserteq(0, job->offset);
+	ut_assertok(spi_flash_erase_resume_dm(dev));
+
+	/* Reading the block being erased waits for that block */
+	ut_assertok(spi_flash_read_dm(dev, 0x8000, sizeof(rbuf), rbuf));
+	ut_assertok(memcmp(erased, rbuf, sizeof(rbuf)));
+	ut_asserteq(0x10000, job->offset);
+
+	while ((ret = spi_flash_erase_poll_dm(dev)) == -EBUSY)
+		;
+	ut_assertok(ret);
+	ut_asserteq(0, job->len);
+	ut_assertok(spi_flash_read_dm(dev, 0x1ff00, sizeof(rbuf), rbuf));
+	ut_assertok(memcmp(erased, rbuf, sizeof(rbuf)));
+	ut_assertok(spi_flash_read_dm(dev, 0x20000, sizeof(rbuf), rbuf));
+	ut_assertok(memcmp(buf, rbuf, sizeof(rbuf)));
+
+	sandbox_sf_unbind_emul(state, busnum, cs);
+	state->spi[busnum][cs].spec = NULL;
+
+	/* Without erase suspend, a read waits just for the block in flight */
+	ut_assertok(run_command("sb save hostfs - 0 spi.bin 200000", 0));
+	ut_assertok(uclass_get_device_by_name(UCLASS_SPI_FLASH, "spi.bin@0",
+					      &dev));
+	ut_assertok(spi_flash_erase_dm(dev, 0x20000, 0x10000));
+	sandbox_sf_set_erase_time(state->spi[busnum][0].emul, 1000);
+	flash = dev_get_uclass_priv(dev);
+	job = &flash->async_erase;
+	ut_assertok(spi_flash_write_dm(dev, 0x20000, sizeof(buf), buf));
+	ut_assertok(spi_flash_erase_start_dm(dev, 0, 0x20000));
+	ut_assertok(spi_flash_read_dm(dev, 0x20000, sizeof(rbuf), rbuf));
+	ut_assertok(memcmp(buf, rbuf, sizeof(rbuf)));
+	ut_asserteq(0x10000, job->offset);
+	ut_asserteq(0, job->block);
+	while ((ret = spi_flash_erase_poll_dm(dev)) == -EBUSY)
+		;
+	ut_assertok(ret);
+	ut_assertok(spi_flash_read_dm(dev, 0x1ff00, sizeof(rbuf), rbuf));
+	ut_assertok(memcmp(erased, rbuf, sizeof(rbuf)));
+
+	sandbox_sf_unbind_emul(state, busnum, 0);
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_async_erase, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
@@ -8,6 +8,7 @@
 #include <dm.h>
 #include <fdtdec.h>
 #include <spi.h>
+#include <spi-mem.h>
 #include <spi_flash.h>
 #include <asm/state.h>
 #include <dm/device-internal.h>
@@ -125,3 +126,41 @@ static int dm_test_spi_xfer(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_spi_xfer, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test that SPI memory operations are checked and run over spi_xfer() */
+static int dm_test_spi_mem(struct unit_test_state *uts)
+{
+	struct spi_slave *slave;
+	struct udevice *bus;
+	const int busnum = 0, cs = 0, mode = 0;
+	unsigned char din[3];
+	struct spi_mem_op op = SPI_MEM_OP(SPI_MEM_OP_CMD(0x9f, 1),
+					  SPI_MEM_OP_NO_ADDR,
+					  SPI_MEM_OP_NO_DUMMY,
+					  SPI_MEM_OP_DATA_IN(3, din, 1));
+
+	ut_assertok(spi_get_bus_and_cs(busnum, cs, 1000000, mode, NULL, 0,
+				       &bus, &slave));
+	ut_assertok(spi_claim_bus(slave));
+	ut_assert(spi_mem_supports_op(slave, &op));
+	ut_assertok(spi_mem_exec_op(slave, &op));
+	ut_asserteq(0x20, din[0]);
+	ut_asserteq(0x20, din[1]);
+	ut_asserteq(0x15, din[2]);
+
+	/* Quad data needs SPI_RX_QUAD in the mode */
+	op.data.buswidth = 4;
+	ut_assert(!spi_mem_supports_op(slave, &op));
+	ut_asserteq(-ENOTSUPP, spi_mem_exec_op(slave, &op));
+	slave->mode |= SPI_RX_QUAD;
+	ut_assert(spi_mem_supports_op(slave, &op));
+	slave->mode &= ~SPI_RX_QUAD;
+	spi_release_bus(slave);
+
+#ifdef CONFIG_DM_SPI_FLASH
+	sandbox_sf_unbind_emul(state_get_current(), busnum, cs);
+#endif
+
+	return 0;
+}
+DM_TEST(dm_test_spi_mem, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
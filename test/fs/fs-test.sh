@@ -9,14 +9,14 @@
 # It currently tests the fs/sb and native commands for ext4 and fat partitions
 # Expected results are as follows:
 # EXT4 tests:
-# fs-test.sb.ext4.out: Summary: PASS: 23 FAIL: 0
-# fs-test.ext4.out: Summary: PASS: 23 FAIL: 0
-# fs-test.fs.ext4.out: Summary: PASS: 23 FAIL: 0
+# fs-test.sb.ext4.out: Summary: PASS: 25 FAIL: 0
+# fs-test.ext4.out: Summary: PASS: 25 FAIL: 0
+# fs-test.fs.ext4.out: Summary: PASS: 25 FAIL: 0
 # FAT tests:
-# fs-test.sb.fat.out: Summary: PASS: 23 FAIL: 0
-# fs-test.fat.out: Summary: PASS: 20 FAIL: 3
-# fs-test.fs.fat.out: Summary: PASS: 20 FAIL: 3
-# Total Summary: TOTAL PASS: 132 TOTAL FAIL: 6
+# fs-test.sb.fat.out: Summary: PASS: 25 FAIL: 0
+# fs-test.fat.out: Summary: PASS: 22 FAIL: 3
+# fs-test.fs.fat.out: Summary: PASS: 22 FAIL: 3
+# Total Summary: TOTAL PASS: 144 TOTAL FAIL: 6
 
 # pre-requisite binaries list.
 PREREQ_BINS="md5sum mkfs mount umount dd fallocate mkdir"
@@ -146,6 +146,7 @@ function create_image() {
 # UBOOT is set in env
 function test_image() {
 	addr="0x01000008"
+	oddaddr="0x01000001"
 	length="0x00100000"
 
 	case "$2" in
@@ -316,6 +317,14 @@ ${PREFIX}load host${SUFFIX} $addr ${FPATH}${FILE_WRITE}2
 md5sum $addr \$filesize
 setenv filesize
 #
+
+# Test Case 14a - Read full 1MB of small file to an odd address
+${PREFIX}load host${SUFFIX} $oddaddr ${FPATH}$FILE_SMALL
+printenv filesize
+# Test Case 14b - Read full 1MB of small file to an odd address
+md5sum $oddaddr \$filesize
+setenv filesize
+#
 reset
 
 EOF
@@ -509,6 +518,12 @@ function check_results() {
 	check_md5 "Test Case 13c " "$1" "$2" 1 \
 		"TC13: 1MB read from $3.w2 - content verified"
 
+	# Check read full mb of 1MB.file to an odd address
+	grep -A4 "Test Case 14a " "$1" | grep -q "filesize=100000"
+	pass_fail "TC14: load of $3 to an odd address size"
+	check_md5 "Test Case 14b " "$1" "$2" 1 \
+		"TC14: load of $3 to an odd address"
+
 	echo "** End $1"
 }
 